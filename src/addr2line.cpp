@@ -0,0 +1,348 @@
+#include "addr2line.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "fonda_lib/symbolizer.h"
+#include "dump_writer.h"
+
+// ----------------------------------------------------------------------------
+static void addr2line_usage()
+{
+	fprintf(stdout,
+		"Usage: fonda addr2line [options] [address...]\n\n"
+		"Addresses are read from stdin if none are given.\n\n"
+		"Options:\n"
+		"  -e <file>          Executable to read (default a.out)\n"
+		"  --tos              Parse the executable as TOS/PRG\n"
+		"  --input <file>     Read addresses from a file rather than stdin\n"
+		"  -a                 Print the address before each result\n"
+		"  -f                 Print the function name\n"
+		"  -i                 Also print the functions the code is inlined into\n"
+		"  -s                 Print only the base name of each file\n"
+		"  --column           Print the column after the line number\n\n"
+	);
+}
+
+// ----------------------------------------------------------------------------
+struct addr2line_query
+{
+	uint64_t address;
+	uint32_t index;				// position in the input
+};
+
+struct addr2line_result
+{
+	const fonda::line_index::entry* line;	// nullptr if not found
+	const fonda::lookup_symbol* symbol;		// nullptr if not found
+};
+
+// ----------------------------------------------------------------------------
+// Parse whitespace-separated hex addresses, with or without "0x"
+static void parse_addresses(const char* text, size_t length, std::vector<addr2line_query>& queries)
+{
+	const char* end = text + length;
+	const char* p = text;
+	while (p < end)
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+			++p;
+		if (p == end)
+			break;
+		if (end - p >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+			p += 2;
+
+		uint64_t val = 0;
+		while (p < end)
+		{
+			char c = *p;
+			uint32_t digit;
+			if (c >= '0' && c <= '9')
+				digit = c - '0';
+			else if (c >= 'a' && c <= 'f')
+				digit = c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F')
+				digit = c - 'A' + 10;
+			else
+				break;
+			val = (val << 4) | digit;
+			++p;
+		}
+		// Skip anything else up to the next whitespace
+		while (p < end && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r')
+			++p;
+
+		addr2line_query q;
+		q.address = val;
+		q.index = queries.size();
+		queries.push_back(q);
+	}
+}
+
+// ----------------------------------------------------------------------------
+static bool read_addresses(FILE* pFile, std::vector<addr2line_query>& queries)
+{
+	std::vector<char> text;
+	char buffer[65536];
+	size_t count;
+	while ((count = fread(buffer, 1, sizeof(buffer), pFile)) != 0)
+		text.insert(text.end(), buffer, buffer + count);
+	if (ferror(pFile))
+		return false;
+	parse_addresses(text.data(), text.size(), queries);
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+// Resolve all the queries with one pass over the sorted line and symbol tables.
+static void resolve(const fonda::symbolizer& mod, std::vector<addr2line_query>& queries,
+	std::vector<addr2line_result>& results)
+{
+	std::sort(queries.begin(), queries.end(),
+		[](const addr2line_query& a, const addr2line_query& b) { return a.address < b.address; });
+
+	results.resize(queries.size());
+	const std::vector<fonda::line_index::entry>& entries = mod.lines().entries();
+	const std::vector<fonda::lookup_symbol>& symbols = mod.symbols().symbols();
+	size_t line_pos = 0;		// first entry above the current query
+	size_t sym_pos = 0;			// first symbol above the current query
+	for (const addr2line_query& q : queries)
+	{
+		while (line_pos < entries.size() && entries[line_pos].address <= q.address)
+			++line_pos;
+		while (sym_pos < symbols.size() && symbols[sym_pos].address <= q.address)
+			++sym_pos;
+
+		addr2line_result& res = results[q.index];
+		res.line = line_pos && mod.lines().covers(entries[line_pos - 1], q.address) ?
+			&entries[line_pos - 1] : nullptr;
+		res.symbol = mod.symbols().find_below(sym_pos, q.address);
+	}
+}
+
+// ----------------------------------------------------------------------------
+static void put_location(output_buffer& out, const fonda::line_location* loc,
+	bool base_names, bool print_column)
+{
+	if (!loc || !loc->file)
+	{
+		out.put_str(print_column ? "??:0:0\n" : "??:0\n");
+		return;
+	}
+
+	if (!base_names && loc->file->dir_index < loc->unit->dirs.size())
+	{
+		out.put_str(loc->unit->dirs[loc->file->dir_index]);
+		out.put_char('/');
+	}
+	const char* path = loc->file->path.c_str();
+	if (base_names && strrchr(path, '/'))
+		path = strrchr(path, '/') + 1;
+	out.put_str(path);
+	out.put_char(':');
+	out.put_dec(loc->point->line);
+	if (print_column)
+	{
+		out.put_char(':');
+		out.put_dec(loc->point->column);
+	}
+	out.put_char('\n');
+}
+
+// ----------------------------------------------------------------------------
+// Print the call site of an inlined function, in the function it is inlined into
+static void put_call_site(output_buffer& out, const fonda::inline_call& call,
+	bool base_names, bool print_column)
+{
+	if (!call.file)
+	{
+		put_location(out, nullptr, base_names, print_column);
+		return;
+	}
+	fonda::code_point point = {};
+	point.line = call.line;
+	point.column = call.column;
+	fonda::line_location loc;
+	loc.unit = call.unit;
+	loc.point = &point;
+	loc.file = call.file;
+	put_location(out, &loc, base_names, print_column);
+}
+
+// ----------------------------------------------------------------------------
+// Look up a single address in an ELF file, decoding only the line program of
+// the unit that covers it. Returns false if the full load is needed instead.
+static bool lookup_single(const char* fname, uint64_t address, bool print_address,
+	bool base_names, bool print_column)
+{
+	FILE* pInfile = fopen(fname, "rb");
+	if (!pInfile)
+		return false;
+	if (fonda::is_tos_file(pInfile))
+	{
+		fclose(pInfile);
+		return false;
+	}
+
+	fonda::compilation_unit unit;
+	size_t point_index = 0;
+	int ret = fonda::lookup_elf_address(pInfile, address, unit, point_index);
+	fclose(pInfile);
+	if (ret != fonda::elf_error::OK && ret != fonda::elf_error::ERROR_ADDRESS_NOT_FOUND)
+		return false;
+
+	output_buffer out(stdout);
+	if (print_address)
+	{
+		out.put_str("0x");
+		out.put_hex(address, 8);
+		out.put_char('\n');
+	}
+	if (ret != fonda::elf_error::OK)
+	{
+		put_location(out, nullptr, base_names, print_column);
+		return true;
+	}
+	fonda::line_location loc;
+	loc.unit = &unit;
+	loc.point = &unit.points[point_index];
+	loc.file = loc.point->file_index < unit.files.size() ? &unit.files[loc.point->file_index] : nullptr;
+	put_location(out, &loc, base_names, print_column);
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+int addr2line_main(int argc, char** argv)
+{
+	const char* fname = "a.out";
+	const char* input_fname = nullptr;
+	bool force_tos = false;
+	bool print_address = false;
+	bool print_function = false;
+	bool print_inlines = false;
+	bool base_names = false;
+	bool print_column = false;
+	std::vector<addr2line_query> queries;
+	std::string args;
+
+	for (int opt = 1; opt < argc; ++opt)
+	{
+		if (strcmp(argv[opt], "-e") == 0 && opt + 1 < argc)
+			fname = argv[++opt];
+		else if (strcmp(argv[opt], "--input") == 0 && opt + 1 < argc)
+			input_fname = argv[++opt];
+		else if (strcmp(argv[opt], "--tos") == 0)
+			force_tos = true;
+		else if (strcmp(argv[opt], "-a") == 0)
+			print_address = true;
+		else if (strcmp(argv[opt], "-f") == 0)
+			print_function = true;
+		else if (strcmp(argv[opt], "-i") == 0)
+			print_inlines = true;
+		else if (strcmp(argv[opt], "-s") == 0)
+			base_names = true;
+		else if (strcmp(argv[opt], "--column") == 0)
+			print_column = true;
+		else if (argv[opt][0] == '-')
+		{
+			fprintf(stderr, "Error: Unknown option: '%s'\n", argv[opt]);
+			addr2line_usage();
+			return 1;
+		}
+		else
+		{
+			args += argv[opt];
+			args += ' ';
+		}
+	}
+
+	if (args.size())
+		parse_addresses(args.c_str(), args.size(), queries);
+
+	// A single address doesn't need the whole file to be parsed. Function
+	// names come from the symbols, and inlined functions from the whole of
+	// the debug info, so still need the full load.
+	if (queries.size() == 1 && !force_tos && !print_function && !print_inlines &&
+		lookup_single(fname, queries[0].address, print_address, base_names, print_column))
+		return 0;
+
+	fonda::symbolizer mod;
+	int ret = mod.load(fname, force_tos);
+	if (ret == -1)
+	{
+		fprintf(stderr, "Error: Can't open file: %s\n", fname);
+		return 1;
+	}
+	if (ret)
+	{
+		fprintf(stderr, "Parsing failed with error %d\n", ret);
+		return 2;
+	}
+
+	if (!args.size())
+	{
+		FILE* pInput = input_fname ? fopen(input_fname, "r") : stdin;
+		if (!pInput)
+		{
+			fprintf(stderr, "Error: Can't open file: %s\n", input_fname);
+			return 1;
+		}
+		bool ok = read_addresses(pInput, queries);
+		if (input_fname)
+			fclose(pInput);
+		if (!ok)
+		{
+			fprintf(stderr, "Error: Can't read addresses\n");
+			return 1;
+		}
+	}
+
+	std::vector<addr2line_result> results;
+	resolve(mod, queries, results);
+
+	// "queries" is now sorted, so recover the input order of addresses
+	std::vector<uint64_t> addresses(queries.size());
+	for (const addr2line_query& q : queries)
+		addresses[q.index] = q.address;
+
+	output_buffer out(stdout);
+	std::vector<fonda::inline_call> inlines;
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const addr2line_result& res = results[i];
+		const char* function = res.symbol ? res.symbol->name.c_str() : "??";
+		inlines.clear();
+		if (print_inlines)
+			mod.find_inline_stack(addresses[i], inlines);
+
+		if (print_address)
+		{
+			out.put_str("0x");
+			out.put_hex(addresses[i], 8);
+			out.put_char('\n');
+		}
+		if (print_function)
+		{
+			out.put_str(inlines.size() ? inlines[0].name->c_str() : function);
+			out.put_char('\n');
+		}
+
+		fonda::line_location loc;
+		if (res.line)
+			loc = mod.lines().get_location(*res.line);
+		put_location(out, res.line ? &loc : nullptr, base_names, print_column);
+
+		// Each inlined function is called from the next one out
+		for (size_t j = 0; j < inlines.size(); ++j)
+		{
+			if (print_function)
+			{
+				out.put_str(j + 1 < inlines.size() ? inlines[j + 1].name->c_str() : function);
+				out.put_char('\n');
+			}
+			put_call_site(out, inlines[j], base_names, print_column);
+		}
+	}
+	return 0;
+}
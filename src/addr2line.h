@@ -0,0 +1,10 @@
+#ifndef ADDR2LINE_H
+#define ADDR2LINE_H
+
+// ----------------------------------------------------------------------------
+// "fonda addr2line": batch address symbolisation, compatible with the output
+// of binutils addr2line. argv[0] is the subcommand name.
+// Returns the process exit code.
+extern int addr2line_main(int argc, char** argv);
+
+#endif // ADDR2LINE_H
@@ -3,8 +3,8 @@ set -e
 SRC_PATH=.
 CC=g++
 LD=g++
-CFLAGS="-DDEBUG -I${SRC_PATH}/lib -std=c++11 -g -O0 -Wall"
-LDFLAGS="-lc"
+CFLAGS="-DDEBUG -I${SRC_PATH}/lib -std=c++11 -g -O0 -Wall -pthread"
+LDFLAGS="-lc -pthread"
 
 rm -f fonda
 
@@ -14,10 +14,19 @@ set -x
 # Library files
 ${CC} ${CFLAGS} -c -o fonda_lib/readelf.o fonda_lib/readelf.cpp
 ${CC} ${CFLAGS} -c -o fonda_lib/readtos.o fonda_lib/readtos.cpp
+${CC} ${CFLAGS} -c -o fonda_lib/lookup_index.o fonda_lib/lookup_index.cpp
+${CC} ${CFLAGS} -c -o fonda_lib/symbolizer.o fonda_lib/symbolizer.cpp
+${CC} ${CFLAGS} -c -o fonda_lib/address_space.o fonda_lib/address_space.cpp
+${CC} ${CFLAGS} -c -o fonda_lib/async_loader.o fonda_lib/async_loader.cpp
 
-# Application file
+# Application files
+${CC} ${CFLAGS} -c -o dump_writer.o dump_writer.cpp
+${CC} ${CFLAGS} -c -o server.o server.cpp
+${CC} ${CFLAGS} -c -o addr2line.o addr2line.cpp
 ${CC} ${CFLAGS} -c -o main.o main.cpp
 
-${LD} ${LDFLAGS} fonda_lib/readelf.o fonda_lib/readtos.o main.o -o fonda
+${LD} ${LDFLAGS} fonda_lib/readelf.o fonda_lib/readtos.o fonda_lib/lookup_index.o fonda_lib/symbolizer.o \
+	fonda_lib/address_space.o fonda_lib/async_loader.o \
+	dump_writer.o server.o addr2line.o main.o -o fonda
 
 
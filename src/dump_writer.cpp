@@ -0,0 +1,409 @@
+#include "dump_writer.h"
+
+// ----------------------------------------------------------------------------
+//	OUTPUT BUFFER
+// ----------------------------------------------------------------------------
+output_buffer::output_buffer(FILE* pOut, size_t size) :
+	m_pOut(pOut),
+	m_pData(new char[size]),
+	m_size(size),
+	m_pos(0)
+{
+}
+
+// ----------------------------------------------------------------------------
+output_buffer::~output_buffer()
+{
+	flush();
+	delete [] m_pData;
+}
+
+// ----------------------------------------------------------------------------
+void output_buffer::flush()
+{
+	if (m_pos)
+		fwrite(m_pData, 1, m_pos, m_pOut);
+	m_pos = 0;
+}
+
+// ----------------------------------------------------------------------------
+void output_buffer::put_str(const char* str, size_t len)
+{
+	while (len)
+	{
+		if (m_pos == m_size)
+			flush();
+		size_t count = m_size - m_pos;
+		if (count > len)
+			count = len;
+		memcpy(m_pData + m_pos, str, count);
+		m_pos += count;
+		str += count;
+		len -= count;
+	}
+}
+
+// ----------------------------------------------------------------------------
+void output_buffer::put_str_padded(const std::string& str, size_t width)
+{
+	for (size_t i = str.size(); i < width; ++i)
+		put_char(' ');
+	put_str(str);
+}
+
+// ----------------------------------------------------------------------------
+void output_buffer::put_hex(uint64_t val, int min_width)
+{
+	static const char digits[] = "0123456789abcdef";
+	char tmp[16];
+	int count = 0;
+	do
+	{
+		tmp[count++] = digits[val & 0xf];
+		val >>= 4;
+	} while (val);
+	while (count < min_width && count < 16)
+		tmp[count++] = '0';
+	while (count)
+		put_char(tmp[--count]);
+}
+
+// ----------------------------------------------------------------------------
+void output_buffer::put_dec(uint64_t val, int min_width)
+{
+	char tmp[20];
+	int count = 0;
+	do
+	{
+		tmp[count++] = '0' + (val % 10);
+		val /= 10;
+	} while (val);
+	while (count < min_width && count < 20)
+		tmp[count++] = '0';
+	while (count)
+		put_char(tmp[--count]);
+}
+
+// ----------------------------------------------------------------------------
+void output_buffer::put_sdec(int64_t val)
+{
+	if (val < 0)
+	{
+		put_char('-');
+		put_dec(-(uint64_t)val);
+	}
+	else
+		put_dec(val);
+}
+
+// ----------------------------------------------------------------------------
+void output_buffer::put_json_str(const std::string& str)
+{
+	static const char digits[] = "0123456789abcdef";
+	put_char('"');
+	for (size_t i = 0; i < str.size(); ++i)
+	{
+		unsigned char c = str[i];
+		if (c == '"' || c == '\\')
+		{
+			put_char('\\');
+			put_char(c);
+		}
+		else if (c < 0x20)
+		{
+			put_str("\\u00", 4);
+			put_char(digits[c >> 4]);
+			put_char(digits[c & 0xf]);
+		}
+		else
+			put_char(c);
+	}
+	put_char('"');
+}
+
+// ----------------------------------------------------------------------------
+//	DUMP FORMATS
+// ----------------------------------------------------------------------------
+// Same escaping as output_buffer::put_json_str, for strings that are reused
+static std::string json_quote(const std::string& str)
+{
+	static const char digits[] = "0123456789abcdef";
+	std::string quoted;
+	quoted.reserve(str.size() + 2);
+	quoted += '"';
+	for (size_t i = 0; i < str.size(); ++i)
+	{
+		unsigned char c = str[i];
+		if (c == '"' || c == '\\')
+		{
+			quoted += '\\';
+			quoted += c;
+		}
+		else if (c < 0x20)
+		{
+			quoted += "\\u00";
+			quoted += digits[c >> 4];
+			quoted += digits[c & 0xf];
+		}
+		else
+			quoted += c;
+	}
+	quoted += '"';
+	return quoted;
+}
+
+// ----------------------------------------------------------------------------
+bool parse_dump_format(const char* name, dump_format& format)
+{
+	if (strcmp(name, "text") == 0)
+		format = DUMP_FORMAT_TEXT;
+	else if (strcmp(name, "tsv") == 0)
+		format = DUMP_FORMAT_TSV;
+	else if (strcmp(name, "json") == 0)
+		format = DUMP_FORMAT_JSON;
+	else
+		return false;
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+void dump_writer::heading(const char* text)
+{
+	// Only the text format has headings. The others are one record per line.
+	if (m_format == DUMP_FORMAT_TEXT)
+		m_out.put_str(text);
+}
+
+// ----------------------------------------------------------------------------
+void dump_writer::input_file(const char* fname)
+{
+	switch (m_format)
+	{
+		case DUMP_FORMAT_TEXT:
+			m_out.put_str("File: \"");
+			m_out.put_str(fname);
+			m_out.put_str("\"\n");
+			break;
+		case DUMP_FORMAT_TSV:
+			m_out.put_str("input\t");
+			m_out.put_str(fname);
+			m_out.put_char('\n');
+			break;
+		case DUMP_FORMAT_JSON:
+			m_out.put_str("{\"type\":\"input\",\"path\":");
+			m_out.put_json_str(fname);
+			m_out.put_str("}\n");
+			break;
+	}
+}
+
+// ----------------------------------------------------------------------------
+void dump_writer::section_header()
+{
+	heading("\n==== SECTION INFORMATION ===\n\n");
+}
+
+// ----------------------------------------------------------------------------
+void dump_writer::section(const fonda::elf_section& s)
+{
+	switch (m_format)
+	{
+		case DUMP_FORMAT_TEXT:
+			m_out.put_char('[');
+			m_out.put_dec(s.section_id, 3);
+			m_out.put_str("] [");
+			m_out.put_str_padded(s.name_string, 20);
+			m_out.put_str("] [");
+			m_out.put_hex(s.offset, 8);
+			m_out.put_str("] [");
+			m_out.put_hex(s.size, 8);
+			m_out.put_str("] [type: ");
+			m_out.put_hex(s.type, 8);
+			m_out.put_str("] [addr:");
+			m_out.put_hex(s.addr, 8);
+			m_out.put_str("]\n");
+			break;
+		case DUMP_FORMAT_TSV:
+			m_out.put_str("section\t");
+			m_out.put_dec(s.section_id);
+			m_out.put_char('\t');
+			m_out.put_str(s.name_string);
+			m_out.put_char('\t');
+			m_out.put_hex(s.offset);
+			m_out.put_char('\t');
+			m_out.put_hex(s.size);
+			m_out.put_char('\t');
+			m_out.put_hex(s.type);
+			m_out.put_char('\t');
+			m_out.put_hex(s.addr);
+			m_out.put_char('\n');
+			break;
+		case DUMP_FORMAT_JSON:
+			m_out.put_str("{\"type\":\"section\",\"id\":");
+			m_out.put_dec(s.section_id);
+			m_out.put_str(",\"name\":");
+			m_out.put_json_str(s.name_string);
+			m_out.put_str(",\"offset\":");
+			m_out.put_dec(s.offset);
+			m_out.put_str(",\"size\":");
+			m_out.put_dec(s.size);
+			m_out.put_str(",\"sh_type\":");
+			m_out.put_dec(s.type);
+			m_out.put_str(",\"addr\":");
+			m_out.put_dec(s.addr);
+			m_out.put_str("}\n");
+			break;
+	}
+}
+
+// ----------------------------------------------------------------------------
+void dump_writer::line_header()
+{
+	heading("\n\n==== LINE INFORMATION ===\n\n");
+}
+
+// ----------------------------------------------------------------------------
+void dump_writer::unit(const fonda::compilation_unit& unit)
+{
+	// Format the full path of each file once, rather than per code point.
+	// For JSON the stored path is already quoted and escaped.
+	m_paths.clear();
+	for (const fonda::compilation_unit::file& file : unit.files)
+	{
+		std::string path;
+		if (file.dir_index < unit.dirs.size())
+			path = unit.dirs[file.dir_index];
+		path += "/";
+		path += file.path;
+		if (m_format == DUMP_FORMAT_JSON)
+			path = json_quote(path);
+		m_paths.push_back(path);
+
+		switch (m_format)
+		{
+			case DUMP_FORMAT_TEXT:
+				m_out.put_str("\tfile ");
+				m_out.put_str(path);
+				m_out.put_char('\n');
+				break;
+			case DUMP_FORMAT_TSV:
+				m_out.put_str("file\t");
+				m_out.put_str(path);
+				m_out.put_char('\n');
+				break;
+			case DUMP_FORMAT_JSON:
+				m_out.put_str("{\"type\":\"file\",\"path\":");
+				m_out.put_str(path);
+				m_out.put_str("}\n");
+				break;
+		}
+	}
+
+	static const std::string unknown_path("?");
+	for (const fonda::code_point& cp : unit.points)
+	{
+		const std::string& path = cp.file_index < m_paths.size() ?
+			m_paths[cp.file_index] : unknown_path;
+		switch (m_format)
+		{
+			case DUMP_FORMAT_TEXT:
+				m_out.put_str("\t\tAddress: ");
+				m_out.put_hex(cp.address);
+				m_out.put_str(" File: \"");
+				m_out.put_str(path);
+				m_out.put_str("\" Line: ");
+				m_out.put_sdec((int32_t)cp.line);
+				m_out.put_str(" Col: ");
+				m_out.put_dec(cp.column);
+				m_out.put_char('\n');
+				break;
+			case DUMP_FORMAT_TSV:
+				m_out.put_str("line\t");
+				m_out.put_hex(cp.address);
+				m_out.put_char('\t');
+				m_out.put_str(path);
+				m_out.put_char('\t');
+				m_out.put_dec(cp.line);
+				m_out.put_char('\t');
+				m_out.put_dec(cp.column);
+				m_out.put_char('\n');
+				break;
+			case DUMP_FORMAT_JSON:
+				m_out.put_str("{\"type\":\"line\",\"address\":");
+				m_out.put_dec(cp.address);
+				m_out.put_str(",\"path\":");
+				m_out.put_str(path);
+				m_out.put_str(",\"line\":");
+				m_out.put_dec(cp.line);
+				m_out.put_str(",\"column\":");
+				m_out.put_dec(cp.column);
+				m_out.put_str("}\n");
+				break;
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+void dump_writer::symbol_header()
+{
+	heading("\n\n==== SYMBOL INFORMATION ===\n\n");
+}
+
+// ----------------------------------------------------------------------------
+void dump_writer::symbol(const fonda::elf_symbol& sym)
+{
+	switch (m_format)
+	{
+		case DUMP_FORMAT_TEXT:
+			m_out.put_str("Symbol: ");
+			m_out.put_hex(sym.st_value, 8);
+			m_out.put_str(" (size: ");
+			m_out.put_hex(sym.st_size, 8);
+			m_out.put_str(") binding=");
+			m_out.put_hex(sym.st_other >> 4);
+			m_out.put_str(" type=");
+			m_out.put_hex(sym.st_other & 0xf);
+			m_out.put_str(" section=(");
+			m_out.put_dec(sym.st_shndx);
+			m_out.put_str(", name ");
+			m_out.put_str(sym.section_type);
+			m_out.put_str(") \"");
+			m_out.put_str(sym.name);
+			m_out.put_str("\"\n");
+			break;
+		case DUMP_FORMAT_TSV:
+			m_out.put_str("symbol\t");
+			m_out.put_hex(sym.st_value);
+			m_out.put_char('\t');
+			m_out.put_hex(sym.st_size);
+			m_out.put_char('\t');
+			m_out.put_dec(sym.st_info >> 4);
+			m_out.put_char('\t');
+			m_out.put_dec(sym.st_info & 0xf);
+			m_out.put_char('\t');
+			m_out.put_dec(sym.st_shndx);
+			m_out.put_char('\t');
+			m_out.put_str(sym.section_type);
+			m_out.put_char('\t');
+			m_out.put_str(sym.name);
+			m_out.put_char('\n');
+			break;
+		case DUMP_FORMAT_JSON:
+			m_out.put_str("{\"type\":\"symbol\",\"address\":");
+			m_out.put_dec(sym.st_value);
+			m_out.put_str(",\"size\":");
+			m_out.put_dec(sym.st_size);
+			m_out.put_str(",\"binding\":");
+			m_out.put_dec(sym.st_info >> 4);
+			m_out.put_str(",\"sym_type\":");
+			m_out.put_dec(sym.st_info & 0xf);
+			m_out.put_str(",\"shndx\":");
+			m_out.put_dec(sym.st_shndx);
+			m_out.put_str(",\"section\":");
+			m_out.put_json_str(sym.section_type);
+			m_out.put_str(",\"name\":");
+			m_out.put_json_str(sym.name);
+			m_out.put_str("}\n");
+			break;
+	}
+}
@@ -0,0 +1,93 @@
+#ifndef DUMP_WRITER_H
+#define DUMP_WRITER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "fonda_lib/readelf.h"
+
+// ----------------------------------------------------------------------------
+// output_buffer -- Accumulates formatted output in a large block of memory and
+// writes it to a FILE* in one go, avoiding the stdio cost of printf per row.
+class output_buffer
+{
+public:
+	output_buffer(FILE* pOut, size_t size = 1 << 20);
+	~output_buffer();
+
+	void flush();
+
+	void put_char(char c)
+	{
+		if (m_pos == m_size)
+			flush();
+		m_pData[m_pos++] = c;
+	}
+	void put_str(const char* str, size_t len);
+	void put_str(const char* str)			{ put_str(str, strlen(str)); }
+	void put_str(const std::string& str)	{ put_str(str.c_str(), str.size()); }
+
+	// Write a string right-aligned in a field of "width" chars (like "%20s")
+	void put_str_padded(const std::string& str, size_t width);
+
+	// Lower-case hex, zero-padded to at least min_width digits (like "%08lx")
+	void put_hex(uint64_t val, int min_width = 1);
+	void put_dec(uint64_t val, int min_width = 1);
+	void put_sdec(int64_t val);
+
+	// Write a string as a quoted JSON string, escaping as necessary
+	void put_json_str(const std::string& str);
+
+private:
+	FILE*		m_pOut;
+	char*		m_pData;
+	size_t		m_size;
+	size_t		m_pos;
+};
+
+// ----------------------------------------------------------------------------
+enum dump_format
+{
+	DUMP_FORMAT_TEXT,		// human-readable, the original fonda output
+	DUMP_FORMAT_TSV,		// tab-separated, one record per line, type in the first column
+	DUMP_FORMAT_JSON		// JSON lines, one object per record
+};
+
+// Returns true and sets "format" if the name is recognised
+extern bool parse_dump_format(const char* name, dump_format& format);
+
+// ----------------------------------------------------------------------------
+// dump_writer -- writes parsed results in one of the dump formats.
+class dump_writer
+{
+public:
+	dump_writer(FILE* pOut, dump_format format) :
+		m_out(pOut),
+		m_format(format)
+	{}
+
+	void input_file(const char* fname);
+
+	void section_header();
+	void section(const fonda::elf_section& s);
+
+	void line_header();
+	void unit(const fonda::compilation_unit& unit);
+
+	void symbol_header();
+	void symbol(const fonda::elf_symbol& sym);
+
+	void flush()		{ m_out.flush(); }
+
+private:
+	void heading(const char* text);
+
+	output_buffer				m_out;
+	dump_format					m_format;
+	std::vector<std::string>	m_paths;	// formatted "dir/path" for each file of the current unit
+};
+
+#endif // DUMP_WRITER_H
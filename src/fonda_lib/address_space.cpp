@@ -0,0 +1,113 @@
+#include "address_space.h"
+#include "elf_struct.h"
+#include <algorithm>
+
+namespace fonda
+{
+// ----------------------------------------------------------------------------
+// Find the link-time extent of a module. Returns false if it has no contents.
+static bool module_extent(const symbolizer& module, uint64_t& start, uint64_t& end)
+{
+	start = ~0ULL;
+	end = 0;
+	if (module.is_tos())
+	{
+		const tos_header& header = module.tos().header;
+		start = 0;
+		end = (uint64_t)header.ph_tlen + header.ph_dlen + header.ph_blen;
+		return end != 0;
+	}
+
+	const elf_results& elf = module.elf();
+	for (const elf_segment& seg : elf.segments)
+	{
+		if (seg.type != PT_LOAD || seg.mem_size == 0)
+			continue;
+		start = std::min(start, seg.vaddr);
+		end = std::max(end, seg.vaddr + seg.mem_size);
+	}
+	// Relocatable files have no segments
+	if (end == 0)
+	{
+		for (const elf_section& sec : elf.sections)
+		{
+			if (!(sec.flags & SHF_ALLOC) || sec.size == 0)
+				continue;
+			start = std::min(start, sec.addr);
+			end = std::max(end, sec.addr + sec.size);
+		}
+	}
+	return end != 0;
+}
+
+// ----------------------------------------------------------------------------
+bool address_space::add(const std::string& name, const symbolizer& module, uint64_t bias)
+{
+	uint64_t start, end;
+	if (!module_extent(module, start, end))
+		return false;
+	return add(name, module, bias, start + bias, end + bias);
+}
+
+// ----------------------------------------------------------------------------
+bool address_space::add(const std::string& name, const symbolizer& module, uint64_t bias,
+	uint64_t start, uint64_t end)
+{
+	if (start >= end)
+		return false;
+
+	// The first mapping starting after this one, and the one before it,
+	// are the only ones which could overlap
+	std::vector<module_mapping>::iterator it = std::upper_bound(m_mappings.begin(), m_mappings.end(), start,
+		[](uint64_t addr, const module_mapping& m) { return addr < m.start; });
+	if (it != m_mappings.end() && it->start < end)
+		return false;
+	if (it != m_mappings.begin() && (it - 1)->end > start)
+		return false;
+
+	module_mapping mapping;
+	mapping.name = name;
+	mapping.module = &module;
+	mapping.start = start;
+	mapping.end = end;
+	mapping.bias = bias;
+	m_mappings.insert(it, mapping);
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+void address_space::remove(const symbolizer& module)
+{
+	m_mappings.erase(std::remove_if(m_mappings.begin(), m_mappings.end(),
+		[&module](const module_mapping& m) { return m.module == &module; }), m_mappings.end());
+}
+
+// ----------------------------------------------------------------------------
+const module_mapping* address_space::find(uint64_t address) const
+{
+	std::vector<module_mapping>::const_iterator it = std::upper_bound(m_mappings.begin(), m_mappings.end(), address,
+		[](uint64_t addr, const module_mapping& m) { return addr < m.start; });
+	if (it == m_mappings.begin() || address >= (it - 1)->end)
+		return nullptr;
+	return &*(it - 1);
+}
+
+// ----------------------------------------------------------------------------
+const module_mapping* address_space::find_line(uint64_t address, line_location& loc) const
+{
+	const module_mapping* mapping = find(address);
+	if (!mapping || !mapping->module->find_line(mapping->to_module(address), loc))
+		return nullptr;
+	return mapping;
+}
+
+// ----------------------------------------------------------------------------
+const lookup_symbol* address_space::find_symbol(uint64_t address, const module_mapping*& mapping) const
+{
+	mapping = find(address);
+	if (!mapping)
+		return nullptr;
+	return mapping->module->find_symbol(mapping->to_module(address));
+}
+
+}
@@ -0,0 +1,67 @@
+#ifndef FONDA_LIB_ADDRESS_SPACE_H
+#define FONDA_LIB_ADDRESS_SPACE_H
+
+// Several modules loaded at different addresses in one target.
+#include "symbolizer.h"
+
+namespace fonda
+{
+// ----------------------------------------------------------------------------
+// A module placed in the address space. Runtime addresses in [start, end)
+// belong to it, and are "bias" above the addresses in the module's own info.
+struct module_mapping
+{
+	std::string			name;
+	const symbolizer*	module;
+	uint64_t			start;
+	uint64_t			end;
+	uint64_t			bias;
+
+	// Convert between runtime and module addresses
+	uint64_t to_module(uint64_t address) const		{ return address - bias; }
+	uint64_t to_runtime(uint64_t address) const		{ return address + bias; }
+};
+
+// ----------------------------------------------------------------------------
+// address_space -- routes runtime addresses to the module loaded there, in
+// O(log modules) time, then to that module's indexes. The modules are not
+// copied, so must outlive the address space.
+//
+// Results from the query functions are in module addresses: use the mapping
+// returned with them to convert back.
+class address_space
+{
+public:
+	// Add a module loaded "bias" above its link addresses. Its extent is the
+	// PT_LOAD segments for ELF files (or the allocated sections, for
+	// relocatable files), or TEXT+DATA+BSS for TOS files, whose addresses
+	// start at 0. Returns false if the module is empty or overlaps another.
+	bool add(const std::string& name, const symbolizer& module, uint64_t bias);
+
+	// As above, with an explicit runtime extent [start, end)
+	bool add(const std::string& name, const symbolizer& module, uint64_t bias,
+		uint64_t start, uint64_t end);
+
+	// Remove every mapping of the module
+	void remove(const symbolizer& module);
+
+	// Returns nullptr if no module covers the address
+	const module_mapping* find(uint64_t address) const;
+
+	// Find the code point covering the runtime address. Returns nullptr if
+	// no module or no line covers it, otherwise the module's mapping.
+	const module_mapping* find_line(uint64_t address, line_location& loc) const;
+
+	// Find the symbol covering the runtime address. Returns nullptr if not
+	// found; "mapping" is set to the module's mapping, or nullptr.
+	const lookup_symbol* find_symbol(uint64_t address, const module_mapping*& mapping) const;
+
+	// Mappings sorted by start address
+	const std::vector<module_mapping>& mappings() const		{ return m_mappings; }
+
+private:
+	std::vector<module_mapping>		m_mappings;		// sorted by start, non-overlapping
+};
+
+}
+#endif // FONDA_LIB_ADDRESS_SPACE_H
@@ -0,0 +1,136 @@
+#include "async_loader.h"
+#include <algorithm>
+
+namespace fonda
+{
+// ----------------------------------------------------------------------------
+async_loader::async_loader() :
+	m_lazy_max_bytes(0),
+	m_cancel(false),
+	m_stage(load_stage::IDLE),
+	m_done(0),
+	m_total(0),
+	m_result(0)
+{
+	m_debug_dirs.push_back("/usr/lib/debug");
+}
+
+// ----------------------------------------------------------------------------
+async_loader::~async_loader()
+{
+	cancel();
+}
+
+// ----------------------------------------------------------------------------
+void async_loader::start(const std::string& fname, bool force_tos, const std::vector<uint64_t>& priority_addresses)
+{
+	cancel();
+	m_shared.clear();
+	m_cancel = false;
+	m_stage = load_stage::SYMBOLS;
+	m_done = 0;
+	m_total = 0;
+	m_result = 0;
+	m_thread = std::thread(&async_loader::run, this, fname, force_tos, priority_addresses);
+}
+
+// ----------------------------------------------------------------------------
+void async_loader::cancel()
+{
+	m_cancel = true;
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+// ----------------------------------------------------------------------------
+int async_loader::wait()
+{
+	if (m_thread.joinable())
+		m_thread.join();
+	return m_result;
+}
+
+// ----------------------------------------------------------------------------
+load_progress async_loader::get_progress() const
+{
+	load_progress progress;
+	progress.stage = m_stage;
+	progress.done = m_done;
+	progress.total = m_total;
+	progress.result = m_result;
+	return progress;
+}
+
+// ----------------------------------------------------------------------------
+//	WORKER THREAD
+// ----------------------------------------------------------------------------
+void async_loader::run(std::string fname, bool force_tos, std::vector<uint64_t> priority_addresses)
+{
+	elf_parse_options options;
+	options.progress = [this](uint64_t done, uint64_t total)
+	{
+		m_done = done;
+		m_total = total;
+		return !m_cancel.load();
+	};
+
+	options.parts = elf_parts::SYMBOLS;
+	int ret = run_stage(fname, force_tos, load_stage::SYMBOLS, options);
+
+	// TOS files were read whole by the first stage
+	shared_symbolizer::snapshot first = get();
+	if (ret == 0 && !first->is_tos())
+	{
+		// The units covering the priority addresses, by .debug_aranges
+		for (uint64_t address : priority_addresses)
+		{
+			const elf_address_range* range = first->elf().unit_ranges.find(address);
+			if (range && std::find(options.units.begin(), options.units.end(), range->value) == options.units.end())
+				options.units.push_back(range->value);
+		}
+
+		// The later stages copy the symbols rather than decode them again
+		options.symbols_from = &first->elf();
+		if (options.units.size())
+		{
+			options.parts = elf_parts::SYMBOLS | elf_parts::DEBUG_INFO | elf_parts::LINES;
+			ret = run_stage(fname, force_tos, load_stage::PRIORITY_UNITS, options);
+		}
+
+		if (ret == 0)
+		{
+			options.parts = elf_parts::ALL;
+			options.units.clear();
+			ret = run_stage(fname, force_tos, load_stage::ALL, options);
+		}
+	}
+	m_result = ret;
+	m_stage = load_stage::DONE;
+}
+
+// ----------------------------------------------------------------------------
+int async_loader::run_stage(const std::string& fname, bool force_tos, uint32_t stage,
+	const elf_parse_options& options)
+{
+	if (m_cancel)
+		return elf_error::ERROR_CANCELLED;
+	m_stage = stage;
+	m_done = 0;
+	m_total = 0;
+
+	std::shared_ptr<symbolizer> next(new symbolizer);
+	next->set_debug_dirs(m_debug_dirs);
+	next->set_lazy_lines(m_lazy_max_bytes);
+	int ret = next->load(fname.c_str(), force_tos, options);
+	if (ret == 0 && m_cancel)
+		ret = elf_error::ERROR_CANCELLED;
+	if (ret == 0)
+	{
+		m_shared.publish(next);
+		if (m_stage_callback && !m_stage_callback(stage))
+			ret = elf_error::ERROR_CANCELLED;
+	}
+	return ret;
+}
+
+}
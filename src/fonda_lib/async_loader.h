@@ -0,0 +1,104 @@
+#ifndef FONDA_LIB_ASYNC_LOADER_H
+#define FONDA_LIB_ASYNC_LOADER_H
+
+// Loading a program in the background, making it queryable a part at a time.
+#include <functional>
+#include <thread>
+#include "symbolizer.h"
+
+namespace fonda
+{
+// ----------------------------------------------------------------------------
+// Stages of an async_loader load, in the order they are published
+namespace load_stage
+{
+	enum
+	{
+		IDLE = 0,					// nothing started
+		SYMBOLS = 1,				// symbol tables only
+		PRIORITY_UNITS = 2,			// plus the units covering the priority addresses
+		ALL = 3,					// everything, including frames and relocations
+		DONE = 4					// finished, cancelled or failed: see the result
+	};
+}
+
+// ----------------------------------------------------------------------------
+struct load_progress
+{
+	uint32_t		stage;			// load_stage being worked on
+	uint64_t		done;			// section bytes decoded so far in the stage
+	uint64_t		total;			// section bytes the stage will decode
+	int				result;			// parser error code once DONE, e.g. ERROR_CANCELLED
+};
+
+// ----------------------------------------------------------------------------
+// async_loader -- loads a program on a worker thread. start() returns at once,
+// and each stage is published through get() as a frozen snapshot as soon as
+// it is ready: first the symbols, then the line and function information of
+// the units covering the caller's priority addresses (e.g. the current PC),
+// then the whole file. Queries on a snapshot never wait for the later stages.
+//
+// Each later stage of an ELF file copies the symbols of the first and decodes
+// the rest; the priority units are decoded again in the last stage. TOS files
+// are small enough to be read whole as the first stage. Units are found from
+// .debug_aranges, so without it there is no priority stage.
+//
+// start(), cancel() and wait() should be called from one thread; get() and
+// get_progress() from any, including the stage callback.
+class async_loader
+{
+public:
+	async_loader();
+	~async_loader();				// cancels any load in progress
+
+	// Directories searched for separate debug files. Set before start().
+	void set_debug_dirs(const std::vector<std::string>& dirs)	{ m_debug_dirs = dirs; }
+
+	// See symbolizer::set_lazy_lines(). Set before start().
+	void set_lazy_lines(uint64_t max_bytes)		{ m_lazy_max_bytes = max_bytes; }
+
+	// Called on the worker thread each time a stage has been published, with
+	// its load_stage, e.g. to refresh a view rather than poll get(). Return
+	// false to stop the load there, which then ends with ERROR_CANCELLED.
+	// Set before start().
+	void set_stage_callback(const std::function<bool(uint32_t stage)>& callback)
+		{ m_stage_callback = callback; }
+
+	// Start loading a file in the background, cancelling any earlier load
+	// and dropping its snapshots.
+	void start(const std::string& fname, bool force_tos, const std::vector<uint64_t>& priority_addresses);
+
+	// Stop the load in progress, and wait for the worker to finish. The last
+	// snapshot published stays available.
+	void cancel();
+
+	// Wait for the load to finish. Returns the error code of the stage that
+	// failed, ERROR_CANCELLED if cancelled, or 0.
+	int wait();
+
+	// Returns nullptr before the first stage is ready
+	shared_symbolizer::snapshot get() const		{ return m_shared.get(); }
+
+	load_progress get_progress() const;
+
+private:
+	async_loader(const async_loader&);
+	async_loader& operator=(const async_loader&);
+
+	void run(std::string fname, bool force_tos, std::vector<uint64_t> priority_addresses);
+	int run_stage(const std::string& fname, bool force_tos, uint32_t stage, const elf_parse_options& options);
+
+	shared_symbolizer			m_shared;
+	std::vector<std::string>	m_debug_dirs;
+	uint64_t					m_lazy_max_bytes;
+	std::function<bool(uint32_t stage)> m_stage_callback;
+	std::thread					m_thread;
+	std::atomic<bool>			m_cancel;
+	std::atomic<uint32_t>		m_stage;
+	std::atomic<uint64_t>		m_done;
+	std::atomic<uint64_t>		m_total;
+	std::atomic<int>			m_result;
+};
+
+}
+#endif // FONDA_LIB_ASYNC_LOADER_H
@@ -59,9 +59,57 @@
 #define DW_TAG_imported_unit 0x3d
 #define DW_TAG_condition 0x3f
 #define DW_TAG_shared_type 0x40
+#define DW_TAG_type_unit 0x41
+#define DW_TAG_rvalue_reference_type 0x42
+#define DW_TAG_template_alias 0x43
+#define DW_TAG_coarray_type 0x44
+#define DW_TAG_generic_subrange 0x45
+#define DW_TAG_dynamic_type 0x46
+#define DW_TAG_atomic_type 0x47
+#define DW_TAG_call_site 0x48
+#define DW_TAG_call_site_parameter 0x49
+#define DW_TAG_skeleton_unit 0x4a
+#define DW_TAG_immutable_type 0x4b
 #define DW_TAG_lo_user 0x4080
 #define DW_TAG_hi_user 0xffff
 
+#define DW_CHILDREN_no	0
+#define DW_CHILDREN_yes	1
+
+/* unit header types (DWARF 5) */
+#define DW_UT_compile		1
+#define DW_UT_type			2
+#define DW_UT_partial		3
+#define DW_UT_skeleton		4
+#define DW_UT_split_compile	5
+#define DW_UT_split_type	6
+
+/* attribute names */
+#define DW_AT_sibling			0x01
+#define DW_AT_location			0x02
+#define DW_AT_name				0x03
+#define DW_AT_stmt_list			0x10
+#define DW_AT_low_pc			0x11
+#define DW_AT_high_pc			0x12
+#define DW_AT_language			0x13
+#define DW_AT_comp_dir			0x1b
+#define DW_AT_inline			0x20
+#define DW_AT_producer			0x25
+#define DW_AT_abstract_origin	0x31
+#define DW_AT_declaration		0x3c
+#define DW_AT_specification		0x47
+#define DW_AT_entry_pc			0x52
+#define DW_AT_ranges			0x55
+#define DW_AT_call_column		0x57
+#define DW_AT_call_file			0x58
+#define DW_AT_call_line			0x59
+#define DW_AT_linkage_name		0x6e
+#define DW_AT_str_offsets_base	0x72
+#define DW_AT_addr_base			0x73
+#define DW_AT_rnglists_base		0x74
+#define DW_AT_loclists_base		0x8c
+#define DW_AT_MIPS_linkage_name	0x2007
+
 /* statement machine opcodes */
 #define DW_LNS_copy             1
 #define DW_LNS_advance_pc       2
@@ -82,6 +130,63 @@
 #define DW_LNCT_size			4
 #define DW_LNCT_MD5				5
 
+#define DW_RLE_end_of_list		0
+#define DW_RLE_base_addressx	1
+#define DW_RLE_startx_endx		2
+#define DW_RLE_startx_length	3
+#define DW_RLE_offset_pair		4
+#define DW_RLE_base_address		5
+#define DW_RLE_start_end		6
+#define DW_RLE_start_length		7
+
+/* call frame instructions. The first three use the top two bits of the opcode */
+#define DW_CFA_advance_loc		0x40
+#define DW_CFA_offset			0x80
+#define DW_CFA_restore			0xc0
+#define DW_CFA_nop				0x00
+#define DW_CFA_set_loc			0x01
+#define DW_CFA_advance_loc1		0x02
+#define DW_CFA_advance_loc2		0x03
+#define DW_CFA_advance_loc4		0x04
+#define DW_CFA_offset_extended	0x05
+#define DW_CFA_restore_extended	0x06
+#define DW_CFA_undefined		0x07
+#define DW_CFA_same_value		0x08
+#define DW_CFA_register			0x09
+#define DW_CFA_remember_state	0x0a
+#define DW_CFA_restore_state	0x0b
+#define DW_CFA_def_cfa			0x0c
+#define DW_CFA_def_cfa_register	0x0d
+#define DW_CFA_def_cfa_offset	0x0e
+#define DW_CFA_def_cfa_expression 0x0f
+#define DW_CFA_expression		0x10
+#define DW_CFA_offset_extended_sf 0x11
+#define DW_CFA_def_cfa_sf		0x12
+#define DW_CFA_def_cfa_offset_sf 0x13
+#define DW_CFA_val_offset		0x14
+#define DW_CFA_val_offset_sf	0x15
+#define DW_CFA_val_expression	0x16
+#define DW_CFA_GNU_args_size	0x2e
+#define DW_CFA_GNU_negative_offset_extended 0x2f
+
+/* pointer encodings in .eh_frame: a format in the low bits, then how it is applied */
+#define DW_EH_PE_absptr			0x00
+#define DW_EH_PE_uleb128		0x01
+#define DW_EH_PE_udata2			0x02
+#define DW_EH_PE_udata4			0x03
+#define DW_EH_PE_udata8			0x04
+#define DW_EH_PE_sleb128		0x09
+#define DW_EH_PE_sdata2			0x0a
+#define DW_EH_PE_sdata4			0x0b
+#define DW_EH_PE_sdata8			0x0c
+#define DW_EH_PE_pcrel			0x10
+#define DW_EH_PE_textrel		0x20
+#define DW_EH_PE_datarel		0x30
+#define DW_EH_PE_funcrel		0x40
+#define DW_EH_PE_aligned		0x50
+#define DW_EH_PE_indirect		0x80
+#define DW_EH_PE_omit			0xff
+
 #define DW_FORM_addr	1	
 #define DW_FORM_block2	3	
 #define DW_FORM_block4	4	
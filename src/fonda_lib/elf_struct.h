@@ -18,6 +18,13 @@
 #define ELFDATA2LSB 1
 #define ELFDATA2MSB 2
 
+/* e_type */
+#define ET_NONE     0               /* No file type */
+#define ET_REL      1               /* Relocatable file */
+#define ET_EXEC     2               /* Executable file */
+#define ET_DYN      3               /* Shared object file */
+#define ET_CORE     4               /* Core file */
+
 /* sh_type */
 #define SHT_NULL        0           /* Section header table entry unused */
 #define SHT_PROGBITS    1           /* Program specific (private) data */
@@ -31,6 +38,7 @@
 #define SHT_REL         9           /* Relocation entries, no addends */
 #define SHT_SHLIB       10          /* Reserved, unspecified semantics */
 #define SHT_DYNSYM      11          /* Dynamic linking symbol table */
+#define SHT_GNU_HASH    0x6FFFFFF6  /* GNU-style symbol hash table */
 #define SHT_LOPROC      0x70000000  /* Processor-specific semantics, lo */
 #define SHT_HIPROC      0x7FFFFFFF  /* Processor-specific semantics, hi */
 #define SHT_LOUSER      0x80000000  /* Application-specific semantics */
@@ -42,6 +50,33 @@
 #define SHF_EXECINSTR (1 << 2)      /* Executable machine instructions */
 #define SHF_MASKPROC  0xF0000000    /* Processor-specific semantics */
 
+/* p_type */
+#define PT_NULL     0               /* Program header table entry unused */
+#define PT_LOAD     1               /* Loadable program segment */
+#define PT_DYNAMIC  2               /* Dynamic linking information */
+#define PT_INTERP   3               /* Program interpreter */
+#define PT_NOTE     4               /* Auxiliary information */
+#define PT_SHLIB    5               /* Reserved, unspecified semantics */
+#define PT_PHDR     6               /* Entry for header table itself */
+#define PT_TLS      7               /* Thread-local storage segment */
+
+/* p_flags */
+#define PF_X (1 << 0)               /* Segment is executable */
+#define PF_W (1 << 1)               /* Segment is writable */
+#define PF_R (1 << 2)               /* Segment is readable */
+
+/* e_phnum value meaning the real count is in sh_info of section 0 */
+#define PN_XNUM 0xffff
+
+/* r_info */
+#define ELF32_R_SYM(i)  ((i) >> 8)
+#define ELF32_R_TYPE(i) ((i) & 0xff)
+#define ELF64_R_SYM(i)  ((i) >> 32)
+#define ELF64_R_TYPE(i) ((i) & 0xffffffff)
+
+/* n_type of notes named "GNU" */
+#define NT_GNU_BUILD_ID 3           /* Unique build ID bitstring */
+
 /* ST_BIND */
 #define STB_LOCAL  0                /* Symbol not visible outside obj */
 #define STB_GLOBAL 1                /* Symbol visible outside obj */
@@ -105,6 +140,28 @@ struct Elf64_Ehdr {
   uint8_t	e_shstrndx[2];      /* Section header string table index */
 };
 
+struct Elf32_Phdr {
+  uint8_t	p_type[4];          /* Segment type */
+  uint8_t	p_offset[4];        /* Segment file offset */
+  uint8_t	p_vaddr[4];         /* Segment virtual address */
+  uint8_t	p_paddr[4];         /* Segment physical address */
+  uint8_t	p_filesz[4];        /* Segment size in file */
+  uint8_t	p_memsz[4];         /* Segment size in memory */
+  uint8_t	p_flags[4];         /* Segment flags */
+  uint8_t	p_align[4];         /* Segment alignment */
+};
+
+struct Elf64_Phdr {
+  uint8_t	p_type[4];          /* Segment type */
+  uint8_t	p_flags[4];         /* Segment flags */
+  uint8_t	p_offset[8];        /* Segment file offset */
+  uint8_t	p_vaddr[8];         /* Segment virtual address */
+  uint8_t	p_paddr[8];         /* Segment physical address */
+  uint8_t	p_filesz[8];        /* Segment size in file */
+  uint8_t	p_memsz[8];         /* Segment size in memory */
+  uint8_t	p_align[8];         /* Segment alignment */
+};
+
 // Wrappers for LSB/MSB conversion
 struct Elf16 {
 	uint8_t	data[2];
@@ -135,6 +192,28 @@ struct Elf64_Sym {
   uint8_t	st_size[8];         /* Associated symbol size */
 };
 
+struct Elf32_Rel {
+  uint8_t	r_offset[4];        /* Location to apply the relocation */
+  uint8_t	r_info[4];          /* Symbol index and relocation type */
+};
+
+struct Elf32_Rela {
+  uint8_t	r_offset[4];        /* Location to apply the relocation */
+  uint8_t	r_info[4];          /* Symbol index and relocation type */
+  uint8_t	r_addend[4];        /* Constant addend */
+};
+
+struct Elf64_Rel {
+  uint8_t	r_offset[8];        /* Location to apply the relocation */
+  uint8_t	r_info[8];          /* Symbol index and relocation type */
+};
+
+struct Elf64_Rela {
+  uint8_t	r_offset[8];        /* Location to apply the relocation */
+  uint8_t	r_info[8];          /* Symbol index and relocation type */
+  uint8_t	r_addend[8];        /* Constant addend */
+};
+
 
 #endif // FONDA_LIB_ELF_STRUCT_H
 
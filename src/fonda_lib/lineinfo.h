@@ -3,6 +3,7 @@
 
 // Shared structures to describe line information in an executable.
 #include <stdint.h>
+#include <algorithm>
 #include <vector>
 #include <string>
 
@@ -34,6 +35,11 @@ struct compilation_unit
 	std::vector<std::string> dirs;
 	std::vector<file> files;
 	std::vector<code_point> points;
+	std::vector<uint32_t> sequence_ends;	// ascending indices in points of rows ending a sequence
+
+	// True if the point ends a sequence, so its address is just past the code
+	bool is_sequence_end(uint32_t point_index) const
+		{ return std::binary_search(sequence_ends.begin(), sequence_ends.end(), point_index); }
 };
 
 }
@@ -0,0 +1,611 @@
+#include "lookup_index.h"
+#include "elf_struct.h"
+#include <algorithm>
+#include <string.h>
+
+namespace fonda
+{
+// ----------------------------------------------------------------------------
+//	LINE INDEX
+// ----------------------------------------------------------------------------
+// Return the part of a path after the last directory separator
+static const char* base_name(const char* path)
+{
+	const char* base = path;
+	for (const char* p = path; *p; ++p)
+		if (*p == '/' || *p == '\\')
+			base = p + 1;
+	return base;
+}
+
+// ----------------------------------------------------------------------------
+// Check a full path ends with "path", on a directory boundary
+static bool path_matches(const std::string& full, const char* path, size_t path_len)
+{
+	if (full.size() < path_len)
+		return false;
+	size_t start = full.size() - path_len;
+	if (full.compare(start, path_len, path) != 0)
+		return false;
+	return start == 0 || full[start - 1] == '/' || full[start - 1] == '\\';
+}
+
+// ----------------------------------------------------------------------------
+static std::string full_path(const compilation_unit& unit, const compilation_unit::file& file)
+{
+	std::string path;
+	if (file.dir_index < unit.dirs.size())
+		path = unit.dirs[file.dir_index] + "/";
+	path += file.path;
+	return path;
+}
+
+// ----------------------------------------------------------------------------
+void line_index::build(const std::vector<compilation_unit>& units, uint64_t code_end)
+{
+	m_pUnits = &units;
+	m_code_end = code_end;
+	m_entries.clear();
+	m_file_lines.clear();
+	m_paths.clear();
+	m_names.clear();
+
+	size_t total = 0;
+	for (const compilation_unit& unit : units)
+		total += unit.points.size();
+	m_entries.reserve(total);
+	m_file_lines.reserve(total);
+
+	for (uint32_t unit_index = 0; unit_index < units.size(); ++unit_index)
+	{
+		const compilation_unit& unit = units[unit_index];
+
+		// Record the full path and base name of each file in the unit
+		std::vector<uint32_t> name_ids;
+		uint32_t first_path = m_paths.size();
+		for (const compilation_unit::file& file : unit.files)
+		{
+			m_paths.push_back(full_path(unit, file));
+
+			std::string name = base_name(file.path.c_str());
+			std::unordered_map<std::string, uint32_t>::iterator it = m_names.find(name);
+			if (it == m_names.end())
+				it = m_names.insert(std::make_pair(name, (uint32_t)m_names.size())).first;
+			name_ids.push_back(it->second);
+		}
+
+		std::vector<uint32_t>::const_iterator next_end = unit.sequence_ends.begin();
+		for (uint32_t point_index = 0; point_index < unit.points.size(); ++point_index)
+		{
+			const code_point& cp = unit.points[point_index];
+			entry e;
+			e.address = cp.address;
+			e.unit_index = unit_index;
+			e.point_index = point_index;
+			e.end_sequence = next_end != unit.sequence_ends.end() && *next_end == point_index;
+			if (e.end_sequence)
+				++next_end;
+			m_entries.push_back(e);
+			if (e.end_sequence)
+				continue;
+
+			if (cp.file_index >= name_ids.size())
+				continue;
+			file_line fl;
+			fl.name_index = name_ids[cp.file_index];
+			fl.line = cp.line;
+			fl.address = cp.address;
+			fl.path_index = first_path + cp.file_index;
+			m_file_lines.push_back(fl);
+		}
+	}
+
+	// Stable sort keeps the parsed order for points at the same address. A
+	// sequence can start where another ends, so put the ends first.
+	std::stable_sort(m_entries.begin(), m_entries.end(),
+		[](const entry& a, const entry& b) {
+			if (a.address != b.address)
+				return a.address < b.address;
+			return a.end_sequence && !b.end_sequence;
+		});
+	std::sort(m_file_lines.begin(), m_file_lines.end(),
+		[](const file_line& a, const file_line& b) {
+			if (a.name_index != b.name_index)
+				return a.name_index < b.name_index;
+			if (a.line != b.line)
+				return a.line < b.line;
+			return a.address < b.address;
+		});
+}
+
+// ----------------------------------------------------------------------------
+line_location line_index::get_location(const entry& e) const
+{
+	line_location loc;
+	loc.unit = &(*m_pUnits)[e.unit_index];
+	loc.point = &loc.unit->points[e.point_index];
+	loc.file = loc.point->file_index < loc.unit->files.size() ?
+		&loc.unit->files[loc.point->file_index] : nullptr;
+	return loc;
+}
+
+// ----------------------------------------------------------------------------
+bool line_index::find(uint64_t address, line_location& loc) const
+{
+	// Find the first entry above the address, then step back
+	std::vector<entry>::const_iterator it = std::upper_bound(m_entries.begin(), m_entries.end(), address,
+		[](uint64_t addr, const entry& e) { return addr < e.address; });
+	if (it == m_entries.begin() || !covers(*(it - 1), address))
+		return false;
+	loc = get_location(*(it - 1));
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+void line_index::find_addresses(const char* path, uint32_t line, std::vector<uint64_t>& addresses) const
+{
+	std::unordered_map<std::string, uint32_t>::const_iterator name_it = m_names.find(base_name(path));
+	if (name_it == m_names.end())
+		return;
+
+	file_line key;
+	key.name_index = name_it->second;
+	key.line = line;
+	std::vector<file_line>::const_iterator it = std::lower_bound(m_file_lines.begin(), m_file_lines.end(), key,
+		[](const file_line& a, const file_line& b) {
+			if (a.name_index != b.name_index)
+				return a.name_index < b.name_index;
+			return a.line < b.line;
+		});
+
+	size_t path_len = strlen(path);
+	for (; it != m_file_lines.end() && it->name_index == key.name_index && it->line == line; ++it)
+	{
+		if (!path_matches(m_paths[it->path_index], path, path_len))
+			continue;
+		if (addresses.empty() || addresses.back() != it->address)
+			addresses.push_back(it->address);
+	}
+}
+
+// ----------------------------------------------------------------------------
+//	LAZY LINE INDEX
+// ----------------------------------------------------------------------------
+const uint64_t lazy_line_index::DEFAULT_MAX_BYTES;
+
+// ----------------------------------------------------------------------------
+void lazy_line_index::build(const elf_results& results, const std::string& fname)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_pResults = &results;
+	m_fname = fname;
+	m_programs.clear();
+	for (size_t i = 0; i < results.line_programs.size(); ++i)
+	{
+		if (results.line_programs[i].unit_offset != ~0ULL)
+			m_programs[results.line_programs[i].unit_offset] = i;
+	}
+	m_cache.clear();
+	m_lru.clear();
+	m_bytes = 0;
+}
+
+// ----------------------------------------------------------------------------
+lazy_line_index::decoded_ptr lazy_line_index::get_unit(size_t program) const
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::unordered_map<size_t, cache_entry>::iterator it = m_cache.find(program);
+		if (it != m_cache.end())
+		{
+			m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+			return it->second.decoded;
+		}
+	}
+
+	// Decode without the lock, so other queries aren't held up by the file
+	// reads. Two threads can occasionally decode the same unit; the first
+	// to finish is cached.
+	FILE* file = fopen(m_fname.c_str(), "rb");
+	if (!file)
+		return decoded_ptr();
+	std::shared_ptr<decoded_unit> decoded(new decoded_unit);
+	int ret = decode_elf_line_program(file, m_pResults->line_programs[program], decoded->unit);
+	fclose(file);
+	if (ret != elf_error::OK)
+		return decoded_ptr();
+
+	// As in line_index::build(), sequence ends go first at each address
+	const compilation_unit& unit = decoded->unit;
+	const std::vector<code_point>& points = unit.points;
+	decoded->by_address.resize(points.size());
+	for (uint32_t i = 0; i < points.size(); ++i)
+		decoded->by_address[i] = i;
+	std::stable_sort(decoded->by_address.begin(), decoded->by_address.end(),
+		[&unit](uint32_t a, uint32_t b) {
+			if (unit.points[a].address != unit.points[b].address)
+				return unit.points[a].address < unit.points[b].address;
+			return unit.is_sequence_end(a) && !unit.is_sequence_end(b);
+		});
+
+	decoded->bytes = sizeof(decoded_unit) + points.capacity() * sizeof(code_point) +
+		decoded->by_address.capacity() * sizeof(uint32_t);
+	for (const compilation_unit::file& f : decoded->unit.files)
+		decoded->bytes += sizeof(f) + f.path.capacity();
+	for (const std::string& dir : decoded->unit.dirs)
+		decoded->bytes += sizeof(dir) + dir.capacity();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::unordered_map<size_t, cache_entry>::iterator it = m_cache.find(program);
+	if (it != m_cache.end())
+	{
+		m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+		return it->second.decoded;
+	}
+	m_lru.push_front(program);
+	cache_entry& entry = m_cache[program];
+	entry.decoded = decoded;
+	entry.lru = m_lru.begin();
+	m_bytes += decoded->bytes;
+
+	// Units still in use elsewhere stay alive until released
+	while (m_bytes > m_max_bytes && m_lru.size() > 1)
+	{
+		std::unordered_map<size_t, cache_entry>::iterator victim = m_cache.find(m_lru.back());
+		m_bytes -= victim->second.decoded->bytes;
+		m_cache.erase(victim);
+		m_lru.pop_back();
+	}
+	return decoded;
+}
+
+// ----------------------------------------------------------------------------
+bool lazy_line_index::find(uint64_t address, line_location& loc) const
+{
+	if (!m_pResults)
+		return false;
+	const elf_address_range* range = m_pResults->unit_ranges.find(address);
+	if (!range)
+		return false;
+	std::unordered_map<uint64_t, size_t>::const_iterator program = m_programs.find(range->value);
+	if (program == m_programs.end())
+		return false;
+	decoded_ptr decoded = get_unit(program->second);
+	if (!decoded)
+		return false;
+
+	// Find the first point above the address, then step back
+	const std::vector<code_point>& points = decoded->unit.points;
+	std::vector<uint32_t>::const_iterator it = std::upper_bound(decoded->by_address.begin(),
+		decoded->by_address.end(), address,
+		[&points](uint64_t addr, uint32_t index) { return addr < points[index].address; });
+	if (it == decoded->by_address.begin() || decoded->unit.is_sequence_end(*(it - 1)))
+		return false;
+
+	loc.unit = &decoded->unit;
+	loc.point = &points[*(it - 1)];
+	loc.file = loc.point->file_index < loc.unit->files.size() ?
+		&loc.unit->files[loc.point->file_index] : nullptr;
+	loc.holder = std::shared_ptr<const compilation_unit>(decoded, &decoded->unit);
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+void lazy_line_index::find_addresses(const char* path, uint32_t line, std::vector<uint64_t>& addresses) const
+{
+	if (!m_pResults)
+		return;
+	size_t first = addresses.size();
+	size_t path_len = strlen(path);
+	const char* name = base_name(path);
+	for (size_t program = 0; program < m_pResults->line_programs.size(); ++program)
+	{
+		decoded_ptr decoded = get_unit(program);
+		if (!decoded)
+			continue;
+		const compilation_unit& unit = decoded->unit;
+
+		// Check the file table before the points
+		std::vector<bool> matches(unit.files.size());
+		bool any = false;
+		for (size_t i = 0; i < unit.files.size(); ++i)
+		{
+			const compilation_unit::file& file = unit.files[i];
+			matches[i] = strcmp(base_name(file.path.c_str()), name) == 0 &&
+				path_matches(full_path(unit, file), path, path_len);
+			any = any || matches[i];
+		}
+		if (!any)
+			continue;
+		for (uint32_t i = 0; i < unit.points.size(); ++i)
+		{
+			const code_point& cp = unit.points[i];
+			if (cp.line == line && cp.file_index < matches.size() && matches[cp.file_index] &&
+				!unit.is_sequence_end(i))
+				addresses.push_back(cp.address);
+		}
+	}
+	std::sort(addresses.begin() + first, addresses.end());
+	addresses.erase(std::unique(addresses.begin() + first, addresses.end()), addresses.end());
+}
+
+// ----------------------------------------------------------------------------
+std::shared_ptr<const compilation_unit> lazy_line_index::find_unit(uint64_t unit_offset) const
+{
+	std::unordered_map<uint64_t, size_t>::const_iterator program = m_programs.find(unit_offset);
+	if (program == m_programs.end())
+		return std::shared_ptr<const compilation_unit>();
+	decoded_ptr decoded = get_unit(program->second);
+	if (!decoded)
+		return std::shared_ptr<const compilation_unit>();
+	return std::shared_ptr<const compilation_unit>(decoded, &decoded->unit);
+}
+
+// ----------------------------------------------------------------------------
+uint64_t lazy_line_index::cached_bytes() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_bytes;
+}
+
+// ----------------------------------------------------------------------------
+//	SYMBOL INDEX
+// ----------------------------------------------------------------------------
+void symbol_index::add(const std::string& name, uint64_t address, uint64_t size)
+{
+	lookup_symbol sym;
+	sym.name = name;
+	sym.address = address;
+	sym.size = size;
+	sym.limit = size ? address + size : ~0ULL;
+	m_symbols.push_back(sym);
+}
+
+// ----------------------------------------------------------------------------
+void symbol_index::add_extent(uint64_t start, uint64_t end)
+{
+	if (start < end)
+		m_extents.push_back(std::make_pair(start, end));
+}
+
+// ----------------------------------------------------------------------------
+void symbol_index::build()
+{
+	// At the same address, prefer symbols with a size
+	std::stable_sort(m_symbols.begin(), m_symbols.end(),
+		[](const lookup_symbol& a, const lookup_symbol& b) {
+			if (a.address != b.address)
+				return a.address < b.address;
+			return a.size > b.size;
+		});
+
+	// Merge overlapping extents, then bound each unsized symbol by the one
+	// containing it. Both lists are sorted, so this is a single pass.
+	if (m_extents.size())
+	{
+		std::sort(m_extents.begin(), m_extents.end());
+		std::vector<std::pair<uint64_t, uint64_t> > merged;
+		for (const std::pair<uint64_t, uint64_t>& extent : m_extents)
+		{
+			if (merged.size() && extent.first <= merged.back().second)
+				merged.back().second = std::max(merged.back().second, extent.second);
+			else
+				merged.push_back(extent);
+		}
+		m_extents.swap(merged);
+
+		size_t extent = 0;
+		for (lookup_symbol& sym : m_symbols)
+		{
+			if (sym.size)
+				continue;
+			while (extent < m_extents.size() && m_extents[extent].second <= sym.address)
+				++extent;
+			bool inside = extent < m_extents.size() && m_extents[extent].first <= sym.address;
+			sym.limit = inside ? m_extents[extent].second : sym.address + 1;
+		}
+	}
+
+	m_names.clear();
+	m_names.reserve(m_symbols.size());
+	for (uint32_t i = 0; i < m_symbols.size(); ++i)
+		m_names.insert(std::make_pair(m_symbols[i].name, i));	// keeps the lowest address
+}
+
+// ----------------------------------------------------------------------------
+const lookup_symbol* symbol_index::find(uint64_t address) const
+{
+	std::vector<lookup_symbol>::const_iterator it = std::upper_bound(m_symbols.begin(), m_symbols.end(), address,
+		[](uint64_t addr, const lookup_symbol& s) { return addr < s.address; });
+	return find_below(it - m_symbols.begin(), address);
+}
+
+// ----------------------------------------------------------------------------
+const lookup_symbol* symbol_index::find_below(size_t upper, uint64_t address) const
+{
+	if (upper == 0)
+		return nullptr;
+
+	// Check all the symbols at the nearest address below. A sized symbol must
+	// contain the address; an unsized one is assumed to reach the next symbol.
+	uint64_t nearest = m_symbols[upper - 1].address;
+	const lookup_symbol* unsized = nullptr;
+	while (upper != 0 && m_symbols[upper - 1].address == nearest)
+	{
+		const lookup_symbol& sym = m_symbols[--upper];
+		if (sym.size == 0)
+			unsized = &sym;
+		else if (address < sym.address + sym.size)
+			return &sym;
+	}
+	return unsized && address < unsized->limit ? unsized : nullptr;
+}
+
+// ----------------------------------------------------------------------------
+const lookup_symbol* symbol_index::find(const std::string& name) const
+{
+	std::unordered_map<std::string, uint32_t>::const_iterator it = m_names.find(name);
+	if (it == m_names.end())
+		return nullptr;
+	return &m_symbols[it->second];
+}
+
+// ----------------------------------------------------------------------------
+//	DYNAMIC SYMBOL INDEX
+// ----------------------------------------------------------------------------
+void dynamic_symbol_index::build(const elf_results& results)
+{
+	m_pResults = &results;
+	m_names.clear();
+	if (uses_file_hash())
+		return;
+
+	const std::vector<elf_symbol>& symbols = results.dynamic_symbols;
+	m_names.reserve(symbols.size());
+	for (uint32_t i = 0; i < symbols.size(); ++i)
+	{
+		// Like the file's tables, only defined symbols can be found
+		if (!symbols[i].name.empty() && symbols[i].st_shndx != SHN_UNDEF)
+			m_names.insert(std::make_pair(symbols[i].name, i));
+	}
+}
+
+// ----------------------------------------------------------------------------
+const elf_symbol* dynamic_symbol_index::find(const char* name) const
+{
+	if (!m_pResults)
+		return nullptr;
+	if (uses_file_hash())
+		return find_elf_dynamic_symbol(*m_pResults, name);
+
+	std::unordered_map<std::string, uint32_t>::const_iterator it = m_names.find(name);
+	if (it == m_names.end())
+		return nullptr;
+	return &m_pResults->dynamic_symbols[it->second];
+}
+
+// ----------------------------------------------------------------------------
+bool dynamic_symbol_index::uses_file_hash() const
+{
+	return m_pResults && m_pResults->dynamic_hash.type != SHT_NULL;
+}
+
+// ----------------------------------------------------------------------------
+//	FRAME INDEX
+// ----------------------------------------------------------------------------
+void frame_index::build(const elf_cfi& cfi)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_pCfi = &cfi;
+	m_tables.clear();
+	m_complete = false;
+}
+
+// ----------------------------------------------------------------------------
+// Decode the instructions of one FDE into m_tables, if not already done.
+// Call with m_mutex held.
+static const elf_cfi_table* decode_table(const elf_cfi& cfi, size_t fde_index,
+	std::unordered_map<size_t, std::unique_ptr<elf_cfi_table> >& tables)
+{
+	std::unique_ptr<elf_cfi_table>& cached = tables[fde_index];
+	if (!cached)
+	{
+		cached.reset(new elf_cfi_table);
+		if (decode_elf_cfi(cfi, cfi.fdes[fde_index], *cached) != elf_error::OK)
+			cached->rows.clear();		// remembered as unusable
+	}
+	return cached.get();
+}
+
+// ----------------------------------------------------------------------------
+void frame_index::decode_all()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_pCfi)
+		return;
+	for (size_t i = 0; i < m_pCfi->fdes.size(); ++i)
+		decode_table(*m_pCfi, i, m_tables);
+	m_complete.store(true, std::memory_order_release);
+}
+
+// ----------------------------------------------------------------------------
+bool frame_index::find(uint64_t address, frame_location& loc) const
+{
+	if (!m_pCfi)
+		return false;
+	const elf_cfi_fde* fde = find_elf_fde(*m_pCfi, address);
+	if (!fde)
+		return false;
+
+	size_t fde_index = fde - m_pCfi->fdes.data();
+	const elf_cfi_table* table;
+	if (m_complete.load(std::memory_order_acquire))
+	{
+		// Nothing is added any more, so the map can be read without locking
+		table = m_tables.find(fde_index)->second.get();
+	}
+	else
+	{
+		// Tables are never removed, so the pointer stays valid after unlocking
+		std::lock_guard<std::mutex> lock(m_mutex);
+		table = decode_table(*m_pCfi, fde_index, m_tables);
+	}
+
+	std::vector<elf_cfi_row>::const_iterator it = std::upper_bound(table->rows.begin(), table->rows.end(), address,
+		[](uint64_t addr, const elf_cfi_row& row) { return addr < row.start; });
+	if (it == table->rows.begin() || address >= (it - 1)->end)
+		return false;
+	loc.cie = &m_pCfi->cies[fde->cie_index];
+	loc.table = table;
+	loc.row = &*(it - 1);
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool frame_index::unwind(const frame_location& loc, const frame_registers& regs,
+	const std::function<bool(uint64_t address, uint64_t& value)>& read_memory,
+	frame_registers& caller, uint64_t& cfa)
+{
+	const elf_cfi_rule& cfa_rule = loc.row->cfa;
+	if (cfa_rule.type != cfi_rule::VAL_OFFSET || cfa_rule.reg >= regs.values.size() ||
+		!regs.valid[cfa_rule.reg])
+		return false;
+	uint64_t mask = loc.cie->address_size < 8 ? (1ULL << (loc.cie->address_size * 8)) - 1 : ~0ULL;
+	cfa = (regs.values[cfa_rule.reg] + cfa_rule.offset) & mask;
+
+	caller = regs;
+	for (uint32_t i = 0; i < loc.row->num_rules; ++i)
+	{
+		const elf_cfi_rule& rule = loc.table->rules[loc.row->first_rule + i];
+		if (rule.column >= caller.values.size())
+		{
+			caller.values.resize(rule.column + 1, 0);
+			caller.valid.resize(rule.column + 1, false);
+		}
+		uint64_t value = 0;
+		bool valid = false;
+		switch (rule.type)
+		{
+			case cfi_rule::SAME_VALUE:
+				continue;
+			case cfi_rule::OFFSET:
+				valid = read_memory((cfa + rule.offset) & mask, value);
+				break;
+			case cfi_rule::VAL_OFFSET:
+				value = (cfa + rule.offset) & mask;
+				valid = true;
+				break;
+			case cfi_rule::REGISTER:
+				valid = rule.reg < regs.values.size() && regs.valid[rule.reg];
+				value = valid ? regs.values[rule.reg] : 0;
+				break;
+			default:
+				break;
+		}
+		caller.values[rule.column] = value;
+		caller.valid[rule.column] = valid;
+	}
+	return true;
+}
+
+}
@@ -0,0 +1,282 @@
+#ifndef FONDA_LIB_LOOKUP_INDEX_H
+#define FONDA_LIB_LOOKUP_INDEX_H
+
+// Sorted indexes over parsed results, for fast repeated queries.
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "lineinfo.h"
+#include "readelf.h"
+
+namespace fonda
+{
+// ----------------------------------------------------------------------------
+// The result of an address -> line lookup.
+struct line_location
+{
+	const compilation_unit* unit;
+	const code_point* point;
+	const compilation_unit::file* file;
+	std::shared_ptr<const compilation_unit> holder;	// keeps a lazily decoded unit alive, or null
+};
+
+// ----------------------------------------------------------------------------
+// line_index -- address -> line and file:line -> address lookups over a set of
+// compilation units. The units are not copied, so must outlive the index.
+class line_index
+{
+public:
+	// One code point, by position in the units
+	struct entry
+	{
+		uint64_t address;
+		uint32_t unit_index;
+		uint32_t point_index;
+		bool end_sequence;		// the point is just past the code of a sequence
+	};
+
+	line_index() :
+		m_pUnits(nullptr),
+		m_code_end(~0ULL)
+	{}
+
+	// Points at or above "code_end" cover no code, for formats without
+	// sequence ends.
+	void build(const std::vector<compilation_unit>& units, uint64_t code_end = ~0ULL);
+
+	// Find the code point covering "address", i.e. the last one at or below it.
+	// Returns false if there is none, or it ends a sequence.
+	bool find(uint64_t address, line_location& loc) const;
+
+	// True if "e", the last entry at or below "address", covers it. For
+	// callers doing their own sorted walk.
+	bool covers(const entry& e, uint64_t address) const
+		{ return !e.end_sequence && address < m_code_end; }
+
+	// Find the addresses of all code points for the given line of a file. "path"
+	// can be a full path or any trailing part of it, e.g. "main.c" or "src/main.c".
+	void find_addresses(const char* path, uint32_t line, std::vector<uint64_t>& addresses) const;
+
+	// Code points sorted by address, for callers doing their own sorted walk
+	const std::vector<entry>& entries() const	{ return m_entries; }
+
+	line_location get_location(const entry& e) const;
+
+private:
+	// One code point, keyed by the base name of its file
+	struct file_line
+	{
+		uint32_t name_index;	// index in m_names
+		uint32_t line;
+		uint64_t address;
+		uint32_t path_index;	// index in m_paths
+	};
+
+	const std::vector<compilation_unit>*	m_pUnits;
+	uint64_t								m_code_end;
+	std::vector<entry>						m_entries;	// sorted by address, sequence ends first
+	std::vector<file_line>					m_file_lines;	// sorted by name_index, line, address
+	std::vector<std::string>				m_paths;		// full "dir/path" of files
+	std::unordered_map<std::string, uint32_t> m_names;		// base name -> name_index
+};
+
+// ----------------------------------------------------------------------------
+// lazy_line_index -- the lookups of line_index over line programs recorded
+// with elf_parts::LINE_PROGRAMS, each decoded from the file the first time a
+// query needs it. Decoded units are cached up to a memory limit, dropping the
+// least recently used, so memory doesn't grow with the size of the program.
+// Addresses are mapped to units by elf_results::unit_ranges.
+// Can be queried from several threads. A lock guards the cache, but units
+// are decoded outside it, so a slow decode doesn't hold up other queries.
+class lazy_line_index
+{
+public:
+	lazy_line_index() :
+		m_pResults(nullptr),
+		m_max_bytes(DEFAULT_MAX_BYTES),
+		m_bytes(0)
+	{}
+
+	static const uint64_t DEFAULT_MAX_BYTES = 16 << 20;
+
+	// The results are not copied, so must outlive the index. Line programs
+	// are read from "fname" when needed.
+	void build(const elf_results& results, const std::string& fname);
+
+	// Limit the memory used by decoded units. The most recently used unit is
+	// always kept. Set before querying.
+	void set_max_bytes(uint64_t max_bytes)		{ m_max_bytes = max_bytes; }
+
+	// As line_index::find(). "loc" holds on to the unit.
+	bool find(uint64_t address, line_location& loc) const;
+
+	// As line_index::find_addresses(). This decodes every line program in
+	// turn, so is much slower than with line_index.
+	void find_addresses(const char* path, uint32_t line, std::vector<uint64_t>& addresses) const;
+
+	// Get the decoded line program of a unit by its offset in .debug_info.
+	// Returns nullptr if it has none, or it can't be decoded.
+	std::shared_ptr<const compilation_unit> find_unit(uint64_t unit_offset) const;
+
+	// Approximate memory used by the decoded units cached
+	uint64_t cached_bytes() const;
+
+private:
+	// A decoded line program, with its points in address order
+	struct decoded_unit
+	{
+		compilation_unit		unit;
+		std::vector<uint32_t>	by_address;		// indices in unit.points
+		uint64_t				bytes;			// approximate memory used
+	};
+	typedef std::shared_ptr<const decoded_unit> decoded_ptr;
+
+	struct cache_entry
+	{
+		decoded_ptr							decoded;
+		std::list<size_t>::iterator			lru;
+	};
+
+	// Decode a line program, or get it from the cache
+	decoded_ptr get_unit(size_t program) const;
+
+	const elf_results*						m_pResults;
+	std::string								m_fname;
+	std::unordered_map<uint64_t, size_t>	m_programs;		// unit offset -> index in line_programs
+	uint64_t								m_max_bytes;
+	mutable std::mutex						m_mutex;
+	mutable std::unordered_map<size_t, cache_entry> m_cache;	// by index in line_programs
+	mutable std::list<size_t>				m_lru;			// most recently used first
+	mutable uint64_t						m_bytes;
+};
+
+// ----------------------------------------------------------------------------
+struct lookup_symbol
+{
+	std::string name;
+	uint64_t address;
+	uint64_t size;			// 0 if unknown
+	uint64_t limit;			// unsized symbols don't reach this address, see add_extent()
+};
+
+// ----------------------------------------------------------------------------
+// symbol_index -- address -> symbol and name -> symbol lookups.
+class symbol_index
+{
+public:
+	void add(const std::string& name, uint64_t address, uint64_t size);
+
+	// Add an address range symbols can be in, such as a section. Unsized
+	// symbols stop at the end of the ranges containing them; outside every
+	// range they only cover their own address. Without any ranges they are
+	// unbounded.
+	void add_extent(uint64_t start, uint64_t end);
+
+	// Sort the symbols added so far. Call before querying.
+	void build();
+
+	// Find the symbol containing "address". Symbols without a size are assumed
+	// to extend up to the next symbol, within their extent. Returns nullptr if
+	// there is none.
+	const lookup_symbol* find(uint64_t address) const;
+
+	// As find(address), where "upper" is the index of the first symbol above
+	// the address. Used by callers walking sorted addresses.
+	const lookup_symbol* find_below(size_t upper, uint64_t address) const;
+
+	// Returns nullptr if there is no symbol with the name
+	const lookup_symbol* find(const std::string& name) const;
+
+	// Symbols sorted by address
+	const std::vector<lookup_symbol>& symbols() const	{ return m_symbols; }
+
+private:
+	std::vector<lookup_symbol>					m_symbols;
+	std::vector<std::pair<uint64_t, uint64_t> >	m_extents;	// start, end
+	std::unordered_map<std::string, uint32_t>	m_names;	// name -> index in m_symbols
+};
+
+// ----------------------------------------------------------------------------
+// dynamic_symbol_index -- name -> symbol lookups in the dynamic symbol table.
+// When the file has a .gnu.hash or .hash table it is used directly and
+// nothing is built; otherwise a hash map of the names is built.
+class dynamic_symbol_index
+{
+public:
+	dynamic_symbol_index() :
+		m_pResults(nullptr)
+	{}
+
+	// The results are not copied, so must outlive the index.
+	void build(const elf_results& results);
+
+	// Returns nullptr if there is no dynamic symbol with the name
+	const elf_symbol* find(const char* name) const;
+
+	// True if lookups use the file's hash table
+	bool uses_file_hash() const;
+
+private:
+	const elf_results*							m_pResults;
+	std::unordered_map<std::string, uint32_t>	m_names;	// name -> index in dynamic_symbols, if no file hash
+};
+
+// ----------------------------------------------------------------------------
+// The result of an address -> unwinding rules lookup.
+struct frame_location
+{
+	const elf_cfi_cie* cie;
+	const elf_cfi_table* table;
+	const elf_cfi_row* row;
+};
+
+// ----------------------------------------------------------------------------
+// The registers of one frame, by DWARF register number.
+struct frame_registers
+{
+	std::vector<uint64_t> values;
+	std::vector<bool> valid;
+};
+
+// ----------------------------------------------------------------------------
+// frame_index -- address -> call frame rules, for unwinding. The instructions
+// of each FDE are decoded the first time it is needed, then kept, so later
+// lookups are a binary search. Can be queried from several threads.
+class frame_index
+{
+public:
+	frame_index() :
+		m_pCfi(nullptr),
+		m_complete(false)
+	{}
+
+	// The entries are not copied, so must outlive the index.
+	void build(const elf_cfi& cfi);
+
+	// Decode every FDE now. Later lookups then take no lock.
+	void decode_all();
+
+	// Returns false if no FDE covers the address or its instructions are bad.
+	bool find(uint64_t address, frame_location& loc) const;
+
+	// Recover the registers of the caller, and the CFA (normally the caller's
+	// stack pointer). The return address is in caller[loc.cie->return_register].
+	// "read_memory" reads a value of the target's address size. Registers
+	// without a rule are copied; those needing DWARF expressions are marked
+	// invalid. Returns false if the CFA can't be found.
+	static bool unwind(const frame_location& loc, const frame_registers& regs,
+		const std::function<bool(uint64_t address, uint64_t& value)>& read_memory,
+		frame_registers& caller, uint64_t& cfa);
+
+private:
+	const elf_cfi*											m_pCfi;
+	mutable std::mutex										m_mutex;
+	mutable std::unordered_map<size_t, std::unique_ptr<elf_cfi_table> > m_tables;	// by FDE index
+	std::atomic<bool>										m_complete;		// every FDE is in m_tables
+};
+
+}
+#endif // FONDA_LIB_LOOKUP_INDEX_H
@@ -2,6 +2,9 @@
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
 
 #include "dwarf_struct.h"
 #include "elf_struct.h"
@@ -40,6 +43,36 @@ template <class T>
 	return acc;
 }
 
+// ----------------------------------------------------------------------------
+// Fast non-cryptographic hash of a block of data, used to spot changed data
+// when reloading. Consumes 8 bytes per step, in the style of xxHash64.
+static uint64_t hash_data(const uint8_t* data, uint64_t size, uint64_t seed = 0)
+{
+	const uint64_t prime1 = 0x9e3779b185ebca87ULL;
+	const uint64_t prime2 = 0xc2b2ae3d27d4eb4fULL;
+	uint64_t acc = seed + prime1 + size;
+	while (size >= 8)
+	{
+		uint64_t val;
+		memcpy(&val, data, 8);
+		acc ^= val * prime2;
+		acc = ((acc << 31) | (acc >> 33)) * prime1;
+		data += 8;
+		size -= 8;
+	}
+	while (size)
+	{
+		acc ^= *data++ * prime1;
+		acc = ((acc << 11) | (acc >> 53)) * prime2;
+		--size;
+	}
+	// Final mix so that all input bits affect all output bits
+	acc ^= acc >> 33;
+	acc *= prime2;
+	acc ^= acc >> 29;
+	return acc;
+}
+
 // ----------------------------------------------------------------------------
 // buffer_access -- Bounded access to a block of memory
 class buffer_access
@@ -276,6 +309,19 @@ public:
 		return buffer.get_pos();
 	}
 
+	// ----------------------------------------------------------------------------
+	// Move forwards without reading. Returns 0 for success, 1 for overrun.
+	int skip(uint64_t count)
+	{
+		return buffer.set(buffer.get_pos() + count);
+	}
+
+	// ----------------------------------------------------------------------------
+	const uint8_t* get_data() const
+	{
+		return buffer.get_data();
+	}
+
 	bool errored() const { return buffer.errored(); }
 private:
 	buffer_access buffer;
@@ -314,9 +360,16 @@ struct elf_section_int
 // ----------------------------------------------------------------------------
 struct elf
 {
+	elf() :
+		file(nullptr),
+		sections(nullptr),
+		read_strings_directly(false)
+	{}
+
 	Elf_Ident 	ident;
 	FILE*		file;
 	elf_section_int* sections;		// flat array of section info
+	bool		read_strings_directly;	// read debug strings from the file rather than loading whole sections
 
 	int load_section(size_t section_num);
 
@@ -342,10 +395,11 @@ struct elf
 struct content_line
 {
 	std::string path;
-	int directory_index;
+	uint64_t directory_index;
 	uint64_t timestamp;
 	uint64_t size;
-	uint64_t mdd5;
+	uint8_t md5[16];
+	bool has_md5;
 };
 
 struct content_desc
@@ -370,6 +424,47 @@ struct line_state_machine
 	uint64_t discriminator;
 };
 
+// ----------------------------------------------------------------------------
+// State used by reload_elf_file() to copy unchanged data from previous results.
+struct reload_context
+{
+	const elf_results*		previous;
+	elf_reload_report*		report;
+	std::unordered_map<uint64_t, size_t> prev_units;	// unit hash -> index in previous line_info_units
+	bool					strings_match;		// strings used by line programs are unchanged
+	bool					names_match;		// section names are unchanged
+	size_t					next_slice;			// next entry of previous symbol_slices to compare
+};
+
+// ----------------------------------------------------------------------------
+// Progress through the parts of a file being decoded, see elf_parse_options.
+struct parse_progress
+{
+	parse_progress(const elf_parse_options& options) :
+		options(options),
+		units(options.units.begin(), options.units.end()),
+		done(0),
+		total(0)
+	{}
+
+	// Count "size" more bytes as decoded. Returns ERROR_CANCELLED if the
+	// caller wants to stop.
+	int advance(uint64_t size)
+	{
+		done += size;
+		if (options.progress && !options.progress(done, total))
+			return elf_error::ERROR_CANCELLED;
+		return elf_error::OK;
+	}
+
+	bool wanted(uint32_t part) const		{ return (options.parts & part) != 0; }
+
+	const elf_parse_options&	options;
+	std::unordered_set<uint64_t> units;		// .debug_info units to decode, or empty for all
+	uint64_t					done;
+	uint64_t					total;
+};
+
 // ----------------------------------------------------------------------------
 int elf::load_section(size_t section_num)
 {
@@ -393,24 +488,75 @@ element_reader elf::create_reader(uint32_t section_num)
 }
 
 // ----------------------------------------------------------------------------
-static elf_section_int* load_named_section(elf& elf, const char* name)
+// Sections without file data, e.g. .eh_frame in a separate debug file, are
+// treated as missing.
+static elf_section_int* find_named_section(elf& elf, const char* name)
 {
 	for (size_t sectionId = 0; sectionId < elf.e_shnum; ++sectionId)
 	{
 		elf_section_int& s = elf.sections[sectionId];
-		if (s.name_string == name)
-		{
-			if (elf.load_section(sectionId))
-				return nullptr;
+		if (s.name_string == name && s.sh_type != SHT_NOBITS)
 			return &s;
-		}
 	}
 	return nullptr;
 }
 
+// ----------------------------------------------------------------------------
+static elf_section_int* load_named_section(elf& elf, const char* name)
+{
+	elf_section_int* s = find_named_section(elf, name);
+	if (!s || elf.load_section(s->section_id))
+		return nullptr;
+	return s;
+}
+
+// ----------------------------------------------------------------------------
+// Load part of a section into "chunk". The size is clipped to the end of the
+// section, and "complete" is set if the chunk reaches it.
+static int load_section_window(elf& elf, const elf_section_int& section, uint64_t offset,
+	uint64_t size, loaded_chunk& chunk, bool& complete)
+{
+	if (offset > section.sh_size)
+		return elf_error::ERROR_READ_FILE;
+	complete = size >= section.sh_size - offset;
+	if (complete)
+		size = section.sh_size - offset;
+	return chunk.load(elf.file, section.sh_offset + offset, size);
+}
+
+// ----------------------------------------------------------------------------
+// Read a string from a section a block at a time, without loading the section
+static std::string read_file_string(elf& elf, const char* section_name, uint64_t offset)
+{
+	const elf_section_int* s = find_named_section(elf, section_name);
+	if (!s)
+		return "";
+
+	std::string res;
+	char block[64];
+	while (offset < s->sh_size)
+	{
+		size_t size = sizeof(block);
+		if (size > s->sh_size - offset)
+			size = s->sh_size - offset;
+		fseek(elf.file, s->sh_offset + offset, SEEK_SET);
+		if (fread(block, 1, size, elf.file) != size)
+			break;
+		const char* end = (const char*)memchr(block, 0, size);
+		if (end)
+			return res.append(block, end - block);
+		res.append(block, size);
+		offset += size;
+	}
+	return res;
+}
+
 // ----------------------------------------------------------------------------
 static std::string read_debug_string(elf& elf, const char* section_name, uint64_t offset)
 {
+	if (elf.read_strings_directly)
+		return read_file_string(elf, section_name, offset);
+
 	// This will load the section if necessary
 	elf_section_int* s = load_named_section(elf, section_name);
 	if (!s)
@@ -422,6 +568,86 @@ static std::string read_debug_string(elf& elf, const char* section_name, uint64_
 	return tmp_read.read_null_term_string();
 }
 
+// ----------------------------------------------------------------------------
+// Read an address or length of the given size
+static uint64_t read_sized(element_reader& eread, uint8_t size)
+{
+	switch (size)
+	{
+		case 1:		return eread.readU8();
+		case 2:		return eread.readU16();
+		case 4:		return eread.readU32();
+		default:	return eread.readU64();
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Read a 3-byte value, as used by DW_FORM_strx3 and DW_FORM_addrx3
+static uint64_t read_u24(element_reader& eread, uint8_t data_mode)
+{
+	// Byte order applies to the 3 bytes as a whole
+	uint32_t b0 = eread.readU8(), b1 = eread.readU8(), b2 = eread.readU8();
+	return data_mode == ELFDATA2MSB ? (b0 << 16) | (b1 << 8) | b2 : (b2 << 16) | (b1 << 8) | b0;
+}
+
+// ----------------------------------------------------------------------------
+// Read one entry of a table such as .debug_str_offsets or .debug_addr. The
+// entry is read straight from the file if the section isn't loaded.
+// Returns 0 for success, 1 for failure.
+static int read_section_value(elf& elf, const elf_section_int* section, uint64_t offset,
+	uint8_t size, uint64_t& value)
+{
+	if (!section || size > 8 || offset > section->sh_size || size > section->sh_size - offset)
+		return 1;
+	uint8_t data[8];
+	if (section->is_loaded)
+		memcpy(data, section->chunk.data + offset, size);
+	else
+	{
+		fseek(elf.file, section->sh_offset + offset, SEEK_SET);
+		if (fread(data, 1, size, elf.file) != size)
+			return 1;
+	}
+	element_reader eread(buffer_access(data, size), elf.ident.ei_data, elf.ident.ei_class);
+	value = read_sized(eread, size);
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+static bool is_strx_form(uint16_t form)
+{
+	return form == DW_FORM_strx || form == DW_FORM_strx1 || form == DW_FORM_strx2 ||
+		form == DW_FORM_strx3 || form == DW_FORM_strx4;
+}
+
+// ----------------------------------------------------------------------------
+static bool is_addrx_form(uint16_t form)
+{
+	return form == DW_FORM_addrx || form == DW_FORM_addrx1 || form == DW_FORM_addrx2 ||
+		form == DW_FORM_addrx3 || form == DW_FORM_addrx4;
+}
+
+// ----------------------------------------------------------------------------
+// The default base of a unit's entries in .debug_str_offsets or .debug_addr,
+// i.e. just after the header of the first contribution. Used when a unit has
+// no DW_AT_str_offsets_base or DW_AT_addr_base.
+static uint64_t default_table_base(bool is64bit)
+{
+	return is64bit ? 16 : 8;
+}
+
+// ----------------------------------------------------------------------------
+// Read an entry of .debug_str_offsets, then the string in .debug_str
+static std::string read_indexed_string(elf& elf, uint64_t str_offsets_base, uint64_t index, bool is64bit)
+{
+	const elf_section_int* offsets = find_named_section(elf, ".debug_str_offsets");
+	uint8_t size = is64bit ? 8 : 4;
+	uint64_t offset;
+	if (read_section_value(elf, offsets, str_offsets_base + index * size, size, offset))
+		return "";
+	return read_debug_string(elf, ".debug_str", offset);
+}
+
 // ----------------------------------------------------------------------------
 static void reset(line_state_machine& sm)
 {
@@ -439,50 +665,93 @@ static void reset(line_state_machine& sm)
 };
 
 // ----------------------------------------------------------------------------
+// Read one directory or file entry of a version 5 line program header.
+// "str_offsets_base" is for the DW_FORM_strx forms, from the owning unit.
 int read_content_line(content_line& content, element_reader& eread, elf& elf_data,
-	const std::vector<content_desc>& descs, bool is64Bit)
+	const std::vector<content_desc>& descs, bool is64Bit, uint64_t str_offsets_base)
 {
+	content.directory_index = 0;
+	content.timestamp = 0;
+	content.size = 0;
+	content.has_md5 = false;
+
 	for (size_t fieldId = 0; fieldId < descs.size(); ++fieldId)
 	{
 		const content_desc& desc = descs[fieldId];
-		switch (desc.type)
+
+		// Read the value in whatever form is used
+		uint64_t val = 0;
+		std::string str;
+		bool is_string = false;
+		switch (desc.form)
 		{
-			case DW_LNCT_directory_index:
+			case DW_FORM_string:
+				str = eread.read_null_term_string();
+				is_string = true;
+				break;
+			case DW_FORM_line_strp:
+				str = read_debug_string(elf_data, ".debug_line_str", eread.readU32or64(is64Bit));
+				is_string = true;
+				break;
+			case DW_FORM_strp:
+				str = read_debug_string(elf_data, ".debug_str", eread.readU32or64(is64Bit));
+				is_string = true;
+				break;
+			case DW_FORM_strp_sup:
+				// The string is in a supplementary object file, which we don't read
+				eread.readU32or64(is64Bit);
+				is_string = true;
+				break;
+			case DW_FORM_strx:
+			case DW_FORM_strx1:
+			case DW_FORM_strx2:
+			case DW_FORM_strx3:
+			case DW_FORM_strx4:
 			{
+				uint64_t index;
 				switch (desc.form)
 				{
-					case DW_FORM_data1:	content.directory_index = eread.readU8(); continue;
-					case DW_FORM_data2:	content.directory_index = eread.readU16(); continue;
-					case DW_FORM_udata:	content.directory_index = eread.readULEB128(); continue;
-					default: return elf_error::ERROR_DWARF_UNKNOWN_CONTENT_FORM;
+					case DW_FORM_strx1:	index = eread.readU8(); break;
+					case DW_FORM_strx2:	index = eread.readU16(); break;
+					case DW_FORM_strx3:	index = read_u24(eread, elf_data.ident.ei_data); break;
+					case DW_FORM_strx4:	index = eread.readU32(); break;
+					default:			index = eread.readULEB128(); break;
 				}
+				str = read_indexed_string(elf_data, str_offsets_base, index, is64Bit);
+				is_string = true;
 				break;
 			}
-			case DW_LNCT_path:
-			{
-				uint64_t offset;
-				switch (desc.form)
+			case DW_FORM_data1:		val = eread.readU8(); break;
+			case DW_FORM_data2:		val = eread.readU16(); break;
+			case DW_FORM_data4:		val = eread.readU32(); break;
+			case DW_FORM_data8:		val = eread.readU64(); break;
+			case DW_FORM_udata:		val = eread.readULEB128(); break;
+			case DW_FORM_sdata:		val = (uint64_t)eread.readSLEB128(); break;
+			case DW_FORM_data16:
+				if (eread.skip(16) == 0 && desc.type == DW_LNCT_MD5)
 				{
-					case DW_FORM_string:	content.path = eread.read_null_term_string(); continue;
-					case DW_FORM_line_strp:
-						offset = eread.readU32or64(is64Bit);
-						content.path = read_debug_string(elf_data, ".debug_line_str", offset);
-						continue;
-					case DW_FORM_strp:		content.path = eread.readULEB128(); continue;
-						offset = eread.readU32or64(is64Bit);
-						content.path = read_debug_string(elf_data, ".debug_str", offset);
-						continue;
-					// NO CHECK
-					//case DW_FORM_strp_sup:	content.path = eread.readULEB128(); continue;
-					//	offset = eread.readU32or64(is64Bit);
-					//	content.path = ReadDebugString(elf_data, ".debug_line_str", offset);
-					//	continue;
-					default: return elf_error::ERROR_DWARF_UNKNOWN_CONTENT_FORM;
+					memcpy(content.md5, eread.get_data() - 16, 16);
+					content.has_md5 = true;
 				}
 				break;
-			}
+			case DW_FORM_block:		eread.skip(eread.readULEB128()); break;
 			default:
-				return elf_error::ERROR_DWARF_UNKNOWN_CONTENT_TYPE;
+				return elf_error::ERROR_DWARF_UNKNOWN_CONTENT_FORM;
+		}
+
+		switch (desc.type)
+		{
+			case DW_LNCT_path:
+				if (!is_string)
+					return elf_error::ERROR_DWARF_UNKNOWN_CONTENT_FORM;
+				content.path = str;
+				break;
+			case DW_LNCT_directory_index:	content.directory_index = val; break;
+			case DW_LNCT_timestamp:			content.timestamp = val; break;
+			case DW_LNCT_size:				content.size = val; break;
+			default:
+				// DW_LNCT_MD5 is handled above. Vendor-defined content is skipped.
+				break;
 		}
 	}
 	return elf_error::OK;
@@ -500,331 +769,1511 @@ static void add_codepoint(const line_state_machine& sm, compilation_unit& unit)
 }
 
 // ----------------------------------------------------------------------------
-static int parse_section_debug_info(elf& elf, elf_section_int& section)
+// Connections between the units of .debug_info and the line programs in .debug_line
+struct line_program_links
 {
-	element_reader eread = elf.create_reader(section.section_id);
-	bool is64Bit;
-	uint32_t unit_length = eread.read_ptrsize(is64Bit);
-	uint16_t dwarf_version = eread.readU16();
-	uint8_t unit_type = 0xff;
-	uint8_t address_size = 0;
-	uint64_t debug_abbrev_offset = 0;
-	(void) unit_length;
-	(void) unit_type;
-	(void) address_size;
-
-	if (dwarf_version <= 4)
-	{
-		debug_abbrev_offset = eread.readU32or64(is64Bit);
-		address_size = eread.readU8();
-	}
-	else if (dwarf_version == 5)
-	{
-		unit_type = eread.readU8();
-		// The following two are tranposed in v5 onwards!
-		address_size = eread.readU8();
-		debug_abbrev_offset = eread.readU32or64(is64Bit);
-	}
-	else
-	{
-		return elf_error::ERROR_DWARF_VERSION_TOO_NEW;
-	}
-	(void) debug_abbrev_offset;
-	return elf_error::OK;
-}
+	std::unordered_map<uint64_t, uint64_t> str_bases;	// DW_AT_stmt_list -> str_offsets_base
+	std::unordered_map<uint64_t, uint64_t> stmt_lists;	// unit offset -> DW_AT_stmt_list
+	std::unordered_map<uint64_t, uint32_t> line_units;	// DW_AT_stmt_list -> index in line_info_units
+};
 
 // ----------------------------------------------------------------------------
-static int parse_section_debug_line(elf_results& output, 
-	elf& elf, const elf_section_int& section)
+//	DEBUG INFO
+// ----------------------------------------------------------------------------
+// One attribute specification of an abbreviation
+struct abbrev_attr
 {
-	element_reader eread = elf.create_reader(section.section_id);
-	uint64_t section_end_pos = section.sh_size;
-	int ret;
+	uint16_t name;				// DW_AT_*
+	uint16_t form;				// DW_FORM_*
+	int64_t implicit_const;		// value for DW_FORM_implicit_const
+};
 
-	// Read all the compilation units in turn
-	while (1)
-	{
-		if (eread.get_pos() > section_end_pos)
-			return elf_error::ERROR_DWARF_DEBUGLINE_PARSE;
+// ----------------------------------------------------------------------------
+struct abbrev
+{
+	uint32_t tag;				// DW_TAG_*, or 0 if the code is unused
+	bool has_children;
+	uint32_t first_attr;		// index in abbrev_table::attrs
+	uint32_t num_attrs;
+	int32_t fixed_size;			// bytes of attribute data, or -1 if any attribute is variable-sized
+	int32_t sibling_pos;		// position of DW_AT_sibling data, or -1 if absent or not at a fixed position
+	uint16_t sibling_form;
+};
 
-		if (eread.get_pos() == section_end_pos)
-			break;
+// ----------------------------------------------------------------------------
+// An abbreviation table from .debug_abbrev, indexed directly by code.
+struct abbrev_table
+{
+	std::vector<abbrev> codes;
+	std::vector<abbrev_attr> attrs;
 
-		// 6.2.4 The Line Number Program Header
-		// (for each compilation unit)
-		bool is64bit = false;
-		uint64_t unit_length = eread.read_ptrsize(is64bit);
+	// The unit encoding that fixed_size and sibling_pos were calculated for
+	uint16_t version;
+	uint8_t address_size;
+	bool is64bit;
+};
 
-		uint64_t unit_start_pos = eread.get_pos();	// the start of unit doesn't include unit_length
-		uint16_t line_number_version = eread.readU16();	// this is the line number version
-		uint8_t address_size = 0;
-		uint8_t segment_selector_size = 0;
-		if (line_number_version >= 5)
-			address_size = eread.readU8();
-		if (line_number_version >= 5)
-			segment_selector_size = eread.readU8();
-		(void)address_size;
-		(void)segment_selector_size;
-
-		// This varies with 32/64 bit formats
-		uint64_t header_length = eread.readU32or64(is64bit);
-		uint8_t minimum_instruction_length = eread.readU8();
-		uint8_t maximum_operations_per_instruction = 0;
-		if (line_number_version >= 5)
-			maximum_operations_per_instruction = eread.readU8();
-		uint8_t default_is_stmt = eread.readU8();
-		int8_t line_base = (int8_t)eread.readU8();
-		uint8_t line_range = eread.readU8();
-		uint8_t opcode_base = eread.readU8();
-		// Suppress unused warnings
-		(void) header_length;
-		(void) maximum_operations_per_instruction;
+// ----------------------------------------------------------------------------
+// Header information of the unit currently being read
+struct dwarf_unit
+{
+	uint64_t offset;			// start of the unit header in .debug_info
+	uint64_t end;				// offset of the next unit
+	uint16_t version;
+	uint8_t unit_type;
+	uint8_t address_size;
+	bool is64bit;
+	const abbrev_table* abbrevs;
+	uint64_t str_offsets_base;	// from the root DIE, for DW_FORM_strx*
+	uint64_t addr_base;			// from the root DIE, for DW_FORM_addrx*
+	uint64_t rnglists_base;		// from the root DIE, for DW_FORM_rnglistx
+	uint64_t base_address;		// low_pc of the root DIE, which range lists are relative to
+};
 
-		output.line_info_units.push_back(compilation_unit());
-		compilation_unit& compilation_unit = output.line_info_units.back();
+// ----------------------------------------------------------------------------
+// Sections and caches shared while reading all the units
+struct dwarf_context
+{
+	dwarf_context(elf& _elf_data) :
+		elf_data(_elf_data),
+		info(nullptr),
+		abbrev(nullptr),
+		str(nullptr),
+		line_str(nullptr),
+		str_offsets(nullptr),
+		addr(nullptr),
+		ranges(nullptr),
+		rnglists(nullptr)
+	{}
 
-		// Now read a series of opcode lengths
-		for (uint8_t i = 1; i < opcode_base; ++i)
-		{
-			uint8_t length = eread.readU8();
-			PRINTF(("\topcode %u has %u args\n", i, length));
-			(void) length;
-		}
+	elf& elf_data;
+	elf_section_int* info;
+	elf_section_int* abbrev;
+	elf_section_int* str;
+	elf_section_int* line_str;
+	elf_section_int* str_offsets;		// need not be loaded
+	elf_section_int* addr;				// need not be loaded
+	elf_section_int* ranges;			// .debug_ranges, for DWARF 4 and earlier
+	elf_section_int* rnglists;			// .debug_rnglists, for DWARF 5
+	std::unordered_map<uint64_t, abbrev_table> abbrev_tables;	// by offset in .debug_abbrev
+	std::vector<dwarf_unit> units;			// all units read so far, in file order
+	elf_range_map unit_ranges;				// from the root DIE of each unit
+	line_program_links links;
 
-		compilation_unit.dirs.push_back(".");
-		if (line_number_version >= 5)		// NO CHECK ??? or dwarf_version?
-		{
-			uint8_t directory_entry_format_count = eread.readU8();
+	// Functions whose names are in another DIE, to be resolved once all
+	// the units are known: (index in output.functions, offset of the other DIE)
+	std::vector<std::pair<size_t, uint64_t> > unnamed_functions;
+	std::vector<std::pair<size_t, uint64_t> > unnamed_inlines;	// as above, for output.inlines
+};
 
-			std::vector<content_desc> descs;
-			std::vector<content_desc> fileDescs;
+// ----------------------------------------------------------------------------
+// A decoded attribute value. Strings point into the loaded section data.
+struct attr_value
+{
+	uint16_t form;
+	uint64_t val;
+	const char* str;			// non-null for string forms
+};
 
-			for (uint8_t i = 0; i < directory_entry_format_count; ++i)
-			{
-				content_desc desc;
-				desc.type = eread.readULEB128();
-				desc.form = eread.readULEB128();
-				descs.push_back(desc);
-			}
-			uint64_t directories_count = eread.readULEB128();
-			for (uint64_t i = 0; i < directories_count; ++i)
-			{
-				content_line cl;
-				ret = read_content_line(cl, eread, elf, descs, is64bit);
-				CHECK_RET(ret)
-				compilation_unit.dirs.push_back(cl.path);
-			}
-			uint64_t file_name_entry_format_count = eread.readULEB128();
-			for (uint8_t i = 0; i < file_name_entry_format_count; ++i)
-			{
-				content_desc desc = {};
-				desc.type = eread.readULEB128();
-				desc.form = eread.readULEB128();
-				fileDescs.push_back(desc);
-			}
+// ----------------------------------------------------------------------------
+// Return the size of data of a form, or -1 if it is variable or unknown.
+static int form_fixed_size(uint16_t form, uint16_t version, uint8_t address_size, bool is64bit)
+{
+	const int offset_size = is64bit ? 8 : 4;
+	switch (form)
+	{
+		case DW_FORM_flag_present:
+		case DW_FORM_implicit_const:
+			return 0;
+		case DW_FORM_data1: case DW_FORM_ref1: case DW_FORM_flag:
+		case DW_FORM_strx1: case DW_FORM_addrx1:
+			return 1;
+		case DW_FORM_data2: case DW_FORM_ref2:
+		case DW_FORM_strx2: case DW_FORM_addrx2:
+			return 2;
+		case DW_FORM_strx3: case DW_FORM_addrx3:
+			return 3;
+		case DW_FORM_data4: case DW_FORM_ref4: case DW_FORM_ref_sup4:
+		case DW_FORM_strx4: case DW_FORM_addrx4:
+			return 4;
+		case DW_FORM_data8: case DW_FORM_ref8: case DW_FORM_ref_sig8: case DW_FORM_ref_sup8:
+			return 8;
+		case DW_FORM_data16:
+			return 16;
+		case DW_FORM_addr:
+			return address_size;
+		case DW_FORM_strp: case DW_FORM_line_strp: case DW_FORM_sec_offset: case DW_FORM_strp_sup:
+			return offset_size;
+		case DW_FORM_ref_addr:
+			return version <= 2 ? address_size : offset_size;
+		default:
+			return -1;
+	}
+}
 
-			uint64_t files_count = eread.readULEB128();
-			for (uint64_t i = 0; i < files_count; ++i)
-			{
-				content_line cl = {};
-				ret = read_content_line(cl, eread, elf, fileDescs, is64bit);
-				CHECK_RET(ret)
-
-				// Copy out the necessary bits
-				compilation_unit::file file;
-				file.dir_index = cl.directory_index;
-				file.path = cl.path;
-				file.length = 0;
-				file.timestamp = 0;
-				compilation_unit.files.push_back(file);
-			}
-		}
-		else
+// ----------------------------------------------------------------------------
+// Calculate the fixed sizes of each abbreviation for a unit encoding
+static void calc_abbrev_strides(abbrev_table& table, const dwarf_unit& unit)
+{
+	table.version = unit.version;
+	table.address_size = unit.address_size;
+	table.is64bit = unit.is64bit;
+	for (abbrev& ab : table.codes)
+	{
+		int32_t pos = 0;
+		ab.sibling_pos = -1;
+		for (uint32_t i = 0; i < ab.num_attrs; ++i)
 		{
-			// Original, simpler directory/file name description
-			while (1)
-			{
-				std::string dir = eread.read_null_term_string();
-				if (dir.size() == 0)
-					break;
-				compilation_unit.dirs.push_back(dir);
-			}
-
-			{
-				compilation_unit::file f;
-				f.path = "NONE";
-				f.dir_index = 0;
-				f.length = 0;
-				f.timestamp = 0;
-				compilation_unit.files.push_back(f);
-			}
-			while (1)
+			const abbrev_attr& attr = table.attrs[ab.first_attr + i];
+			if (attr.name == DW_AT_sibling && pos >= 0)
 			{
-				std::string file_name = eread.read_null_term_string();
-				if (file_name.size() == 0)
-					break;
-
-				compilation_unit::file f;
-				f.dir_index = eread.readULEB128();
-				f.timestamp = eread.readULEB128();
-				f.length = eread.readULEB128();
-				f.path = file_name;
-
-				compilation_unit.files.push_back(f);
+				ab.sibling_pos = pos;
+				ab.sibling_form = attr.form;
 			}
+			int size = form_fixed_size(attr.form, unit.version, unit.address_size, unit.is64bit);
+			if (size < 0 || pos < 0)
+				pos = -1;
+			else
+				pos += size;
 		}
-		if (eread.errored())
-			return elf_error::ERROR_READ_FILE;		
-
-		// Now the compilation units
-		line_state_machine sm;
-		reset(sm);
-		sm.is_stmt = default_is_stmt;
+		ab.fixed_size = pos;
+	}
+}
 
-		uint64_t unit_end_pos = unit_start_pos + unit_length;
+// ----------------------------------------------------------------------------
+// Parse one abbreviation table from .debug_abbrev, at the reader position.
+static int parse_abbrev_table(element_reader& eread, abbrev_table& table)
+{
+	while (1)
+	{
+		uint64_t code = eread.readULEB128();
+		if (code == 0)
+			break;
+		abbrev ab;
+		ab.tag = eread.readULEB128();
+		ab.has_children = eread.readU8() == DW_CHILDREN_yes;
+		ab.first_attr = table.attrs.size();
 		while (1)
 		{
-			assert(sm.line >= 1);
-			if (eread.get_pos() > unit_end_pos)
-				return elf_error::ERROR_DWARF_DEBUGLINE_PARSE;
-			if (eread.get_pos() == unit_end_pos)
+			abbrev_attr attr;
+			attr.name = eread.readULEB128();
+			attr.form = eread.readULEB128();
+			attr.implicit_const = 0;
+			if (attr.form == DW_FORM_implicit_const)
+				attr.implicit_const = eread.readSLEB128();
+			if (attr.name == 0 && attr.form == 0)
 				break;
 			if (eread.errored())
-				return elf_error::ERROR_READ_FILE;
-
-			assert(eread.get_pos() < unit_end_pos);
-			uint8_t opcode0 = eread.readU8();
-			PRINTF(("--- pos: 0x%x opcode0: %x\n", debug_pos, opcode0));
-			if (opcode0 == 0)
-			{
-				// Extended opcode
-				uint64_t length = eread.readULEB128();
-				PRINTF(("length: %x\n", length));
-				(void)length;		// should we use this for correctness checking?
-
-				uint8_t extended_opcode = eread.readU8();
-				PRINTF(("extended_opcode: %x\n", extended_opcode));
+				return elf_error::ERROR_DWARF_DEBUGINFO_PARSE;
+			table.attrs.push_back(attr);
+		}
+		ab.num_attrs = table.attrs.size() - ab.first_attr;
+		if (eread.errored())
+			return elf_error::ERROR_DWARF_DEBUGINFO_PARSE;
 
-				if (extended_opcode == DW_LNE_set_address)
-				{
-					uint64_t addr = eread.readAddress();
-					PRINTF(("DW_LNE_set_address addr: %x\n", addr));
-					sm.address = addr;
-				}
-				else if (extended_opcode == DW_LNE_end_sequence)
-				{
-					PRINTF(("DW_LNE_end_sequence\n"));
-					add_codepoint(sm, compilation_unit);
-					reset(sm);
-					sm.is_stmt = default_is_stmt;
-				}
-				else if (extended_opcode == DW_LNE_define_file)
-				{
-					PRINTF(("DW_LNE_define_file\n"));
-					compilation_unit::file f;
-					uint64_t dir_index = eread.readULEB128();
-					f.timestamp = eread.readULEB128();
-					f.length = eread.readULEB128();
-					f.path = eread.read_null_term_string();
-					f.dir_index = dir_index;
-					PRINTF(("New file: \"%s\" dir_index: %x mod_ts: %x length: %x\n",
-						f.filename, f.dir_index, f.timestamp, f.length));
-					compilation_unit.files.push_back(f);
-				}
-				else if (extended_opcode == DW_LNE_set_discriminator)
-				{
-					sm.discriminator = eread.readULEB128();
-					PRINTF(("DW_LNE_set_discriminator: %llx\n", sm.discriminator));
-				}
-				else
-				{
-					printf("unknown extended_opcode\n");
-					printf("extended_opcode: %x\n", extended_opcode);
-					return elf_error::ERROR_DWARF_UNKNOWN_EXTENDED_OPCODE;
-				}
-			}
-			else if (opcode0 == DW_LNS_advance_pc)
-			{
-				// NOTE: unsigned!
-				uint64_t adv = eread.readULEB128();
-				sm.address += adv * minimum_instruction_length;
-				PRINTF(("advance PC by %d to %x\n", adv, sm.address));
-			}
-			else if (opcode0 == DW_LNS_advance_line)
-			{
-				int64_t adv = eread.readSLEB128();
-				sm.line += adv;
-				PRINTF(("  [0x%08x]  Advance Line by %lld to %lld\n", debug_pos, adv, sm.line));
-			}
-			else if (opcode0 == DW_LNS_copy)
-			{
-				add_codepoint(sm, compilation_unit);
-			}
-			else if (opcode0 == DW_LNS_set_file)
-			{
-				uint64_t file_index = eread.readULEB128();
-				PRINTF(("Set file index to %lld\n", file_index));
-				sm.file_index = file_index;
-			}
-			else if (opcode0 == DW_LNS_set_column)
-			{
-				uint64_t column = eread.readULEB128();
-				PRINTF(("Set column to %lld\n", column));
-				sm.column = column;
-			}
-			else if (opcode0 == DW_LNS_negate_stmt)
-			{
-				PRINTF(("Negate stat\n"));
-				sm.is_stmt = !sm.is_stmt;
-			}
-			else if (opcode0 == DW_LNS_const_add_pc)
-			{
-				int32_t adjusted_opcode = (uint32_t)255 - (uint32_t)opcode_base;
-				uint64_t addr_increment = uint64_t(adjusted_opcode / line_range) * minimum_instruction_length;
-				PRINTF(("Advance PC by %lld\n", addr_increment));
-				sm.address += addr_increment;
-			}
-			else if (opcode0 >= opcode_base)
-			{
-				// 6.2.5.1 Special Opcodes
-				int32_t adjusted_opcode = (uint32_t)opcode0 - (uint32_t)opcode_base;
-				uint64_t addr_increment = uint64_t(adjusted_opcode / line_range) * minimum_instruction_length;
-
-				int32_t line_increment = line_base + (adjusted_opcode % line_range);
-				PRINTF(("Special opcode: adjusted_opcode=%d line_range=%d addr_inc=%d line_inc=%d\n",
-					adjusted_opcode,
-					line_range,
-					addr_increment, line_increment));
-				sm.address += addr_increment;
-				sm.line += line_increment;
-				add_codepoint(sm, compilation_unit);
-				sm.basic_block = false;
-				sm.prologue_end = false;
-				sm.epilogue_begin = false;
-			}
-			else
-			{
-				printf("unknown opcode\n");
-				printf("opcode0: %x\n", opcode0);
-				return elf_error::ERROR_DWARF_UNKNOWN_OPCODE;
-			}
+		// Codes are normally dense and start at 1. Guard against silly values.
+		if (code > 0x100000)
+			return elf_error::ERROR_DWARF_UNKNOWN_ABBREV;
+		if (code >= table.codes.size())
+		{
+			abbrev unused = {};
+			table.codes.resize(code + 1, unused);
 		}
+		table.codes[code] = ab;
 	}
 	return elf_error::OK;
 }
 
 // ----------------------------------------------------------------------------
-// Templated function to read either Elf32_sym or Elf64_sym
-template <typename ELF_SYMBOL>
-	static int read_elf_symbol(elf_symbol& symbol, elf& elf_data, buffer_access& buffer)
+// Find or create the abbreviation table for a unit
+static int get_abbrev_table(dwarf_context& ctx, uint64_t offset, dwarf_unit& unit)
 {
-	ELF_SYMBOL file_sym;
-	if (buffer.read(file_sym) != 0)
-		return elf_error::ERROR_READ_FILE;
-
-	uint8_t mode = elf_data.ident.ei_data;
-	symbol.st_name       = conv_endian(file_sym.st_name, mode);
-	symbol.st_value      = conv_endian(file_sym.st_value, mode);
+	std::unordered_map<uint64_t, abbrev_table>::iterator it = ctx.abbrev_tables.find(offset);
+	if (it == ctx.abbrev_tables.end())
+	{
+		element_reader eread = ctx.elf_data.create_reader(ctx.abbrev->section_id);
+		if (eread.set(offset))
+			return elf_error::ERROR_DWARF_DEBUGINFO_PARSE;
+		abbrev_table table;
+		int ret = parse_abbrev_table(eread, table);
+		CHECK_RET(ret);
+		calc_abbrev_strides(table, unit);
+		it = ctx.abbrev_tables.insert(std::make_pair(offset, table)).first;
+	}
+	else if (it->second.version != unit.version || it->second.address_size != unit.address_size ||
+		it->second.is64bit != unit.is64bit)
+	{
+		// Shared by a unit with a different encoding (very rare)
+		calc_abbrev_strides(it->second, unit);
+	}
+	unit.abbrevs = &it->second;
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// Get a null-terminated string at "offset" in a section, or nullptr
+static const char* get_section_string(const elf_section_int* section, uint64_t offset)
+{
+	if (!section || !section->is_loaded || offset >= section->sh_size)
+		return nullptr;
+	const char* start = (const char*)section->chunk.data + offset;
+	if (!memchr(start, 0, section->sh_size - offset))
+		return nullptr;
+	return start;
+}
+
+// ----------------------------------------------------------------------------
+// Read the data of one attribute. Variable-length data that isn't needed
+// (e.g. blocks) is skipped.
+static int read_attr(attr_value& value, uint16_t form, int64_t implicit_const,
+	dwarf_context& ctx, const dwarf_unit& unit, element_reader& eread)
+{
+	value.form = form;
+	value.val = 0;
+	value.str = nullptr;
+	switch (form)
+	{
+		case DW_FORM_string:
+		{
+			value.str = (const char*)eread.get_data();
+			// Check the string is terminated within the section
+			do {} while (eread.readU8() != 0 && !eread.errored());
+			break;
+		}
+		case DW_FORM_strp:
+			value.val = eread.readU32or64(unit.is64bit);
+			value.str = get_section_string(ctx.str, value.val);
+			break;
+		case DW_FORM_line_strp:
+			value.val = eread.readU32or64(unit.is64bit);
+			value.str = get_section_string(ctx.line_str, value.val);
+			break;
+		case DW_FORM_block1:	eread.skip(eread.readU8()); break;
+		case DW_FORM_block2:	eread.skip(eread.readU16()); break;
+		case DW_FORM_block4:	eread.skip(eread.readU32()); break;
+		case DW_FORM_block:
+		case DW_FORM_exprloc:	eread.skip(eread.readULEB128()); break;
+		case DW_FORM_sdata:		value.val = (uint64_t)eread.readSLEB128(); break;
+		case DW_FORM_udata:
+		case DW_FORM_ref_udata:
+		case DW_FORM_strx:
+		case DW_FORM_addrx:
+		case DW_FORM_loclistx:
+		case DW_FORM_rnglistx:	value.val = eread.readULEB128(); break;
+		case DW_FORM_implicit_const: value.val = (uint64_t)implicit_const; break;
+		case DW_FORM_flag_present:	value.val = 1; break;
+		case DW_FORM_indirect:
+		{
+			uint16_t actual_form = eread.readULEB128();
+			if (actual_form == DW_FORM_indirect)
+				return elf_error::ERROR_DWARF_UNKNOWN_CONTENT_FORM;
+			return read_attr(value, actual_form, implicit_const, ctx, unit, eread);
+		}
+		default:
+		{
+			int size = form_fixed_size(form, unit.version, unit.address_size, unit.is64bit);
+			switch (size)
+			{
+				case 0:		break;
+				case 1:		value.val = eread.readU8(); break;
+				case 2:		value.val = eread.readU16(); break;
+				case 3:		value.val = read_u24(eread, ctx.elf_data.ident.ei_data); break;
+				case 4:		value.val = eread.readU32(); break;
+				case 8:		value.val = eread.readU64(); break;
+				case 16:	eread.skip(16); break;
+				default:	return elf_error::ERROR_DWARF_UNKNOWN_CONTENT_FORM;
+			}
+			break;
+		}
+	}
+	if (eread.errored())
+		return elf_error::ERROR_DWARF_DEBUGINFO_PARSE;
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// Convert a reference attribute to an offset in .debug_info
+static uint64_t ref_to_offset(const attr_value& value, const dwarf_unit& unit)
+{
+	if (value.form == DW_FORM_ref_addr)
+		return value.val;
+	return unit.offset + value.val;
+}
+
+// ----------------------------------------------------------------------------
+static bool is_constant_form(uint16_t form)
+{
+	return form == DW_FORM_data1 || form == DW_FORM_data2 || form == DW_FORM_data4 ||
+		form == DW_FORM_data8 || form == DW_FORM_udata || form == DW_FORM_sdata ||
+		form == DW_FORM_implicit_const;
+}
+
+// ----------------------------------------------------------------------------
+// The attributes of a DIE that we use
+struct die_info
+{
+	uint64_t offset;
+	const abbrev* ab;
+	const char* name;
+	const char* linkage_name;
+	uint64_t low_pc;
+	uint64_t high_pc;
+	bool has_low_pc;
+	bool has_high_pc;
+	bool high_pc_is_offset;		// high_pc is a length rather than an address
+	uint64_t stmt_list;
+	bool has_stmt_list;
+	uint64_t origin;			// DW_AT_specification or DW_AT_abstract_origin
+	bool has_origin;
+	uint64_t sibling;			// offset in .debug_info of the next sibling DIE
+	bool has_sibling;
+	attr_value ranges;			// DW_AT_ranges
+	bool has_ranges;
+	uint64_t str_offsets_base;	// the unit's, unless this DIE sets it
+	uint64_t addr_base;
+	uint64_t rnglists_base;
+	uint32_t call_file;			// for inlined functions
+	uint32_t call_line;
+	uint32_t call_column;
+};
+
+// ----------------------------------------------------------------------------
+// Get the string of a string attribute, looking up DW_FORM_strx* forms in
+// .debug_str_offsets. Returns nullptr if it can't be found.
+static const char* get_attr_string(dwarf_context& ctx, const attr_value& value,
+	uint64_t str_offsets_base, bool is64bit)
+{
+	if (!is_strx_form(value.form))
+		return value.str;
+	uint8_t size = is64bit ? 8 : 4;
+	uint64_t offset;
+	if (read_section_value(ctx.elf_data, ctx.str_offsets, str_offsets_base + value.val * size, size, offset))
+		return nullptr;
+	return get_section_string(ctx.str, offset);
+}
+
+// ----------------------------------------------------------------------------
+// Get the value of an address attribute, looking up DW_FORM_addrx* forms in
+// .debug_addr. Returns false if it can't be found.
+static bool get_attr_address(dwarf_context& ctx, const attr_value& value,
+	uint64_t addr_base, uint8_t address_size, uint64_t& address)
+{
+	if (!is_addrx_form(value.form))
+	{
+		address = value.val;
+		return true;
+	}
+	return read_section_value(ctx.elf_data, ctx.addr, addr_base + value.val * address_size,
+		address_size, address) == 0;
+}
+
+// ----------------------------------------------------------------------------
+// Read the DIE at the current position (after its code) and its attributes.
+static int read_die(die_info& die, const abbrev& ab, dwarf_context& ctx,
+	const dwarf_unit& unit, element_reader& eread)
+{
+	die.ab = &ab;
+	die.name = nullptr;
+	die.linkage_name = nullptr;
+	die.has_low_pc = die.has_high_pc = die.high_pc_is_offset = false;
+	die.has_stmt_list = die.has_origin = die.has_sibling = false;
+	die.has_ranges = false;
+	die.str_offsets_base = unit.str_offsets_base;
+	die.addr_base = unit.addr_base;
+	die.rnglists_base = unit.rnglists_base;
+	die.call_file = die.call_line = die.call_column = 0;
+
+	// Indexed forms are resolved after all the attributes are read, since
+	// the bases they need can come later in the same DIE
+	attr_value name = {}, linkage_name = {}, low_pc = {}, high_pc = {};
+	const abbrev_attr* attrs = &unit.abbrevs->attrs[ab.first_attr];
+	for (uint32_t i = 0; i < ab.num_attrs; ++i)
+	{
+		const abbrev_attr& attr = attrs[i];
+		attr_value value;
+		int ret = read_attr(value, attr.form, attr.implicit_const, ctx, unit, eread);
+		CHECK_RET(ret);
+		switch (attr.name)
+		{
+			case DW_AT_name:			name = value; break;
+			case DW_AT_linkage_name:
+			case DW_AT_MIPS_linkage_name:
+										linkage_name = value; break;
+			case DW_AT_low_pc:			low_pc = value; die.has_low_pc = true; break;
+			case DW_AT_high_pc:			high_pc = value; die.has_high_pc = true; break;
+			case DW_AT_str_offsets_base: die.str_offsets_base = value.val; break;
+			case DW_AT_addr_base:		die.addr_base = value.val; break;
+			case DW_AT_rnglists_base:	die.rnglists_base = value.val; break;
+			case DW_AT_ranges:			die.ranges = value; die.has_ranges = true; break;
+			case DW_AT_stmt_list:		die.stmt_list = value.val; die.has_stmt_list = true; break;
+			case DW_AT_call_file:		die.call_file = value.val; break;
+			case DW_AT_call_line:		die.call_line = value.val; break;
+			case DW_AT_call_column:		die.call_column = value.val; break;
+			case DW_AT_specification:
+			case DW_AT_abstract_origin:
+				die.origin = ref_to_offset(value, unit);
+				die.has_origin = true;
+				break;
+			case DW_AT_sibling:
+				die.sibling = ref_to_offset(value, unit);
+				die.has_sibling = true;
+				break;
+			default:
+				break;
+		}
+	}
+
+	if (name.form)
+		die.name = get_attr_string(ctx, name, die.str_offsets_base, unit.is64bit);
+	if (linkage_name.form)
+		die.linkage_name = get_attr_string(ctx, linkage_name, die.str_offsets_base, unit.is64bit);
+	if (die.has_low_pc)
+		die.has_low_pc = get_attr_address(ctx, low_pc, die.addr_base, unit.address_size, die.low_pc);
+	if (die.has_high_pc)
+	{
+		die.high_pc_is_offset = is_constant_form(high_pc.form);
+		die.has_high_pc = get_attr_address(ctx, high_pc, die.addr_base, unit.address_size, die.high_pc);
+	}
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// Skip the attributes of a DIE, using the precomputed size where possible.
+static int skip_die(const abbrev& ab, dwarf_context& ctx, const dwarf_unit& unit, element_reader& eread)
+{
+	if (ab.fixed_size >= 0)
+		return eread.skip(ab.fixed_size) ? elf_error::ERROR_DWARF_DEBUGINFO_PARSE : elf_error::OK;
+
+	const abbrev_attr* attrs = &unit.abbrevs->attrs[ab.first_attr];
+	for (uint32_t i = 0; i < ab.num_attrs; ++i)
+	{
+		attr_value value;
+		int ret = read_attr(value, attrs[i].form, attrs[i].implicit_const, ctx, unit, eread);
+		CHECK_RET(ret);
+	}
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// Find the unit containing an offset in .debug_info, or nullptr
+static const dwarf_unit* find_unit(const dwarf_context& ctx, uint64_t offset)
+{
+	std::vector<dwarf_unit>::const_iterator it = std::upper_bound(ctx.units.begin(), ctx.units.end(), offset,
+		[](uint64_t off, const dwarf_unit& u) { return off < u.offset; });
+	if (it == ctx.units.begin())
+		return nullptr;
+	--it;
+	return offset < it->end ? &*it : nullptr;
+}
+
+// ----------------------------------------------------------------------------
+// Find the name of a DIE which only refers to another DIE for it, e.g. the
+// out-of-line instance of a C++ method or inlined function. The other DIE
+// may be in a different unit.
+static const char* resolve_die_name(dwarf_context& ctx, uint64_t offset)
+{
+	// Limit the chain length in case of loops
+	for (int depth = 0; depth < 8; ++depth)
+	{
+		const dwarf_unit* unit = find_unit(ctx, offset);
+		if (!unit)
+			return nullptr;
+		element_reader eread = ctx.elf_data.create_reader(ctx.info->section_id);
+		eread.set(offset);
+		uint64_t code = eread.readULEB128();
+		const std::vector<abbrev>& codes = unit->abbrevs->codes;
+		if (code == 0 || code >= codes.size() || codes[code].tag == 0)
+			return nullptr;
+		die_info die;
+		if (read_die(die, codes[code], ctx, *unit, eread) != elf_error::OK)
+			return nullptr;
+		if (die.linkage_name)
+			return die.linkage_name;
+		if (die.name)
+			return die.name;
+		if (!die.has_origin)
+			return nullptr;
+		offset = die.origin;
+	}
+	return nullptr;
+}
+
+// ----------------------------------------------------------------------------
+// Returns true for DIEs whose children should be searched for functions.
+// Everything else (types, variables, and the insides of functions) is skipped.
+static bool is_scope_tag(uint32_t tag)
+{
+	return tag == DW_TAG_compile_unit || tag == DW_TAG_partial_unit || tag == DW_TAG_skeleton_unit ||
+		tag == DW_TAG_namespace || tag == DW_TAG_module;
+}
+
+// ----------------------------------------------------------------------------
+// Returns true for DIEs within functions whose children should be searched
+// for inlined functions.
+static bool is_code_tag(uint32_t tag)
+{
+	return tag == DW_TAG_subprogram || tag == DW_TAG_inlined_subroutine || tag == DW_TAG_lexical_block;
+}
+
+// ----------------------------------------------------------------------------
+// Read the fields of the unit header at the reader position. The abbreviation
+// table isn't loaded.
+static int read_unit_header_fields(dwarf_unit& unit, uint64_t& debug_abbrev_offset, element_reader& eread)
+{
+	unit.offset = eread.get_pos();
+	uint64_t unit_length = eread.read_ptrsize(unit.is64bit);
+	unit.end = eread.get_pos() + unit_length;
+	unit.version = eread.readU16();
+	unit.unit_type = DW_UT_compile;
+	unit.abbrevs = nullptr;
+	unit.str_offsets_base = default_table_base(unit.is64bit);
+	unit.addr_base = default_table_base(unit.is64bit);
+	unit.rnglists_base = default_table_base(unit.is64bit) + 4;	// the header has an offset count
+	unit.base_address = 0;
+	debug_abbrev_offset = 0;
+
+	if (unit.version < 2)
+		return elf_error::ERROR_DWARF_DEBUGINFO_PARSE;
+	else if (unit.version <= 4)
+	{
+		debug_abbrev_offset = eread.readU32or64(unit.is64bit);
+		unit.address_size = eread.readU8();
+	}
+	else if (unit.version == 5)
+	{
+		unit.unit_type = eread.readU8();
+		// The following two are tranposed in v5 onwards!
+		unit.address_size = eread.readU8();
+		debug_abbrev_offset = eread.readU32or64(unit.is64bit);
+		// Skip the extra header fields of some unit types
+		if (unit.unit_type == DW_UT_skeleton || unit.unit_type == DW_UT_split_compile)
+			eread.skip(8);								// dwo_id
+		else if (unit.unit_type == DW_UT_type || unit.unit_type == DW_UT_split_type)
+			eread.skip(8 + (unit.is64bit ? 8 : 4));		// type_signature, type_offset
+	}
+	else
+	{
+		return elf_error::ERROR_DWARF_VERSION_TOO_NEW;
+	}
+	return eread.errored() ? elf_error::ERROR_DWARF_DEBUGINFO_PARSE : elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// Read the unit header at the reader position.
+static int read_unit_header(dwarf_context& ctx, dwarf_unit& unit, element_reader& eread)
+{
+	uint64_t debug_abbrev_offset;
+	int ret = read_unit_header_fields(unit, debug_abbrev_offset, eread);
+	CHECK_RET(ret);
+	if (unit.end > ctx.info->sh_size)
+		return elf_error::ERROR_DWARF_DEBUGINFO_PARSE;
+	return get_abbrev_table(ctx, debug_abbrev_offset, unit);
+}
+
+// ----------------------------------------------------------------------------
+// Get the end address of a DIE with both DW_AT_low_pc and DW_AT_high_pc
+static uint64_t get_high_pc(const die_info& die)
+{
+	return die.high_pc_is_offset ? die.low_pc + die.high_pc : die.high_pc;
+}
+
+// ----------------------------------------------------------------------------
+typedef std::vector<std::pair<uint64_t, uint64_t> > address_ranges;
+
+// ----------------------------------------------------------------------------
+// Read a DWARF 4 range list from .debug_ranges
+static int read_range_list(dwarf_context& ctx, const dwarf_unit& unit, uint64_t offset,
+	address_ranges& ranges)
+{
+	if (!ctx.ranges)
+		return elf_error::ERROR_DWARF_DEBUGINFO_PARSE;
+	element_reader eread = ctx.elf_data.create_reader(ctx.ranges->section_id);
+	if (eread.set(offset))
+		return elf_error::ERROR_DWARF_DEBUGINFO_PARSE;
+
+	// 2.17.3 Non-Contiguous Address Ranges
+	uint64_t max_address = unit.address_size == 8 ? ~0ULL : (1ULL << (unit.address_size * 8)) - 1;
+	uint64_t base = unit.base_address;
+	while (1)
+	{
+		uint64_t start = read_sized(eread, unit.address_size);
+		uint64_t end = read_sized(eread, unit.address_size);
+		if (eread.errored())
+			return elf_error::ERROR_DWARF_DEBUGINFO_PARSE;
+		if (start == 0 && end == 0)
+			break;
+		if (start == max_address)
+			base = end;						// base address selection entry
+		else
+			ranges.push_back(std::make_pair(base + start, base + end));
+	}
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// Read an entry of .debug_addr. Returns 0 for success, 1 for failure.
+static int read_indexed_address(dwarf_context& ctx, const dwarf_unit& unit, uint64_t index, uint64_t& address)
+{
+	return read_section_value(ctx.elf_data, ctx.addr, unit.addr_base + index * unit.address_size,
+		unit.address_size, address);
+}
+
+// ----------------------------------------------------------------------------
+// Read a DWARF 5 range list from .debug_rnglists
+static int read_rnglist(dwarf_context& ctx, const dwarf_unit& unit, uint64_t offset,
+	address_ranges& ranges)
+{
+	if (!ctx.rnglists)
+		return elf_error::ERROR_DWARF_DEBUGINFO_PARSE;
+	element_reader eread = ctx.elf_data.create_reader(ctx.rnglists->section_id);
+	if (eread.set(offset))
+		return elf_error::ERROR_DWARF_DEBUGINFO_PARSE;
+
+	// 2.17.3 Non-Contiguous Address Ranges
+	uint64_t base = unit.base_address;
+	int errors = 0;
+	while (1)
+	{
+		uint8_t kind = eread.readU8();
+		if (kind == DW_RLE_end_of_list)
+			break;
+		uint64_t start = 0, end = 0;
+		switch (kind)
+		{
+			case DW_RLE_base_addressx:
+				errors |= read_indexed_address(ctx, unit, eread.readULEB128(), base);
+				continue;
+			case DW_RLE_base_address:
+				base = read_sized(eread, unit.address_size);
+				continue;
+			case DW_RLE_startx_endx:
+				errors |= read_indexed_address(ctx, unit, eread.readULEB128(), start);
+				errors |= read_indexed_address(ctx, unit, eread.readULEB128(), end);
+				break;
+			case DW_RLE_startx_length:
+				errors |= read_indexed_address(ctx, unit, eread.readULEB128(), start);
+				end = start + eread.readULEB128();
+				break;
+			case DW_RLE_offset_pair:
+				start = base + eread.readULEB128();
+				end = base + eread.readULEB128();
+				break;
+			case DW_RLE_start_end:
+				start = read_sized(eread, unit.address_size);
+				end = read_sized(eread, unit.address_size);
+				break;
+			case DW_RLE_start_length:
+				start = read_sized(eread, unit.address_size);
+				end = start + eread.readULEB128();
+				break;
+			default:
+				return elf_error::ERROR_DWARF_DEBUGINFO_PARSE;
+		}
+		if (eread.errored() || errors)
+			return elf_error::ERROR_DWARF_DEBUGINFO_PARSE;
+		ranges.push_back(std::make_pair(start, end));
+	}
+	return eread.errored() ? elf_error::ERROR_DWARF_DEBUGINFO_PARSE : elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// Get the address ranges of a DIE, from either its low and high pc or DW_AT_ranges.
+// Empty ranges are dropped.
+static int get_die_ranges(dwarf_context& ctx, const dwarf_unit& unit, const die_info& die,
+	address_ranges& ranges)
+{
+	ranges.clear();
+	if (die.has_ranges)
+	{
+		int ret;
+		if (unit.version < 5)
+			ret = read_range_list(ctx, unit, die.ranges.val, ranges);
+		else if (die.ranges.form == DW_FORM_rnglistx)
+		{
+			// The index is of an offset, relative to the base, in the table at the base
+			uint8_t size = unit.is64bit ? 8 : 4;
+			uint64_t offset;
+			if (read_section_value(ctx.elf_data, ctx.rnglists, die.rnglists_base + die.ranges.val * size,
+					size, offset))
+				return elf_error::ERROR_DWARF_DEBUGINFO_PARSE;
+			ret = read_rnglist(ctx, unit, die.rnglists_base + offset, ranges);
+		}
+		else
+			ret = read_rnglist(ctx, unit, die.ranges.val, ranges);
+		CHECK_RET(ret);
+	}
+	else if (die.has_low_pc && die.has_high_pc)
+		ranges.push_back(std::make_pair(die.low_pc, get_high_pc(die)));
+
+	ranges.erase(std::remove_if(ranges.begin(), ranges.end(),
+		[](const std::pair<uint64_t, uint64_t>& r) { return r.second <= r.first; }), ranges.end());
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// An inlined function enclosing the DIE being read
+struct open_inline
+{
+	int depth;
+	uint32_t first_range;		// index in output.inline_ranges
+	uint32_t num_ranges;
+};
+
+// ----------------------------------------------------------------------------
+// Add an inlined function to the output. "parent" is the inlined function
+// it is inside, if any.
+static void add_inline(elf_results& output, dwarf_context& ctx, const dwarf_unit& unit,
+	const die_info& die, const address_ranges& ranges, const open_inline* parent)
+{
+	elf_inline inl;
+	const char* name = die.linkage_name ? die.linkage_name : die.name;
+	if (name)
+		inl.name = name;
+	else if (die.has_origin)
+		ctx.unnamed_inlines.push_back(std::make_pair(output.inlines.size(), die.origin));
+	inl.unit_offset = unit.offset;
+	inl.line_unit = ~0U;
+	inl.call_file = die.call_file;
+	inl.call_line = die.call_line;
+	inl.call_column = die.call_column;
+
+	for (const std::pair<uint64_t, uint64_t>& r : ranges)
+	{
+		elf_inline_range range;
+		range.start = r.first;
+		range.end = r.second;
+		range.inline_index = output.inlines.size();
+		range.parent = -1;
+		if (parent)
+		{
+			// Find the range of the parent this one starts in
+			for (uint32_t i = parent->first_range; i < parent->first_range + parent->num_ranges; ++i)
+			{
+				const elf_inline_range& p = output.inline_ranges[i];
+				if (r.first >= p.start && r.first < p.end)
+				{
+					range.parent = i;
+					break;
+				}
+			}
+		}
+		output.inline_ranges.push_back(range);
+	}
+	output.inlines.push_back(inl);
+}
+
+// ----------------------------------------------------------------------------
+// Walk the DIEs of one unit, adding functions and inlined functions to the output.
+static int walk_unit(elf_results& output, dwarf_context& ctx, dwarf_unit& unit, element_reader& eread)
+{
+	const std::vector<abbrev>& codes = unit.abbrevs->codes;
+	int depth = 0;
+	int skip_depth = -1;		// when >= 0, the depth whose children are being skipped
+	address_ranges ranges;
+	std::vector<open_inline> inlines;
+	int ret;
+
+	while (eread.get_pos() < unit.end)
+	{
+		uint64_t die_offset = eread.get_pos();
+		uint64_t code = eread.readULEB128();
+		if (code == 0)
+		{
+			// End of a list of children
+			--depth;
+			if (depth == skip_depth)
+				skip_depth = -1;
+			if (depth <= 0)
+				break;
+			continue;
+		}
+		if (code >= codes.size() || codes[code].tag == 0)
+			return elf_error::ERROR_DWARF_UNKNOWN_ABBREV;
+		const abbrev& ab = codes[code];
+
+		bool wanted = skip_depth < 0 && (is_code_tag(ab.tag) || is_scope_tag(ab.tag));
+		if (!wanted)
+		{
+			// Jump straight past the children if we know where they end
+			if (ab.has_children && ab.sibling_pos >= 0)
+			{
+				element_reader sib_read = eread;
+				sib_read.skip(ab.sibling_pos);
+				attr_value value;
+				ret = read_attr(value, ab.sibling_form, 0, ctx, unit, sib_read);
+				CHECK_RET(ret);
+				uint64_t sibling = ref_to_offset(value, unit);
+				if (sibling > die_offset && sibling <= unit.end)
+				{
+					eread.set(sibling);
+					continue;
+				}
+			}
+			ret = skip_die(ab, ctx, unit, eread);
+			CHECK_RET(ret);
+			if (ab.has_children)
+			{
+				if (skip_depth < 0)
+					skip_depth = depth;
+				++depth;
+			}
+			continue;
+		}
+
+		die_info die;
+		die.offset = die_offset;
+		ret = read_die(die, ab, ctx, unit, eread);
+		CHECK_RET(ret);
+		if (depth == 0)
+		{
+			// The root DIE sets the bases for the rest of the unit
+			unit.str_offsets_base = die.str_offsets_base;
+			unit.addr_base = die.addr_base;
+			unit.rnglists_base = die.rnglists_base;
+			unit.base_address = die.has_low_pc ? die.low_pc : 0;
+			if (die.has_stmt_list)
+			{
+				ctx.links.str_bases[die.stmt_list] = die.str_offsets_base;
+				ctx.links.stmt_lists[unit.offset] = die.stmt_list;
+			}
+		}
+
+		// Leave any inlined functions this DIE is not inside
+		while (inlines.size() && inlines.back().depth >= depth)
+			inlines.pop_back();
+
+		// A bad range list only loses the ranges of this DIE
+		if (ab.tag == DW_TAG_subprogram &&
+			get_die_ranges(ctx, unit, die, ranges) == elf_error::OK && ranges.size())
+		{
+			elf_function func;
+			const char* name = die.linkage_name ? die.linkage_name : die.name;
+			if (name)
+				func.name = name;
+			else if (die.has_origin)
+				ctx.unnamed_functions.push_back(std::make_pair(output.functions.size(), die.origin));
+			func.low_pc = ranges[0].first;
+			func.high_pc = ranges[0].second;
+			for (const std::pair<uint64_t, uint64_t>& r : ranges)
+			{
+				func.low_pc = std::min(func.low_pc, r.first);
+				func.high_pc = std::max(func.high_pc, r.second);
+				output.function_ranges.add(r.first, r.second, output.functions.size());
+			}
+			func.unit_offset = unit.offset;
+			output.functions.push_back(func);
+			inlines.clear();
+		}
+		else if (ab.tag == DW_TAG_inlined_subroutine &&
+			get_die_ranges(ctx, unit, die, ranges) == elf_error::OK && ranges.size())
+		{
+			open_inline inl;
+			inl.depth = depth;
+			inl.first_range = output.inline_ranges.size();
+			inl.num_ranges = ranges.size();
+			add_inline(output, ctx, unit, die, ranges, inlines.size() ? &inlines.back() : nullptr);
+			inlines.push_back(inl);
+		}
+		else if (depth == 0 && get_die_ranges(ctx, unit, die, ranges) == elf_error::OK)
+		{
+			// The root DIE covers the whole unit
+			for (const std::pair<uint64_t, uint64_t>& r : ranges)
+				ctx.unit_ranges.add(r.first, r.second, unit.offset);
+		}
+
+		if (ab.has_children)
+		{
+			if (is_scope_tag(ab.tag) || is_code_tag(ab.tag))
+				++depth;
+			else if (die.has_sibling && die.sibling > die_offset && die.sibling <= unit.end)
+				eread.set(die.sibling);
+			else
+			{
+				skip_depth = depth;
+				++depth;
+			}
+		}
+	}
+	return eread.errored() ? elf_error::ERROR_DWARF_DEBUGINFO_PARSE : elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// Sort the inline ranges by start address, with enclosing ranges first, and
+// update the parent indices to match.
+static void sort_inline_ranges(std::vector<elf_inline_range>& ranges)
+{
+	std::vector<uint32_t> order(ranges.size());
+	for (size_t i = 0; i < order.size(); ++i)
+		order[i] = i;
+	// Ranges are added before those inside them, so a stable sort keeps
+	// parents first when ranges are identical
+	std::stable_sort(order.begin(), order.end(), [&ranges](uint32_t a, uint32_t b) {
+		if (ranges[a].start != ranges[b].start)
+			return ranges[a].start < ranges[b].start;
+		return ranges[a].end > ranges[b].end;
+	});
+	std::vector<int32_t> new_index(order.size());
+	std::vector<elf_inline_range> sorted;
+	sorted.reserve(order.size());
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		new_index[order[i]] = i;
+		sorted.push_back(ranges[order[i]]);
+	}
+	for (elf_inline_range& r : sorted)
+		if (r.parent >= 0)
+			r.parent = new_index[r.parent];
+	ranges.swap(sorted);
+}
+
+// ----------------------------------------------------------------------------
+// "links" receives the line program and DW_AT_str_offsets_base of each unit.
+static int parse_section_debug_info(elf_results& output, elf& elf, elf_section_int& section,
+	line_program_links& links, parse_progress& progress)
+{
+	dwarf_context ctx(elf);
+	ctx.info = &section;
+	ctx.abbrev = load_named_section(elf, ".debug_abbrev");
+	ctx.str = load_named_section(elf, ".debug_str");
+	ctx.line_str = load_named_section(elf, ".debug_line_str");
+	ctx.str_offsets = load_named_section(elf, ".debug_str_offsets");
+	ctx.addr = load_named_section(elf, ".debug_addr");
+	ctx.ranges = load_named_section(elf, ".debug_ranges");
+	ctx.rnglists = load_named_section(elf, ".debug_rnglists");
+	if (!ctx.abbrev)
+		return elf_error::OK;		// nothing can be decoded
+
+	element_reader eread = elf.create_reader(section.section_id);
+	while (eread.get_pos() < section.sh_size)
+	{
+		dwarf_unit unit;
+		int ret = read_unit_header(ctx, unit, eread);
+		CHECK_RET(ret);
+		if (progress.units.empty() || progress.units.count(unit.offset))
+		{
+			ctx.units.push_back(unit);
+			ret = walk_unit(output, ctx, ctx.units.back(), eread);
+			CHECK_RET(ret);
+		}
+		eread.set(unit.end);
+		ret = progress.advance(unit.end - unit.offset);
+		CHECK_RET(ret);
+	}
+
+	for (const std::pair<size_t, uint64_t>& unnamed : ctx.unnamed_functions)
+	{
+		const char* name = resolve_die_name(ctx, unnamed.second);
+		if (name)
+			output.functions[unnamed.first].name = name;
+	}
+
+	// Many instances are usually inlined from the same function
+	std::unordered_map<uint64_t, const char*> inline_names;
+	for (const std::pair<size_t, uint64_t>& unnamed : ctx.unnamed_inlines)
+	{
+		std::unordered_map<uint64_t, const char*>::iterator it = inline_names.find(unnamed.second);
+		if (it == inline_names.end())
+			it = inline_names.insert(std::make_pair(unnamed.second, resolve_die_name(ctx, unnamed.second))).first;
+		if (it->second)
+			output.inlines[unnamed.first].name = it->second;
+	}
+	sort_inline_ranges(output.inline_ranges);
+
+	links.str_bases.swap(ctx.links.str_bases);
+	links.stmt_lists.swap(ctx.links.stmt_lists);
+
+	// Fall back to the unit ranges here if there was no .debug_aranges
+	if (output.unit_ranges.ranges.empty())
+	{
+		output.unit_ranges = ctx.unit_ranges;
+		output.unit_ranges.build();
+	}
+
+	// Sort the functions, then update the indices in the ranges to match
+	std::vector<uint64_t> order(output.functions.size());
+	for (size_t i = 0; i < order.size(); ++i)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(),
+		[&output](uint64_t a, uint64_t b) { return output.functions[a].low_pc < output.functions[b].low_pc; });
+	std::vector<uint64_t> new_index(order.size());
+	std::vector<elf_function> sorted;
+	sorted.reserve(order.size());
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		new_index[order[i]] = i;
+		sorted.push_back(std::move(output.functions[order[i]]));
+	}
+	output.functions.swap(sorted);
+	for (elf_address_range& r : output.function_ranges.ranges)
+		r.value = new_index[r.value];
+	output.function_ranges.build();
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+//	ADDRESS RANGES
+void elf_range_map::add(uint64_t start, uint64_t end, uint64_t value)
+{
+	elf_address_range r;
+	r.start = start;
+	r.end = end;
+	r.value = value;
+	ranges.push_back(r);
+}
+
+// ----------------------------------------------------------------------------
+void elf_range_map::build()
+{
+	std::stable_sort(ranges.begin(), ranges.end(),
+		[](const elf_address_range& a, const elf_address_range& b) { return a.start < b.start; });
+
+	size_t count = 0;
+	for (size_t i = 0; i < ranges.size(); ++i)
+	{
+		// A copy, since a split below can move the ranges
+		const elf_address_range r = ranges[i];
+		if (r.end <= r.start)
+			continue;
+		if (count)
+		{
+			elf_address_range& prev = ranges[count - 1];
+			if (prev.value == r.value && r.start <= prev.end)
+			{
+				prev.end = std::max(prev.end, r.end);
+				continue;
+			}
+			// Overlap with a different value: the later range only takes
+			// the overlap, so put back any part of the earlier range after
+			// it with the ranges still to be read, ahead of those starting
+			// at the same address
+			if (r.start < prev.end)
+			{
+				elf_address_range tail = { r.end, prev.end, prev.value };
+				prev.end = r.start;
+				if (prev.end == prev.start)
+					--count;
+				if (tail.end > tail.start)
+				{
+					ranges.insert(std::lower_bound(ranges.begin() + i + 1, ranges.end(), tail,
+						[](const elf_address_range& a, const elf_address_range& b) { return a.start < b.start; }),
+						tail);
+				}
+			}
+		}
+		ranges[count++] = r;
+	}
+	ranges.resize(count);
+}
+
+// ----------------------------------------------------------------------------
+const elf_address_range* elf_range_map::find(uint64_t address) const
+{
+	std::vector<elf_address_range>::const_iterator it = std::upper_bound(ranges.begin(), ranges.end(), address,
+		[](uint64_t addr, const elf_address_range& r) { return addr < r.start; });
+	if (it == ranges.begin())
+		return nullptr;
+	--it;
+	return address < it->end ? &*it : nullptr;
+}
+
+// ----------------------------------------------------------------------------
+// Parse all the address range sets in .debug_aranges into "ranges".
+static int parse_aranges(element_reader& eread, uint64_t size, elf_range_map& ranges)
+{
+	while (eread.get_pos() < size)
+	{
+		// 6.1.2 Lookup by Address
+		uint64_t set_start = eread.get_pos();
+		bool is64bit = false;
+		uint64_t unit_length = eread.read_ptrsize(is64bit);
+		uint64_t set_end = eread.get_pos() + unit_length;
+		uint16_t version = eread.readU16();
+		uint64_t unit_offset = eread.readU32or64(is64bit);
+		uint8_t address_size = eread.readU8();
+		uint8_t segment_selector_size = eread.readU8();
+		if (eread.errored() || set_end > size || version != 2)
+			return elf_error::ERROR_DWARF_DEBUGARANGES_PARSE;
+		if (address_size != 2 && address_size != 4 && address_size != 8)
+			return elf_error::ERROR_DWARF_DEBUGARANGES_PARSE;
+
+		// The tuples are aligned to their own size from the start of the set
+		uint64_t tuple_size = segment_selector_size + 2 * address_size;
+		uint64_t pos = eread.get_pos() - set_start;
+		eread.skip((tuple_size - pos % tuple_size) % tuple_size);
+
+		while (eread.get_pos() + tuple_size <= set_end)
+		{
+			eread.skip(segment_selector_size);
+			uint64_t start = read_sized(eread, address_size);
+			uint64_t length = read_sized(eread, address_size);
+			if (start == 0 && length == 0)
+				break;
+			ranges.add(start, start + length, unit_offset);
+		}
+		if (eread.errored())
+			return elf_error::ERROR_DWARF_DEBUGARANGES_PARSE;
+		eread.set(set_end);
+	}
+
+	ranges.build();
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// Parse the line number program of a single compilation unit, starting at the
+// current position of "eread". Afterwards eread is positioned at the next unit.
+// "str_offsets_base" is the DW_AT_str_offsets_base of the owning unit.
+static int parse_line_unit(compilation_unit& compilation_unit,
+	elf& elf, element_reader& eread, uint64_t str_offsets_base)
+{
+	int ret;
+	// 6.2.4 The Line Number Program Header
+	bool is64bit = false;
+	uint64_t unit_length = eread.read_ptrsize(is64bit);
+
+	uint64_t unit_start_pos = eread.get_pos();	// the start of unit doesn't include unit_length
+	uint16_t line_number_version = eread.readU16();	// this is the line number version
+	uint8_t address_size = 0;
+	uint8_t segment_selector_size = 0;
+	if (line_number_version >= 5)
+		address_size = eread.readU8();
+	if (line_number_version >= 5)
+		segment_selector_size = eread.readU8();
+	(void)address_size;
+	(void)segment_selector_size;
+
+	// This varies with 32/64 bit formats
+	uint64_t header_length = eread.readU32or64(is64bit);
+	uint8_t minimum_instruction_length = eread.readU8();
+	uint8_t maximum_operations_per_instruction = 0;
+	if (line_number_version >= 4)
+		maximum_operations_per_instruction = eread.readU8();
+	uint8_t default_is_stmt = eread.readU8();
+	int8_t line_base = (int8_t)eread.readU8();
+	uint8_t line_range = eread.readU8();
+	uint8_t opcode_base = eread.readU8();
+	// Suppress unused warnings
+	(void) header_length;
+	(void) maximum_operations_per_instruction;
+
+	// Now read a series of opcode lengths
+	for (uint8_t i = 1; i < opcode_base; ++i)
+	{
+		uint8_t length = eread.readU8();
+		PRINTF(("\topcode %u has %u args\n", i, length));
+		(void) length;
+	}
+
+	if (line_number_version >= 5)
+	{
+		// Version 5 lists the compilation directory and primary file as
+		// entry 0 of each table, so both tables are used as they are
+		uint8_t directory_entry_format_count = eread.readU8();
+
+		std::vector<content_desc> descs;
+		std::vector<content_desc> fileDescs;
+
+		for (uint8_t i = 0; i < directory_entry_format_count; ++i)
+		{
+			content_desc desc;
+			desc.type = eread.readULEB128();
+			desc.form = eread.readULEB128();
+			descs.push_back(desc);
+		}
+		uint64_t directories_count = eread.readULEB128();
+		for (uint64_t i = 0; i < directories_count; ++i)
+		{
+			content_line cl;
+			ret = read_content_line(cl, eread, elf, descs, is64bit, str_offsets_base);
+			CHECK_RET(ret)
+			compilation_unit.dirs.push_back(cl.path);
+		}
+		uint8_t file_name_entry_format_count = eread.readU8();
+		for (uint8_t i = 0; i < file_name_entry_format_count; ++i)
+		{
+			content_desc desc = {};
+			desc.type = eread.readULEB128();
+			desc.form = eread.readULEB128();
+			fileDescs.push_back(desc);
+		}
+
+		uint64_t files_count = eread.readULEB128();
+		for (uint64_t i = 0; i < files_count; ++i)
+		{
+			content_line cl;
+			ret = read_content_line(cl, eread, elf, fileDescs, is64bit, str_offsets_base);
+			CHECK_RET(ret)
+
+			// Copy out the necessary bits
+			compilation_unit::file file;
+			file.dir_index = cl.directory_index;
+			file.path = cl.path;
+			file.length = cl.size;
+			file.timestamp = cl.timestamp;
+			compilation_unit.files.push_back(file);
+		}
+	}
+	else
+	{
+		// Original, simpler directory/file name description. Index 0 means
+		// the compilation directory, which isn't listed.
+		compilation_unit.dirs.push_back(".");
+		while (1)
+		{
+			std::string dir = eread.read_null_term_string();
+			if (dir.size() == 0)
+				break;
+			compilation_unit.dirs.push_back(dir);
+		}
+
+		{
+			compilation_unit::file f;
+			f.path = "NONE";
+			f.dir_index = 0;
+			f.length = 0;
+			f.timestamp = 0;
+			compilation_unit.files.push_back(f);
+		}
+		while (1)
+		{
+			std::string file_name = eread.read_null_term_string();
+			if (file_name.size() == 0)
+				break;
+
+			compilation_unit::file f;
+			f.dir_index = eread.readULEB128();
+			f.timestamp = eread.readULEB128();
+			f.length = eread.readULEB128();
+			f.path = file_name;
+
+			compilation_unit.files.push_back(f);
+		}
+	}
+	if (eread.errored())
+		return elf_error::ERROR_READ_FILE;		
+
+	// Now the compilation units
+	line_state_machine sm;
+	reset(sm);
+	sm.is_stmt = default_is_stmt;
+
+	uint64_t unit_end_pos = unit_start_pos + unit_length;
+	while (1)
+	{
+		assert(sm.line >= 1);
+		if (eread.get_pos() > unit_end_pos)
+			return elf_error::ERROR_DWARF_DEBUGLINE_PARSE;
+		if (eread.get_pos() == unit_end_pos)
+			break;
+		if (eread.errored())
+			return elf_error::ERROR_READ_FILE;
+
+		assert(eread.get_pos() < unit_end_pos);
+		uint8_t opcode0 = eread.readU8();
+		PRINTF(("--- pos: 0x%x opcode0: %x\n", debug_pos, opcode0));
+		if (opcode0 == 0)
+		{
+			// Extended opcode
+			uint64_t length = eread.readULEB128();
+			PRINTF(("length: %x\n", length));
+			(void)length;		// should we use this for correctness checking?
+
+			uint8_t extended_opcode = eread.readU8();
+			PRINTF(("extended_opcode: %x\n", extended_opcode));
+
+			if (extended_opcode == DW_LNE_set_address)
+			{
+				uint64_t addr = eread.readAddress();
+				PRINTF(("DW_LNE_set_address addr: %x\n", addr));
+				sm.address = addr;
+			}
+			else if (extended_opcode == DW_LNE_end_sequence)
+			{
+				PRINTF(("DW_LNE_end_sequence\n"));
+				compilation_unit.sequence_ends.push_back((uint32_t)compilation_unit.points.size());
+				add_codepoint(sm, compilation_unit);
+				reset(sm);
+				sm.is_stmt = default_is_stmt;
+			}
+			else if (extended_opcode == DW_LNE_define_file)
+			{
+				PRINTF(("DW_LNE_define_file\n"));
+				compilation_unit::file f;
+				uint64_t dir_index = eread.readULEB128();
+				f.timestamp = eread.readULEB128();
+				f.length = eread.readULEB128();
+				f.path = eread.read_null_term_string();
+				f.dir_index = dir_index;
+				PRINTF(("New file: \"%s\" dir_index: %x mod_ts: %x length: %x\n",
+					f.filename, f.dir_index, f.timestamp, f.length));
+				compilation_unit.files.push_back(f);
+			}
+			else if (extended_opcode == DW_LNE_set_discriminator)
+			{
+				sm.discriminator = eread.readULEB128();
+				PRINTF(("DW_LNE_set_discriminator: %llx\n", sm.discriminator));
+			}
+			else
+			{
+				printf("unknown extended_opcode\n");
+				printf("extended_opcode: %x\n", extended_opcode);
+				return elf_error::ERROR_DWARF_UNKNOWN_EXTENDED_OPCODE;
+			}
+		}
+		else if (opcode0 == DW_LNS_advance_pc)
+		{
+			// NOTE: unsigned!
+			uint64_t adv = eread.readULEB128();
+			sm.address += adv * minimum_instruction_length;
+			PRINTF(("advance PC by %d to %x\n", adv, sm.address));
+		}
+		else if (opcode0 == DW_LNS_advance_line)
+		{
+			int64_t adv = eread.readSLEB128();
+			sm.line += adv;
+			PRINTF(("  [0x%08x]  Advance Line by %lld to %lld\n", debug_pos, adv, sm.line));
+		}
+		else if (opcode0 == DW_LNS_copy)
+		{
+			add_codepoint(sm, compilation_unit);
+		}
+		else if (opcode0 == DW_LNS_set_file)
+		{
+			uint64_t file_index = eread.readULEB128();
+			PRINTF(("Set file index to %lld\n", file_index));
+			sm.file_index = file_index;
+		}
+		else if (opcode0 == DW_LNS_set_column)
+		{
+			uint64_t column = eread.readULEB128();
+			PRINTF(("Set column to %lld\n", column));
+			sm.column = column;
+		}
+		else if (opcode0 == DW_LNS_negate_stmt)
+		{
+			PRINTF(("Negate stat\n"));
+			sm.is_stmt = !sm.is_stmt;
+		}
+		else if (opcode0 == DW_LNS_const_add_pc)
+		{
+			int32_t adjusted_opcode = (uint32_t)255 - (uint32_t)opcode_base;
+			uint64_t addr_increment = uint64_t(adjusted_opcode / line_range) * minimum_instruction_length;
+			PRINTF(("Advance PC by %lld\n", addr_increment));
+			sm.address += addr_increment;
+		}
+		else if (opcode0 >= opcode_base)
+		{
+			// 6.2.5.1 Special Opcodes
+			int32_t adjusted_opcode = (uint32_t)opcode0 - (uint32_t)opcode_base;
+			uint64_t addr_increment = uint64_t(adjusted_opcode / line_range) * minimum_instruction_length;
+
+			int32_t line_increment = line_base + (adjusted_opcode % line_range);
+			PRINTF(("Special opcode: adjusted_opcode=%d line_range=%d addr_inc=%d line_inc=%d\n",
+				adjusted_opcode,
+				line_range,
+				addr_increment, line_increment));
+			sm.address += addr_increment;
+			sm.line += line_increment;
+			add_codepoint(sm, compilation_unit);
+			sm.basic_block = false;
+			sm.prologue_end = false;
+			sm.epilogue_begin = false;
+		}
+		else
+		{
+			printf("unknown opcode\n");
+			printf("opcode0: %x\n", opcode0);
+			return elf_error::ERROR_DWARF_UNKNOWN_OPCODE;
+		}
+	}
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+static int parse_section_debug_line(elf_results& output, elf& elf, const elf_section_int& section,
+	line_program_links& links, reload_context* reload, parse_progress& progress)
+{
+	element_reader eread = elf.create_reader(section.section_id);
+	uint64_t section_end_pos = section.sh_size;
+	int ret;
+
+	// Only the line programs of the chosen units, if limited
+	std::unordered_set<uint64_t> wanted_programs;
+	if (!progress.units.empty())
+	{
+		for (const std::pair<const uint64_t, uint64_t>& stmt_list : links.stmt_lists)
+			wanted_programs.insert(stmt_list.second);
+	}
+
+	// Read all the compilation units in turn
+	while (1)
+	{
+		if (eread.get_pos() > section_end_pos)
+			return elf_error::ERROR_DWARF_DEBUGLINE_PARSE;
+
+		if (eread.get_pos() == section_end_pos)
+			break;
+
+		// Find the extent of the unit, so that it can be hashed
+		uint64_t unit_pos = eread.get_pos();
+		element_reader length_read = eread;
+		bool is64bit = false;
+		uint64_t unit_length = length_read.read_ptrsize(is64bit);
+		uint64_t unit_end_pos = length_read.get_pos() + unit_length;
+		if (unit_end_pos > section_end_pos)
+			return elf_error::ERROR_DWARF_DEBUGLINE_PARSE;
+
+		ret = progress.advance(unit_end_pos - unit_pos);
+		CHECK_RET(ret);
+		if (!progress.units.empty() && !wanted_programs.count(unit_pos))
+		{
+			eread.set(unit_end_pos);
+			continue;
+		}
+
+		uint64_t hash = hash_data(section.chunk.data + unit_pos, unit_end_pos - unit_pos);
+		output.hashes.line_units.push_back(hash);
+		links.line_units[unit_pos] = output.line_info_units.size();
+
+		// When reloading, copy any identical unit from the previous results.
+		// This is only safe if the strings the unit refers to are unchanged.
+		if (reload && reload->strings_match)
+		{
+			std::unordered_map<uint64_t, size_t>::const_iterator it = reload->prev_units.find(hash);
+			if (it != reload->prev_units.end())
+			{
+				output.line_info_units.push_back(reload->previous->line_info_units[it->second]);
+				++reload->report->units_reused;
+				eread.set(unit_end_pos);
+				continue;
+			}
+		}
+
+		std::unordered_map<uint64_t, uint64_t>::const_iterator base_it = links.str_bases.find(unit_pos);
+		uint64_t str_offsets_base = base_it != links.str_bases.end() ?
+			base_it->second : default_table_base(is64bit);
+
+		output.line_info_units.push_back(compilation_unit());
+		ret = parse_line_unit(output.line_info_units.back(), elf, eread, str_offsets_base);
+		CHECK_RET(ret);
+		if (reload)
+			reload->report->changed_units.push_back(output.line_info_units.size() - 1);
+	}
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// Templated function to read either Elf32_sym or Elf64_sym
+template <typename ELF_SYMBOL>
+	static int read_elf_symbol(elf_symbol& symbol, elf& elf_data, buffer_access& buffer)
+{
+	ELF_SYMBOL file_sym;
+	if (buffer.read(file_sym) != 0)
+		return elf_error::ERROR_READ_FILE;
+
+	uint8_t mode = elf_data.ident.ei_data;
+	symbol.st_name       = conv_endian(file_sym.st_name, mode);
+	symbol.st_value      = conv_endian(file_sym.st_value, mode);
 	symbol.st_size       = conv_endian(file_sym.st_size, mode);
 	symbol.st_info       = conv_endian(file_sym.st_info, mode);
 	symbol.st_other      = conv_endian(file_sym.st_other, mode);
@@ -833,201 +2282,1982 @@ template <typename ELF_SYMBOL>
 }
 
 // ----------------------------------------------------------------------------
-static int parse_section_symbol(elf_results& output, 
-	elf& elf, const elf_section_int& section)
+// Number of symbol table entries hashed together when reloading
+static const uint32_t SYMBOL_SLICE_COUNT = 256;
+
+// ----------------------------------------------------------------------------
+// Read one symbol table entry, with its name and section name
+static int read_symbol(elf_symbol& sym, elf& elf, buffer_access& sym_buffer, element_reader& name_read)
+{
+	int ret = elf_error::OK;
+	if (elf.ident.ei_class == ELFCLASS32)
+		ret = read_elf_symbol<Elf32_Sym>(sym, elf, sym_buffer);
+	else if (elf.ident.ei_class == ELFCLASS64)
+		ret = read_elf_symbol<Elf64_Sym>(sym, elf, sym_buffer);
+	CHECK_RET(ret);
+
+	name_read.set(sym.st_name);
+	sym.name = name_read.read_null_term_string();
+	if (sym.st_shndx < elf.e_shnum)
+	{
+		const elf_section_int& ref_section = elf.sections[sym.st_shndx];
+		sym.section_type = ref_section.name_string;
+	}
+	else if (sym.st_shndx == SHN_ABS)
+		sym.section_type = "ABS";
+	else if (sym.st_shndx == SHN_COMMON)
+		sym.section_type = "COMMON";
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+static int parse_section_symbol(elf_results& output, 
+	elf& elf, const elf_section_int& section, reload_context* reload)
+{
+	uint8_t data_class = elf.ident.ei_class;	// 32 bit or 64 bit
+	int ret = elf_error::OK;
+	// Load the necessary chunks:
+	// the symbol section...
+	ret = elf.load_section(section.section_id);
+	CHECK_RET(ret)
+
+	// ... and the strings for the symbols.
+	ret = elf.load_section(section.sh_link);
+	CHECK_RET(ret)
+
+	const elf_section_int& symbol_section = section;
+	buffer_access sym_buffer = symbol_section.chunk.buffer;
+	sym_buffer.set(0);
+
+	// Symbols can only be reused if every string they refer to is the same
+	const elf_section_int& string_section = elf.sections[section.sh_link];
+	uint64_t strings_hash = hash_data(string_section.chunk.data, string_section.sh_size);
+	size_t table_id = output.hashes.symbol_strings.size();
+	output.hashes.symbol_strings.push_back(strings_hash);
+	bool can_reuse = reload && reload->names_match &&
+		table_id < reload->previous->hashes.symbol_strings.size() &&
+		reload->previous->hashes.symbol_strings[table_id] == strings_hash;
+
+	uint64_t entry_size = (data_class == ELFCLASS32) ? sizeof(Elf32_Sym) : sizeof(Elf64_Sym);
+
+	// The linked string table is in sh_link...
+	element_reader name_read = elf.create_reader(section.sh_link);
+	while (sym_buffer.get_pos() < section.sh_size)
+	{
+		// Hash the next slice of entries
+		uint64_t slice_pos = sym_buffer.get_pos();
+		uint64_t slice_end = slice_pos + SYMBOL_SLICE_COUNT * entry_size;
+		if (slice_end > section.sh_size)
+			slice_end = section.sh_size;
+
+		elf_hash_slice slice;
+		slice.hash = hash_data(symbol_section.chunk.data + slice_pos, slice_end - slice_pos);
+		slice.first = output.symbols.size();
+		slice.count = (slice_end - slice_pos + entry_size - 1) / entry_size;
+		output.hashes.symbol_slices.push_back(slice);
+
+		if (reload)
+		{
+			const std::vector<elf_hash_slice>& prev_slices = reload->previous->hashes.symbol_slices;
+			size_t prev_id = reload->next_slice++;
+			if (can_reuse && prev_id < prev_slices.size() &&
+				prev_slices[prev_id].hash == slice.hash &&
+				prev_slices[prev_id].count == slice.count)
+			{
+				const std::vector<elf_symbol>& prev_symbols = reload->previous->symbols;
+				uint32_t first = prev_slices[prev_id].first;
+				output.symbols.insert(output.symbols.end(),
+					prev_symbols.begin() + first, prev_symbols.begin() + first + slice.count);
+				reload->report->symbols_reused += slice.count;
+				sym_buffer.set(slice_end);
+				continue;
+			}
+		}
+
+		while (sym_buffer.get_pos() < slice_end)
+		{
+			elf_symbol sym;
+			ret = read_symbol(sym, elf, sym_buffer, name_read);
+			CHECK_RET(ret);
+			output.symbols.push_back(sym);
+		}
+	}
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// Read a SHT_DYNSYM section into output.dynamic_symbols
+static int parse_dynamic_symbols(elf_results& output, elf& elf, const elf_section_int& section)
+{
+	int ret = elf.load_section(section.section_id);
+	CHECK_RET(ret)
+	ret = elf.load_section(section.sh_link);
+	CHECK_RET(ret)
+
+	uint64_t entry_size = (elf.ident.ei_class == ELFCLASS32) ? sizeof(Elf32_Sym) : sizeof(Elf64_Sym);
+	output.dynamic_symbols.reserve(section.sh_size / entry_size);
+
+	buffer_access sym_buffer = section.chunk.buffer;
+	element_reader name_read = elf.create_reader(section.sh_link);
+	while (sym_buffer.get_pos() + entry_size <= section.sh_size)
+	{
+		elf_symbol sym;
+		ret = read_symbol(sym, elf, sym_buffer, name_read);
+		CHECK_RET(ret);
+		output.dynamic_symbols.push_back(sym);
+	}
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// Copy the words of a .hash or .gnu.hash section. Only the endianness is
+// converted: nothing is hashed.
+static int parse_symbol_hash(elf_results& output, elf& elf, const elf_section_int& section)
+{
+	int ret = elf.load_section(section.section_id);
+	CHECK_RET(ret)
+
+	elf_symbol_hash& hash = output.dynamic_hash;
+	element_reader reader = elf.create_reader(section.section_id);
+	if (section.sh_type == SHT_HASH)
+	{
+		// nbucket, nchain, buckets, chains
+		if (section.sh_size < 8)
+			return elf_error::OK;
+		uint32_t nbucket = reader.readU32();
+		uint32_t nchain = reader.readU32();
+		if (nbucket == 0 || (uint64_t)(2 + nbucket + nchain) * 4 > section.sh_size)
+			return elf_error::OK;
+		hash.buckets.resize(nbucket);
+		for (uint32_t& b : hash.buckets)
+			b = reader.readU32();
+		hash.chains.resize(nchain);
+		for (uint32_t& c : hash.chains)
+			c = reader.readU32();
+	}
+	else
+	{
+		// nbuckets, symoffset, bloom_size, bloom_shift, bloom, buckets, chains
+		if (section.sh_size < 16)
+			return elf_error::OK;
+		uint32_t nbuckets = reader.readU32();
+		hash.symoffset = reader.readU32();
+		uint32_t bloom_size = reader.readU32();
+		hash.bloom_shift = reader.readU32();
+		hash.bloom_bits = elf.ident.ei_class == ELFCLASS32 ? 32 : 64;
+		uint64_t fixed_size = 16 + (uint64_t)bloom_size * (hash.bloom_bits / 8) + (uint64_t)nbuckets * 4;
+		if (nbuckets == 0 || bloom_size == 0 || fixed_size > section.sh_size)
+			return elf_error::OK;
+		hash.bloom.resize(bloom_size);
+		for (uint64_t& word : hash.bloom)
+			word = hash.bloom_bits == 32 ? reader.readU32() : reader.readU64();
+		hash.buckets.resize(nbuckets);
+		for (uint32_t& b : hash.buckets)
+			b = reader.readU32();
+		// The chains run to the end of the section
+		hash.chains.resize((section.sh_size - fixed_size) / 4);
+		for (uint32_t& c : hash.chains)
+			c = reader.readU32();
+	}
+	hash.type = section.sh_type;
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// Read the symbol tables, the first dynamic symbol table and its hash table.
+// "first_symbols" maps each symbol table to the index of its first entry in
+// output.symbols.
+static int parse_symbol_tables(elf_results& output, elf& elf_data, reload_context* reload,
+	parse_progress& progress, std::unordered_map<uint32_t, uint32_t>& first_symbols)
+{
+	int ret = elf_error::OK;
+	uint32_t dynsym_id = 0;
+	for (uint32_t sectionId = 0; sectionId < elf_data.e_shnum; ++sectionId)
+	{
+		const elf_section_int& s = elf_data.sections[sectionId];
+		// Move to section start
+		if (s.sh_type == SHT_SYMTAB)
+		{
+			first_symbols[sectionId] = output.symbols.size();
+			ret = parse_section_symbol(output, elf_data, s, reload);
+			CHECK_RET(ret);
+			ret = progress.advance(s.sh_size);
+			CHECK_RET(ret);
+		}
+		else if (s.sh_type == SHT_DYNSYM)
+		{
+			if (output.dynamic_symbols.empty())
+			{
+				ret = parse_dynamic_symbols(output, elf_data, s);
+				CHECK_RET(ret);
+				dynsym_id = sectionId;
+			}
+			ret = progress.advance(s.sh_size);
+			CHECK_RET(ret);
+		}
+	}
+
+	// Prefer .gnu.hash, which has a bloom filter, to .hash
+	const elf_section_int* hash_section = nullptr;
+	for (uint32_t sectionId = 0; sectionId < elf_data.e_shnum; ++sectionId)
+	{
+		const elf_section_int& s = elf_data.sections[sectionId];
+		if (s.sh_link != dynsym_id || dynsym_id == 0)
+			continue;
+		if (s.sh_type == SHT_GNU_HASH || (s.sh_type == SHT_HASH && !hash_section))
+			hash_section = &s;
+	}
+	if (hash_section)
+	{
+		ret = parse_symbol_hash(output, elf_data, *hash_section);
+		CHECK_RET(ret);
+	}
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// As parse_symbol_tables(), copying what an earlier parse of the same file
+// decoded. The symbol tables are only looked at for their sizes.
+static void copy_symbol_tables(elf_results& output, const elf& elf_data, const elf_results& previous,
+	std::unordered_map<uint32_t, uint32_t>& first_symbols)
+{
+	output.symbols = previous.symbols;
+	output.dynamic_symbols = previous.dynamic_symbols;
+	output.dynamic_hash = previous.dynamic_hash;
+	output.hashes.symbol_strings = previous.hashes.symbol_strings;
+	output.hashes.symbol_slices = previous.hashes.symbol_slices;
+
+	// The tables were read in section order, as in parse_section_symbol()
+	uint64_t entry_size = (elf_data.ident.ei_class == ELFCLASS32) ? sizeof(Elf32_Sym) : sizeof(Elf64_Sym);
+	uint32_t first = 0;
+	for (uint32_t sectionId = 0; sectionId < elf_data.e_shnum; ++sectionId)
+	{
+		const elf_section_int& s = elf_data.sections[sectionId];
+		if (s.sh_type != SHT_SYMTAB)
+			continue;
+		first_symbols[sectionId] = first;
+		first += (s.sh_size + entry_size - 1) / entry_size;
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Templated function to read either Elf32_hdr or Elf64_hdr
+template <typename ELF_FILE_HEADER>
+	static int read_elf_header(elf& elf_data, FILE* file)
+{
+	ELF_FILE_HEADER hdr;
+	if (read_file(file, hdr) != 0)
+		return elf_error::ERROR_READ_FILE;
+
+	uint8_t mode = elf_data.ident.ei_data;
+	elf_data.e_type 	 = conv_endian(hdr.e_type, mode);
+	elf_data.e_machine	 = conv_endian(hdr.e_machine, mode);
+	elf_data.e_version	 = conv_endian(hdr.e_version, mode);
+	elf_data.e_entry	 = conv_endian(hdr.e_entry, mode);
+	elf_data.e_phoff	 = conv_endian(hdr.e_phoff, mode);
+	elf_data.e_shoff	 = conv_endian(hdr.e_shoff, mode);
+	elf_data.e_flags	 = conv_endian(hdr.e_flags, mode);
+	elf_data.e_ehsize	 = conv_endian(hdr.e_ehsize, mode);
+	elf_data.e_phentsize = conv_endian(hdr.e_phentsize, mode);
+	elf_data.e_phnum	 = conv_endian(hdr.e_phnum, mode);
+	elf_data.e_shentsize = conv_endian(hdr.e_shentsize, mode);
+	elf_data.e_shnum	 = conv_endian(hdr.e_shnum, mode);
+	elf_data.e_shstrndx	 = conv_endian(hdr.e_shstrndx, mode);
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// Read the ELF header, the section headers and the section names.
+static int read_elf_sections(elf& elf_data, FILE* file)
+{
+	elf_data.file = file;
+
+	int ret = read_file(file, elf_data.ident);
+	CHECK_RET(ret);
+
+	// Check header
+	static char magic[4] = { 0x7f, 'E', 'L', 'F'};
+	for (size_t i = 0; i < 4; ++i)
+		if (elf_data.ident.ei_magic[i] != magic[i])
+			return elf_error::ERROR_HEADER_MAGIC_FAIL;
+
+	uint8_t data_class = elf_data.ident.ei_class;	// 32 bit or 64 bit
+
+	// Read main ELF header variants
+	if (data_class == ELFCLASS32)
+		ret = read_elf_header<Elf32_Ehdr>(elf_data, file);
+	else if (data_class == ELFCLASS64)
+		ret = read_elf_header<Elf64_Ehdr>(elf_data, file);
+	else
+		return elf_error::ERROR_UNKNOWN_CLASS;
+
+	if (elf_data.e_version != EV_CURRENT)
+		return elf_error::ERROR_ELF_VERSION;
+
+	// Load the section header data itself, into a custom block
+	loaded_chunk entries_chunk;
+	ret = entries_chunk.load(file, elf_data.e_shoff, elf_data.e_shnum * elf_data.e_shentsize);
+	CHECK_RET(ret);
+
+	// Create a reader for the section headers
+	element_reader sh_reader(entries_chunk.buffer, elf_data.ident.ei_data, elf_data.ident.ei_class);
+
+	// Read sections' raw information
+	elf_data.sections = new elf_section_int[elf_data.e_shnum];
+	for (uint32_t sectionId = 0; sectionId < elf_data.e_shnum; ++sectionId)
+	{
+		elf_section_int& s = elf_data.sections[sectionId];
+		s.sh_name       = sh_reader.readU32();
+		s.sh_type       = sh_reader.readU32();
+		s.sh_flags      = sh_reader.readAddress();
+		s.sh_addr       = sh_reader.readAddress();
+		s.sh_offset     = sh_reader.readAddress();
+		s.sh_size       = sh_reader.readAddress();
+		s.sh_link       = sh_reader.readU32();
+		s.sh_info       = sh_reader.readU32();
+		s.sh_addralign  = sh_reader.readAddress();
+		s.sh_entsize    = sh_reader.readAddress();
+		s.section_id	= sectionId;
+		if (sh_reader.errored())
+			return elf_error::ERROR_READ_FILE;
+	}
+
+	// Load the section with the section's name strings in
+	ret = elf_data.load_section(elf_data.e_shstrndx);
+	CHECK_RET(ret);
+
+	// Now read the section names
+	element_reader name_reader = elf_data.create_reader(elf_data.e_shstrndx);
+	for (uint32_t sectionId = 0; sectionId < elf_data.e_shnum; ++sectionId)
+	{
+		elf_section_int& s = elf_data.sections[sectionId];
+
+		// Jump into the section with strings and read a string
+		name_reader.set(s.sh_name);
+		s.name_string = name_reader.read_null_term_string();
+		if (name_reader.errored())
+			return elf_error::ERROR_READ_FILE;
+	}
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+//	CALL FRAME INFORMATION
+// ----------------------------------------------------------------------------
+// Read a pointer in one of the DW_EH_PE_* encodings. "field_address" is the
+// address of the data being read, for pc-relative pointers.
+// Returns 0 for success, 1 for an encoding we can't read.
+static int read_encoded_pointer(element_reader& eread, uint8_t encoding, uint8_t address_size,
+	uint64_t field_address, uint64_t& value)
+{
+	switch (encoding & 0x0f)
+	{
+		case DW_EH_PE_absptr:	value = read_sized(eread, address_size); break;
+		case DW_EH_PE_uleb128:	value = eread.readULEB128(); break;
+		case DW_EH_PE_udata2:	value = eread.readU16(); break;
+		case DW_EH_PE_udata4:	value = eread.readU32(); break;
+		case DW_EH_PE_udata8:	value = eread.readU64(); break;
+		case DW_EH_PE_sleb128:	value = (uint64_t)eread.readSLEB128(); break;
+		case DW_EH_PE_sdata2:	value = (uint64_t)(int16_t)eread.readU16(); break;
+		case DW_EH_PE_sdata4:	value = (uint64_t)(int32_t)eread.readU32(); break;
+		case DW_EH_PE_sdata8:	value = eread.readU64(); break;
+		default:				return 1;
+	}
+	switch (encoding & 0x70)
+	{
+		case DW_EH_PE_absptr:	break;
+		case DW_EH_PE_pcrel:	value += field_address; break;
+		default:				return 1;		// needs bases we don't know
+	}
+	if (address_size < 8)
+		value &= (1ULL << (address_size * 8)) - 1;
+	return eread.errored() ? 1 : 0;
+}
+
+// ----------------------------------------------------------------------------
+// The CIEs of the section being read, by offset
+struct cie_info
+{
+	uint32_t index;				// in elf_cfi::cies, or ~0U if the CIE can't be used
+	bool has_augmentation_data;	// FDEs have augmentation data to skip
+};
+
+struct frame_section
+{
+	const elf_section_int* section;
+	bool is_eh_frame;
+	std::unordered_map<uint64_t, cie_info> cies;
+};
+
+// ----------------------------------------------------------------------------
+// Read the header of an entry: its length and CIE id or pointer.
+static int read_frame_entry_header(element_reader& eread, uint64_t section_size, uint64_t& end,
+	bool& is64bit, uint64_t& id_pos, uint64_t& id)
+{
+	uint64_t length = eread.read_ptrsize(is64bit);
+	end = eread.get_pos() + length;
+	id_pos = eread.get_pos();
+	id = length ? eread.readU32or64(is64bit) : 0;
+	if (eread.errored() || end > section_size)
+		return elf_error::ERROR_DWARF_FRAME_PARSE;
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// Find or read the CIE at "offset" in the section
+static const cie_info& get_cie(elf_cfi& cfi, elf& elf, frame_section& frame, uint64_t offset)
+{
+	std::unordered_map<uint64_t, cie_info>::iterator it = frame.cies.find(offset);
+	if (it != frame.cies.end())
+		return it->second;
+	cie_info& info = frame.cies[offset];
+	info.index = ~0U;
+	info.has_augmentation_data = false;
+
+	element_reader eread = elf.create_reader(frame.section->section_id);
+	uint64_t end, id_pos, id;
+	bool is64bit;
+	if (eread.set(offset) || read_frame_entry_header(eread, frame.section->sh_size, end, is64bit, id_pos, id))
+		return info;
+	if (id != (frame.is_eh_frame ? 0 : (is64bit ? ~0ULL : 0xffffffffULL)))
+		return info;
+
+	elf_cfi_cie cie;
+	uint8_t version = eread.readU8();
+	if (version != 1 && version != 3 && version != 4)
+		return info;
+	std::string augmentation = eread.read_null_term_string();
+	cie.address_size = elf.ident.ei_class == ELFCLASS64 ? 8 : 4;
+	if (version >= 4)
+	{
+		cie.address_size = eread.readU8();
+		eread.readU8();					// segment_selector_size
+		if (cie.address_size != 2 && cie.address_size != 4 && cie.address_size != 8)
+			return info;
+	}
+	if (augmentation == "eh")
+		read_sized(eread, cie.address_size);	// old GCC exception table pointer
+	cie.code_align = eread.readULEB128();
+	cie.data_align = eread.readSLEB128();
+	cie.return_register = version == 1 ? eread.readU8() : eread.readULEB128();
+	cie.pointer_encoding = DW_EH_PE_absptr;
+	cie.signal_frame = false;
+
+	// Augmentations we don't understand make the rest of the CIE unreadable,
+	// unless it starts with 'z', which gives the size of the data
+	if (augmentation.size() && augmentation[0] == 'z')
+	{
+		uint64_t data_end = eread.readULEB128();
+		data_end += eread.get_pos();
+		info.has_augmentation_data = true;
+		for (size_t i = 1; i < augmentation.size(); ++i)
+		{
+			uint8_t encoding;
+			uint64_t unused;
+			switch (augmentation[i])
+			{
+				case 'R':
+					cie.pointer_encoding = eread.readU8();
+					continue;
+				case 'P':
+					encoding = eread.readU8();
+					if (read_encoded_pointer(eread, encoding, cie.address_size, 0, unused))
+						break;
+					continue;
+				case 'L':
+					eread.readU8();		// encoding of the LSDA pointer in FDEs
+					continue;
+				case 'S':
+					cie.signal_frame = true;
+					continue;
+				default:
+					break;
+			}
+			break;
+		}
+		eread.set(data_end);
+	}
+	else if (augmentation.size() && augmentation != "eh")
+		return info;
+	if (eread.errored() || eread.get_pos() > end)
+		return info;
+
+	cie.instructions = cfi.instructions.size();
+	cie.instructions_size = end - eread.get_pos();
+	cfi.instructions.insert(cfi.instructions.end(), eread.get_data(), eread.get_data() + cie.instructions_size);
+	info.index = cfi.cies.size();
+	cfi.cies.push_back(cie);
+	return info;
+}
+
+// ----------------------------------------------------------------------------
+// Read the FDEs of .debug_frame or .eh_frame. Entries which can't be used,
+// e.g. with an unknown augmentation, are skipped.
+static int parse_frame_section(elf_cfi& cfi, elf& elf, const elf_section_int& section, bool is_eh_frame)
+{
+	frame_section frame;
+	frame.section = &section;
+	frame.is_eh_frame = is_eh_frame;
+	element_reader eread = elf.create_reader(section.section_id);
+	while (eread.get_pos() < section.sh_size)
+	{
+		uint64_t end, id_pos, id;
+		bool is64bit;
+		int ret = read_frame_entry_header(eread, section.sh_size, end, is64bit, id_pos, id);
+		CHECK_RET(ret);
+		if (end == id_pos)
+		{
+			// A zero terminator ends .eh_frame
+			if (is_eh_frame)
+				break;
+			continue;
+		}
+
+		bool is_cie = is_eh_frame ? id == 0 : id == (is64bit ? ~0ULL : 0xffffffffULL);
+		if (!is_cie)
+		{
+			// In .eh_frame the CIE pointer is relative to the pointer itself
+			const cie_info& info = get_cie(cfi, elf, frame, is_eh_frame ? id_pos - id : id);
+			if (info.index != ~0U)
+			{
+				const elf_cfi_cie& cie = cfi.cies[info.index];
+				elf_cfi_fde fde;
+				fde.cie_index = info.index;
+				uint64_t range;
+				int bad = read_encoded_pointer(eread, cie.pointer_encoding, cie.address_size,
+					section.sh_addr + eread.get_pos(), fde.start);
+				bad |= read_encoded_pointer(eread, cie.pointer_encoding & 0x0f, cie.address_size, 0, range);
+				if (info.has_augmentation_data)
+					eread.skip(eread.readULEB128());
+				fde.end = fde.start + range;
+				if (!bad && !eread.errored() && eread.get_pos() <= end && range)
+				{
+					fde.instructions = cfi.instructions.size();
+					fde.instructions_size = end - eread.get_pos();
+					cfi.instructions.insert(cfi.instructions.end(), eread.get_data(),
+						eread.get_data() + fde.instructions_size);
+					cfi.fdes.push_back(fde);
+				}
+			}
+		}
+		eread.set(end);
+	}
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+static int parse_cfi(elf_cfi& cfi, elf& elf)
+{
+	cfi.data_mode = elf.ident.ei_data;
+	// .debug_frame first, so that its entries win over .eh_frame ones
+	static const char* section_names[] = { ".debug_frame", ".eh_frame" };
+	for (int i = 0; i < 2; ++i)
+	{
+		const elf_section_int* section = load_named_section(elf, section_names[i]);
+		if (!section)
+			continue;
+		int ret = parse_frame_section(cfi, elf, *section, i == 1);
+		CHECK_RET(ret);
+	}
+
+	// Sort, dropping any entry which overlaps an earlier one
+	std::stable_sort(cfi.fdes.begin(), cfi.fdes.end(),
+		[](const elf_cfi_fde& a, const elf_cfi_fde& b) { return a.start < b.start; });
+	size_t count = 0;
+	for (size_t i = 0; i < cfi.fdes.size(); ++i)
+	{
+		if (count && cfi.fdes[i].start < cfi.fdes[count - 1].end)
+			continue;
+		cfi.fdes[count++] = cfi.fdes[i];
+	}
+	cfi.fdes.resize(count);
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// The rules while running instructions
+struct cfi_state
+{
+	elf_cfi_rule cfa;
+	std::vector<elf_cfi_rule> rules;		// sorted by column
+};
+
+// ----------------------------------------------------------------------------
+static elf_cfi_rule& get_rule(cfi_state& state, uint32_t column)
+{
+	std::vector<elf_cfi_rule>::iterator it = std::lower_bound(state.rules.begin(), state.rules.end(), column,
+		[](const elf_cfi_rule& r, uint32_t col) { return r.column < col; });
+	if (it == state.rules.end() || it->column != column)
+	{
+		elf_cfi_rule rule = {};
+		rule.column = column;
+		it = state.rules.insert(it, rule);
+	}
+	return *it;
+}
+
+// ----------------------------------------------------------------------------
+static void set_rule(cfi_state& state, uint32_t column, uint8_t type, uint32_t reg, int64_t offset)
+{
+	elf_cfi_rule& rule = get_rule(state, column);
+	rule.type = type;
+	rule.reg = reg;
+	rule.offset = offset;
+	rule.expression = rule.expression_size = 0;
+}
+
+// ----------------------------------------------------------------------------
+// Set a column back to its rule after the CIE's instructions
+static void restore_rule(cfi_state& state, const cfi_state& initial, uint32_t column)
+{
+	for (const elf_cfi_rule& rule : initial.rules)
+	{
+		if (rule.column == column)
+		{
+			get_rule(state, column) = rule;
+			return;
+		}
+	}
+	std::vector<elf_cfi_rule>::iterator it = std::lower_bound(state.rules.begin(), state.rules.end(), column,
+		[](const elf_cfi_rule& r, uint32_t col) { return r.column < col; });
+	if (it != state.rules.end() && it->column == column)
+		state.rules.erase(it);
+}
+
+// ----------------------------------------------------------------------------
+static bool same_rule(const elf_cfi_rule& a, const elf_cfi_rule& b)
+{
+	return a.column == b.column && a.type == b.type && a.reg == b.reg && a.offset == b.offset &&
+		a.expression == b.expression && a.expression_size == b.expression_size;
+}
+
+// ----------------------------------------------------------------------------
+// Add a row for [start, end) with the current rules, or extend the previous
+// row if its rules are the same.
+static void add_cfi_row(elf_cfi_table& table, const cfi_state& state, uint64_t start, uint64_t end)
+{
+	if (table.rows.size())
+	{
+		elf_cfi_row& prev = table.rows.back();
+		bool same = prev.end == start && same_rule(prev.cfa, state.cfa) &&
+			prev.num_rules == state.rules.size();
+		for (uint32_t i = 0; same && i < prev.num_rules; ++i)
+			same = same_rule(table.rules[prev.first_rule + i], state.rules[i]);
+		if (same)
+		{
+			prev.end = end;
+			return;
+		}
+	}
+	elf_cfi_row row;
+	row.start = start;
+	row.end = end;
+	row.cfa = state.cfa;
+	row.first_rule = table.rules.size();
+	row.num_rules = state.rules.size();
+	table.rules.insert(table.rules.end(), state.rules.begin(), state.rules.end());
+	table.rows.push_back(row);
+}
+
+// ----------------------------------------------------------------------------
+// Run a block of instructions. For an FDE, rows are added to "table" as the
+// location advances from "loc"; for a CIE "table" is null.
+static int run_cfi_instructions(const elf_cfi& cfi, const elf_cfi_cie& cie, uint64_t offset, uint64_t size,
+	cfi_state& state, const cfi_state& initial, uint64_t& loc, elf_cfi_table* table)
+{
+	buffer_access buffer(cfi.instructions.data() + offset, size);
+	element_reader eread(buffer, cfi.data_mode, cie.address_size == 8 ? ELFCLASS64 : ELFCLASS32);
+	std::vector<cfi_state> saved;		// for DW_CFA_remember_state
+
+	while (eread.get_pos() < size)
+	{
+		uint8_t op = eread.readU8();
+		uint64_t new_loc = loc;
+		uint32_t reg;
+		switch (op & 0xc0)
+		{
+			case DW_CFA_advance_loc:
+				new_loc = loc + (op & 0x3f) * cie.code_align;
+				break;
+			case DW_CFA_offset:
+				set_rule(state, op & 0x3f, cfi_rule::OFFSET, 0, (int64_t)eread.readULEB128() * cie.data_align);
+				break;
+			case DW_CFA_restore:
+				restore_rule(state, initial, op & 0x3f);
+				break;
+			default:
+				switch (op)
+				{
+					case DW_CFA_nop:
+						break;
+					case DW_CFA_set_loc:
+						// Only the format of the encoding is used: this isn't emitted
+						// by compilers in .eh_frame, where it could be pc-relative
+						if (read_encoded_pointer(eread, cie.pointer_encoding & 0x0f, cie.address_size, 0, new_loc))
+							return elf_error::ERROR_DWARF_FRAME_PARSE;
+						break;
+					case DW_CFA_advance_loc1:	new_loc = loc + eread.readU8() * cie.code_align; break;
+					case DW_CFA_advance_loc2:	new_loc = loc + eread.readU16() * cie.code_align; break;
+					case DW_CFA_advance_loc4:	new_loc = loc + eread.readU32() * cie.code_align; break;
+					case DW_CFA_offset_extended:
+						reg = eread.readULEB128();
+						set_rule(state, reg, cfi_rule::OFFSET, 0, (int64_t)eread.readULEB128() * cie.data_align);
+						break;
+					case DW_CFA_offset_extended_sf:
+						reg = eread.readULEB128();
+						set_rule(state, reg, cfi_rule::OFFSET, 0, eread.readSLEB128() * cie.data_align);
+						break;
+					case DW_CFA_GNU_negative_offset_extended:
+						reg = eread.readULEB128();
+						set_rule(state, reg, cfi_rule::OFFSET, 0, -(int64_t)eread.readULEB128() * cie.data_align);
+						break;
+					case DW_CFA_val_offset:
+						reg = eread.readULEB128();
+						set_rule(state, reg, cfi_rule::VAL_OFFSET, 0, (int64_t)eread.readULEB128() * cie.data_align);
+						break;
+					case DW_CFA_val_offset_sf:
+						reg = eread.readULEB128();
+						set_rule(state, reg, cfi_rule::VAL_OFFSET, 0, eread.readSLEB128() * cie.data_align);
+						break;
+					case DW_CFA_restore_extended:
+						restore_rule(state, initial, eread.readULEB128());
+						break;
+					case DW_CFA_undefined:
+						set_rule(state, eread.readULEB128(), cfi_rule::UNDEFINED, 0, 0);
+						break;
+					case DW_CFA_same_value:
+						set_rule(state, eread.readULEB128(), cfi_rule::SAME_VALUE, 0, 0);
+						break;
+					case DW_CFA_register:
+						reg = eread.readULEB128();
+						set_rule(state, reg, cfi_rule::REGISTER, eread.readULEB128(), 0);
+						break;
+					case DW_CFA_expression:
+					case DW_CFA_val_expression:
+					{
+						elf_cfi_rule& rule = get_rule(state, eread.readULEB128());
+						rule.type = op == DW_CFA_expression ? cfi_rule::EXPRESSION : cfi_rule::VAL_EXPRESSION;
+						rule.reg = 0;
+						rule.offset = 0;
+						rule.expression_size = eread.readULEB128();
+						rule.expression = offset + eread.get_pos();
+						eread.skip(rule.expression_size);
+						break;
+					}
+					case DW_CFA_remember_state:
+						saved.push_back(state);
+						break;
+					case DW_CFA_restore_state:
+					{
+						if (saved.empty())
+							return elf_error::ERROR_DWARF_FRAME_PARSE;
+						// The whole row comes back, CFA included, as in libgcc
+						// and binutils: epilogues rely on it
+						state = saved.back();
+						saved.pop_back();
+						break;
+					}
+					case DW_CFA_def_cfa:
+						state.cfa.type = cfi_rule::VAL_OFFSET;
+						state.cfa.reg = eread.readULEB128();
+						state.cfa.offset = eread.readULEB128();
+						break;
+					case DW_CFA_def_cfa_sf:
+						state.cfa.type = cfi_rule::VAL_OFFSET;
+						state.cfa.reg = eread.readULEB128();
+						state.cfa.offset = eread.readSLEB128() * cie.data_align;
+						break;
+					case DW_CFA_def_cfa_register:
+						state.cfa.type = cfi_rule::VAL_OFFSET;
+						state.cfa.reg = eread.readULEB128();
+						break;
+					case DW_CFA_def_cfa_offset:
+						state.cfa.offset = eread.readULEB128();
+						break;
+					case DW_CFA_def_cfa_offset_sf:
+						state.cfa.offset = eread.readSLEB128() * cie.data_align;
+						break;
+					case DW_CFA_def_cfa_expression:
+						state.cfa.type = cfi_rule::VAL_EXPRESSION;
+						state.cfa.expression_size = eread.readULEB128();
+						state.cfa.expression = offset + eread.get_pos();
+						eread.skip(state.cfa.expression_size);
+						break;
+					case DW_CFA_GNU_args_size:
+						eread.readULEB128();
+						break;
+					default:
+						return elf_error::ERROR_DWARF_FRAME_PARSE;
+				}
+				break;
+		}
+		if (eread.errored())
+			return elf_error::ERROR_DWARF_FRAME_PARSE;
+
+		if (new_loc != loc && table)
+		{
+			if (new_loc < loc)
+				return elf_error::ERROR_DWARF_FRAME_PARSE;
+			add_cfi_row(*table, state, loc, new_loc);
+			loc = new_loc;
+		}
+	}
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+const elf_cfi_fde* find_elf_fde(const elf_cfi& cfi, uint64_t address)
+{
+	std::vector<elf_cfi_fde>::const_iterator it = std::upper_bound(cfi.fdes.begin(), cfi.fdes.end(), address,
+		[](uint64_t addr, const elf_cfi_fde& fde) { return addr < fde.start; });
+	if (it == cfi.fdes.begin())
+		return nullptr;
+	--it;
+	return address < it->end ? &*it : nullptr;
+}
+
+// ----------------------------------------------------------------------------
+int decode_elf_cfi(const elf_cfi& cfi, const elf_cfi_fde& fde, elf_cfi_table& table)
+{
+	table.rows.clear();
+	table.rules.clear();
+	const elf_cfi_cie& cie = cfi.cies[fde.cie_index];
+
+	cfi_state initial = {};
+	initial.cfa.type = cfi_rule::UNDEFINED;
+	uint64_t loc = fde.start;
+	int ret = run_cfi_instructions(cfi, cie, cie.instructions, cie.instructions_size,
+		initial, initial, loc, nullptr);
+	CHECK_RET(ret);
+
+	cfi_state state = initial;
+	ret = run_cfi_instructions(cfi, cie, fde.instructions, fde.instructions_size,
+		state, initial, loc, &table);
+	CHECK_RET(ret);
+	if (loc < fde.end)
+		add_cfi_row(table, state, loc, fde.end);
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// Templated function to read the common fields of Elf32_Rel, Elf32_Rela,
+// Elf64_Rel or Elf64_Rela
+template <typename ELF_REL>
+	static int read_elf_relocation(elf_relocation& rel, elf& elf_data, buffer_access& buffer, ELF_REL& file_rel)
+{
+	if (buffer.read(file_rel) != 0)
+		return elf_error::ERROR_READ_FILE;
+
+	uint8_t mode = elf_data.ident.ei_data;
+	rel.site = conv_endian(file_rel.r_offset, mode);
+	uint64_t info = conv_endian(file_rel.r_info, mode);
+	if (sizeof(file_rel.r_info) == 8)
+	{
+		rel.symbol = ELF64_R_SYM(info);
+		rel.type = ELF64_R_TYPE(info);
+	}
+	else
+	{
+		rel.symbol = ELF32_R_SYM(info);
+		rel.type = ELF32_R_TYPE(info);
+	}
+	rel.addend = 0;
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// As read_elf_relocation(), for Elf32_Rela or Elf64_Rela
+template <typename ELF_RELA>
+	static int read_elf_relocation_addend(elf_relocation& rel, elf& elf_data, buffer_access& buffer)
+{
+	ELF_RELA file_rel;
+	int ret = read_elf_relocation(rel, elf_data, buffer, file_rel);
+	CHECK_RET(ret);
+	uint64_t addend = conv_endian(file_rel.r_addend, elf_data.ident.ei_data);
+	// Sign-extend 32-bit addends
+	rel.addend = sizeof(file_rel.r_addend) == 4 ? (int64_t)(int32_t)addend : (int64_t)addend;
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// "first_symbols" maps each parsed symbol table to the index of its first
+// entry in output.symbols.
+static int parse_section_relocations(elf_results& output, elf& elf, const elf_section_int& section,
+	const std::unordered_map<uint32_t, uint32_t>& first_symbols)
+{
+	int ret = elf.load_section(section.section_id);
+	CHECK_RET(ret);
+
+	bool is32 = elf.ident.ei_class == ELFCLASS32;
+	bool has_addend = section.sh_type == SHT_RELA;
+	uint64_t entry_size = has_addend ?
+		(is32 ? sizeof(Elf32_Rela) : sizeof(Elf64_Rela)) :
+		(is32 ? sizeof(Elf32_Rel) : sizeof(Elf64_Rel));
+	if (section.sh_entsize > entry_size)
+		entry_size = section.sh_entsize;
+
+	std::unordered_map<uint32_t, uint32_t>::const_iterator sym_it = first_symbols.find(section.sh_link);
+	const elf_section_int* target = section.sh_info && section.sh_info < elf.e_shnum ?
+		&elf.sections[section.sh_info] : nullptr;
+	// In relocatable files the sites are offsets in the target section
+	uint64_t site_base = elf.e_type == ET_REL && target ? target->sh_addr : 0;
+
+	buffer_access buffer = section.chunk.buffer;
+	uint64_t count = section.sh_size / entry_size;
+	output.relocations.reserve(output.relocations.size() + count);
+	for (uint64_t i = 0; i < count; ++i)
+	{
+		buffer.set(i * entry_size);
+		elf_relocation rel;
+		if (is32 && has_addend)
+			ret = read_elf_relocation_addend<Elf32_Rela>(rel, elf, buffer);
+		else if (has_addend)
+			ret = read_elf_relocation_addend<Elf64_Rela>(rel, elf, buffer);
+		else if (is32)
+		{
+			Elf32_Rel file_rel;
+			ret = read_elf_relocation(rel, elf, buffer, file_rel);
+		}
+		else
+		{
+			Elf64_Rel file_rel;
+			ret = read_elf_relocation(rel, elf, buffer, file_rel);
+		}
+		CHECK_RET(ret);
+
+		rel.site += site_base;
+		if (rel.symbol == 0 || sym_it == first_symbols.end())
+			rel.symbol = ~0U;
+		else
+			rel.symbol += sym_it->second;
+		if (rel.symbol != ~0U && rel.symbol >= output.symbols.size())
+			rel.symbol = ~0U;
+		rel.section_id = section.section_id;
+		rel.target_section = target ? section.sh_info : 0;
+		output.relocations.push_back(rel);
+	}
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// Build the indexes of relocations by site and by symbol. Relocations of
+// sections which aren't loaded, e.g. debug info, are left out of the sites,
+// since their offsets aren't addresses.
+static void index_relocations(elf_results& output, elf& elf)
+{
+	const std::vector<elf_relocation>& relocs = output.relocations;
+	for (uint32_t i = 0; i < relocs.size(); ++i)
+	{
+		const elf_relocation& rel = relocs[i];
+		if (rel.target_section == 0 || (elf.sections[rel.target_section].sh_flags & SHF_ALLOC))
+			output.relocation_sites.push_back(i);
+		if (rel.symbol != ~0U)
+			output.relocation_symbols.push_back(i);
+	}
+	std::stable_sort(output.relocation_sites.begin(), output.relocation_sites.end(),
+		[&relocs](uint32_t a, uint32_t b) { return relocs[a].site < relocs[b].site; });
+	std::stable_sort(output.relocation_symbols.begin(), output.relocation_symbols.end(),
+		[&relocs](uint32_t a, uint32_t b) {
+			if (relocs[a].symbol != relocs[b].symbol)
+				return relocs[a].symbol < relocs[b].symbol;
+			return relocs[a].site < relocs[b].site;
+		});
+}
+
+// ----------------------------------------------------------------------------
+// Templated function to read either Elf32_Phdr or Elf64_Phdr
+template <typename ELF_PHDR>
+	static int read_elf_program_header(elf_segment& segment, elf& elf_data, buffer_access& buffer)
+{
+	ELF_PHDR file_phdr;
+	if (buffer.read(file_phdr) != 0)
+		return elf_error::ERROR_READ_FILE;
+
+	uint8_t mode = elf_data.ident.ei_data;
+	segment.type		= conv_endian(file_phdr.p_type, mode);
+	segment.flags		= conv_endian(file_phdr.p_flags, mode);
+	segment.offset		= conv_endian(file_phdr.p_offset, mode);
+	segment.vaddr		= conv_endian(file_phdr.p_vaddr, mode);
+	segment.paddr		= conv_endian(file_phdr.p_paddr, mode);
+	segment.file_size	= conv_endian(file_phdr.p_filesz, mode);
+	segment.mem_size	= conv_endian(file_phdr.p_memsz, mode);
+	segment.align		= conv_endian(file_phdr.p_align, mode);
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+static int parse_program_headers(elf_results& output, elf& elf_data)
+{
+	// Very large counts are stored in the first section header
+	uint32_t count = elf_data.e_phnum;
+	if (count == PN_XNUM && elf_data.e_shnum)
+		count = elf_data.sections[0].sh_info;
+	if (count == 0 || elf_data.e_phoff == 0)
+		return elf_error::OK;
+
+	uint32_t entry_size = elf_data.ident.ei_class == ELFCLASS32 ? sizeof(Elf32_Phdr) : sizeof(Elf64_Phdr);
+	if (elf_data.e_phentsize < entry_size)
+		return elf_error::ERROR_READ_FILE;
+
+	loaded_chunk headers_chunk;
+	int ret = headers_chunk.load(elf_data.file, elf_data.e_phoff, (uint64_t)count * elf_data.e_phentsize);
+	CHECK_RET(ret);
+	buffer_access buffer = headers_chunk.buffer;
+	output.segments.resize(count);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		buffer.set((uint64_t)i * elf_data.e_phentsize);
+		if (elf_data.ident.ei_class == ELFCLASS32)
+			ret = read_elf_program_header<Elf32_Phdr>(output.segments[i], elf_data, buffer);
+		else
+			ret = read_elf_program_header<Elf64_Phdr>(output.segments[i], elf_data, buffer);
+		CHECK_RET(ret);
+	}
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+//	SEPARATE DEBUG FILES
+// ----------------------------------------------------------------------------
+// Read .gnu_debuglink and the build ID note, which name the debug file
+static int parse_debug_links(elf_results& output, elf& elf_data)
+{
+	elf_section_int* link_section = load_named_section(elf_data, ".gnu_debuglink");
+	if (link_section)
+	{
+		// Name, padded to 4 bytes, then the CRC
+		element_reader reader = elf_data.create_reader(link_section->section_id);
+		output.debuglink = reader.read_null_term_string();
+		uint64_t crc_pos = (output.debuglink.size() + 1 + 3) & ~3ULL;
+		if (crc_pos + 4 <= link_section->sh_size)
+		{
+			reader.set(crc_pos);
+			output.debuglink_crc = reader.readU32();
+		}
+		else
+			output.debuglink.clear();
+	}
+
+	for (uint32_t sectionId = 0; sectionId < elf_data.e_shnum; ++sectionId)
+	{
+		const elf_section_int& s = elf_data.sections[sectionId];
+		if (s.sh_type != SHT_NOTE)
+			continue;
+		int ret = elf_data.load_section(sectionId);
+		CHECK_RET(ret);
+
+		// Each note is namesz, descsz, type, then name and desc padded to 4 bytes
+		element_reader reader = elf_data.create_reader(sectionId);
+		uint64_t pos = 0;
+		while (pos + 12 <= s.sh_size)
+		{
+			reader.set(pos);
+			uint32_t name_size = reader.readU32();
+			uint32_t desc_size = reader.readU32();
+			uint32_t type = reader.readU32();
+			uint64_t name_pos = pos + 12;
+			uint64_t desc_pos = name_pos + ((name_size + 3ULL) & ~3ULL);
+			pos = desc_pos + ((desc_size + 3ULL) & ~3ULL);
+			if (pos > s.sh_size)
+				break;
+			if (type == NT_GNU_BUILD_ID && name_size == 4 &&
+				memcmp(s.chunk.data + name_pos, "GNU", 4) == 0)
+			{
+				const uint8_t* desc = s.chunk.data + desc_pos;
+				output.build_id.assign(desc, desc + desc_size);
+				return elf_error::OK;
+			}
+		}
+	}
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// Slice-by-8 tables for the reflected CRC32 polynomial
+struct crc32_tables
+{
+	uint32_t table[8][256];
+
+	crc32_tables()
+	{
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			uint32_t crc = i;
+			for (int bit = 0; bit < 8; ++bit)
+				crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+			table[0][i] = crc;
+		}
+		for (uint32_t i = 0; i < 256; ++i)
+			for (int slice = 1; slice < 8; ++slice)
+				table[slice][i] = (table[slice - 1][i] >> 8) ^ table[0][table[slice - 1][i] & 0xff];
+	}
+};
+
+// ----------------------------------------------------------------------------
+uint32_t elf_crc32(uint32_t crc, const uint8_t* data, uint64_t size)
+{
+	static const crc32_tables tables;
+	const uint32_t (*t)[256] = tables.table;
+	crc = ~crc;
+	// 8 bytes per step, independent of host endianness
+	for (; size >= 8; size -= 8, data += 8)
+	{
+		uint32_t lo = crc ^ ((uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+			((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+		crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+			t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+	}
+	for (; size; --size)
+		crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xff];
+	return ~crc;
+}
+
+// ----------------------------------------------------------------------------
+static bool file_crc_matches(const std::string& fname, uint32_t expected)
+{
+	FILE* file = fopen(fname.c_str(), "rb");
+	if (!file)
+		return false;
+	std::vector<uint8_t> buffer(256 * 1024);
+	uint32_t crc = 0;
+	size_t count;
+	while ((count = fread(buffer.data(), 1, buffer.size(), file)) != 0)
+		crc = elf_crc32(crc, buffer.data(), count);
+	bool ok = !ferror(file) && crc == expected;
+	fclose(file);
+	return ok;
+}
+
+// ----------------------------------------------------------------------------
+static bool file_exists(const std::string& fname)
+{
+	FILE* file = fopen(fname.c_str(), "rb");
+	if (!file)
+		return false;
+	fclose(file);
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool find_elf_debug_file(const elf_results& results, const std::string& fname,
+	const std::vector<std::string>& debug_dirs, std::string& debug_fname)
+{
+	// Build IDs name the file uniquely, so no check is needed
+	if (results.build_id.size() >= 2)
+	{
+		static const char hex[] = "0123456789abcdef";
+		std::string id;
+		for (uint8_t b : results.build_id)
+		{
+			id += hex[b >> 4];
+			id += hex[b & 0xf];
+		}
+		for (const std::string& dir : debug_dirs)
+		{
+			std::string path = dir + "/.build-id/" + id.substr(0, 2) + "/" + id.substr(2) + ".debug";
+			if (file_exists(path))
+			{
+				debug_fname = path;
+				return true;
+			}
+		}
+	}
+
+	if (results.debuglink.empty())
+		return false;
+
+	std::string dir;
+	size_t slash = fname.rfind('/');
+	if (slash != std::string::npos)
+		dir = fname.substr(0, slash + 1);
+
+	std::vector<std::string> candidates;
+	// The debug file can have the same name as the file, so skip that
+	if (dir + results.debuglink != fname)
+		candidates.push_back(dir + results.debuglink);
+	candidates.push_back(dir + ".debug/" + results.debuglink);
+	for (const std::string& debug_dir : debug_dirs)
+	{
+		// Debug dirs mirror the absolute directory of the file
+		if (dir.size() && dir[0] == '/')
+			candidates.push_back(debug_dir + dir + results.debuglink);
+		else
+			candidates.push_back(debug_dir + "/" + results.debuglink);
+	}
+	for (const std::string& path : candidates)
+	{
+		if (file_crc_matches(path, results.debuglink_crc))
+		{
+			debug_fname = path;
+			return true;
+		}
+	}
+	return false;
+}
+
+// ----------------------------------------------------------------------------
+// Find the line program of each inlined function's unit, for its call_file
+static void link_inline_line_units(elf_results& output, const line_program_links& links)
+{
+	for (elf_inline& inl : output.inlines)
+	{
+		std::unordered_map<uint64_t, uint64_t>::const_iterator it = links.stmt_lists.find(inl.unit_offset);
+		if (it == links.stmt_lists.end())
+			continue;
+		std::unordered_map<uint64_t, uint32_t>::const_iterator unit_it = links.line_units.find(it->second);
+		if (unit_it != links.line_units.end())
+			inl.line_unit = unit_it->second;
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Record the extent of each line program, reading just the unit lengths
+// rather than loading the section.
+static int record_line_programs(elf_results& output, elf& elf, const elf_section_int& section,
+	const line_program_links& links, parse_progress& progress)
+{
+	std::unordered_map<uint64_t, uint64_t> owners;		// DW_AT_stmt_list -> unit offset
+	for (const std::pair<const uint64_t, uint64_t>& stmt_list : links.stmt_lists)
+		owners[stmt_list.second] = stmt_list.first;
+
+	uint64_t offset = 0;
+	while (offset < section.sh_size)
+	{
+		loaded_chunk chunk;
+		bool complete;
+		int ret = load_section_window(elf, section, offset, 12, chunk, complete);
+		CHECK_RET(ret);
+		element_reader length_read(chunk.buffer, elf.ident.ei_data, elf.ident.ei_class);
+		bool is64bit = false;
+		uint64_t unit_length = length_read.read_ptrsize(is64bit);
+		uint64_t size = length_read.get_pos() + unit_length;
+		if (length_read.errored() || size > section.sh_size - offset)
+			return elf_error::ERROR_DWARF_DEBUGLINE_PARSE;
+
+		elf_line_program program;
+		program.offset = offset;
+		program.size = size;
+		std::unordered_map<uint64_t, uint64_t>::const_iterator base_it = links.str_bases.find(offset);
+		program.str_offsets_base = base_it != links.str_bases.end() ?
+			base_it->second : default_table_base(is64bit);
+		std::unordered_map<uint64_t, uint64_t>::const_iterator owner_it = owners.find(offset);
+		program.unit_offset = owner_it != owners.end() ? owner_it->second : ~0ULL;
+		output.line_programs.push_back(program);
+
+		offset += size;
+		ret = progress.advance(size);
+		CHECK_RET(ret);
+	}
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// Sum the sizes of the sections the requested parts will decode
+static uint64_t get_parse_total(const elf& elf_data, const parse_progress& progress)
+{
+	uint64_t total = 0;
+	for (uint32_t sectionId = 0; sectionId < elf_data.e_shnum; ++sectionId)
+	{
+		const elf_section_int& s = elf_data.sections[sectionId];
+		if (s.sh_type == SHT_NOBITS)
+			continue;
+		if ((s.sh_type == SHT_SYMTAB || s.sh_type == SHT_DYNSYM) && progress.wanted(elf_parts::SYMBOLS))
+		{
+			if (!progress.options.symbols_from)
+				total += s.sh_size;
+		}
+		else if ((s.sh_type == SHT_REL || s.sh_type == SHT_RELA) && progress.wanted(elf_parts::RELOCATIONS))
+			total += s.sh_size;
+		else if (s.name_string == ".debug_info" && progress.wanted(elf_parts::DEBUG_INFO))
+			total += s.sh_size;
+		else if (s.name_string == ".debug_line" && progress.wanted(elf_parts::LINES))
+			total += s.sh_size;
+		else if (s.name_string == ".debug_line" && progress.wanted(elf_parts::LINE_PROGRAMS))
+			total += s.sh_size;
+		else if ((s.name_string == ".eh_frame" || s.name_string == ".debug_frame") &&
+			progress.wanted(elf_parts::FRAMES))
+			total += s.sh_size;
+	}
+	return total;
+}
+
+// ----------------------------------------------------------------------------
+static int process_elf_file_internal(elf& elf_data, FILE* file, elf_results& output,
+	reload_context* reload, parse_progress& progress)
+{
+	output.sections.clear();
+	output.segments.clear();
+	output.line_info_units.clear();
+	output.line_programs.clear();
+	output.symbols.clear();
+	output.dynamic_symbols.clear();
+	output.dynamic_hash = elf_symbol_hash();
+	output.dynamic_hash.type = SHT_NULL;
+	output.relocations.clear();
+	output.relocation_sites.clear();
+	output.relocation_symbols.clear();
+	output.functions.clear();
+	output.function_ranges.ranges.clear();
+	output.unit_ranges.ranges.clear();
+	output.inlines.clear();
+	output.inline_ranges.clear();
+	output.cfi = elf_cfi();
+	output.hashes = elf_content_hashes();
+	output.debuglink.clear();
+	output.debuglink_crc = 0;
+	output.build_id.clear();
+
+	int ret = read_elf_sections(elf_data, file);
+	CHECK_RET(ret);
+	output.entry = elf_data.e_entry;
+	ret = parse_program_headers(output, elf_data);
+	CHECK_RET(ret);
+	if (progress.wanted(elf_parts::DEBUG_INFO | elf_parts::LINES))
+	{
+		ret = parse_debug_links(output, elf_data);
+		CHECK_RET(ret);
+	}
+	progress.total = get_parse_total(elf_data, progress);
+	ret = progress.advance(0);
+	CHECK_RET(ret);
+
+	for (uint32_t sectionId = 0; sectionId < elf_data.e_shnum; ++sectionId)
+	{
+		const elf_section_int& s = elf_data.sections[sectionId];
+		output.hashes.section_names = hash_data((const uint8_t*)s.name_string.c_str(),
+			s.name_string.size() + 1, output.hashes.section_names);
+
+		// Copy to results
+		elf_section result_sec = {};
+		result_sec.section_id  = s.section_id;
+		result_sec.name_string = s.name_string;
+		result_sec.offset      = s.sh_offset;
+		result_sec.size        = s.sh_size;
+		result_sec.type        = s.sh_type;
+		result_sec.flags       = s.sh_flags;
+		result_sec.addr        = s.sh_addr;
+		output.sections.push_back(result_sec);			
+	}
+
+	const elf_section_int* aranges_section = load_named_section(elf_data, ".debug_aranges");
+	if (aranges_section)
+	{
+		element_reader eread = elf_data.create_reader(aranges_section->section_id);
+		ret = parse_aranges(eread, aranges_section->sh_size, output.unit_ranges);
+		CHECK_RET(ret);
+	}
+
+	line_program_links links;
+	elf_section_int* debug_info_section = progress.wanted(elf_parts::DEBUG_INFO) ?
+		load_named_section(elf_data, ".debug_info") : nullptr;
+	if (debug_info_section)
+	{
+		ret = parse_section_debug_info(output, elf_data, *debug_info_section, links, progress);
+		CHECK_RET(ret);
+	}
+
+	const elf_section_int* debug_line_section = progress.wanted(elf_parts::LINES) ?
+		load_named_section(elf_data, ".debug_line") : nullptr;
+	if (debug_line_section)
+	{
+		// Line programs can refer to these string sections
+		static const char* string_sections[] = { ".debug_line_str", ".debug_str", ".debug_str_offsets" };
+		for (const char* name : string_sections)
+		{
+			const elf_section_int* strings = load_named_section(elf_data, name);
+			if (strings)
+				output.hashes.line_strings = hash_data(strings->chunk.data, strings->sh_size,
+					output.hashes.line_strings);
+		}
+
+		if (reload)
+		{
+			reload->names_match = output.hashes.section_names == reload->previous->hashes.section_names;
+			reload->strings_match = output.hashes.line_strings == reload->previous->hashes.line_strings;
+		}
+		ret = parse_section_debug_line(output, elf_data, *debug_line_section, links, reload, progress);
+		CHECK_RET(ret);
+		link_inline_line_units(output, links);
+	}
+	else if (reload)
+	{
+		reload->names_match = output.hashes.section_names == reload->previous->hashes.section_names;
+	}
+
+	const elf_section_int* programs_section = progress.wanted(elf_parts::LINE_PROGRAMS) ?
+		find_named_section(elf_data, ".debug_line") : nullptr;
+	if (programs_section)
+	{
+		ret = record_line_programs(output, elf_data, *programs_section, links, progress);
+		CHECK_RET(ret);
+	}
+
+	if (progress.wanted(elf_parts::FRAMES))
+	{
+		ret = parse_cfi(output.cfi, elf_data);
+		CHECK_RET(ret);
+		static const char* frame_sections[] = { ".eh_frame", ".debug_frame" };
+		for (const char* name : frame_sections)
+		{
+			const elf_section_int* frames = find_named_section(elf_data, name);
+			ret = progress.advance(frames ? frames->sh_size : 0);
+			CHECK_RET(ret);
+		}
+	}
+
+	if (!progress.wanted(elf_parts::SYMBOLS))
+		return elf_error::OK;
+
+	std::unordered_map<uint32_t, uint32_t> first_symbols;	// symbol table section -> index in output.symbols
+	if (progress.options.symbols_from)
+		copy_symbol_tables(output, elf_data, *progress.options.symbols_from, first_symbols);
+	else
+	{
+		ret = parse_symbol_tables(output, elf_data, reload, progress, first_symbols);
+		CHECK_RET(ret);
+	}
+
+	for (uint32_t sectionId = 0; sectionId < elf_data.e_shnum; ++sectionId)
+	{
+		const elf_section_int& s = elf_data.sections[sectionId];
+		if ((s.sh_type == SHT_REL || s.sh_type == SHT_RELA) && progress.wanted(elf_parts::RELOCATIONS))
+		{
+			ret = parse_section_relocations(output, elf_data, s, first_symbols);
+			CHECK_RET(ret);
+			ret = progress.advance(s.sh_size);
+			CHECK_RET(ret);
+		}
+	}
+	index_relocations(output, elf_data);
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// Find function and object symbols whose address or size differ between
+// two sets of results. Names which aren't unique (e.g. static functions in
+// different files) are ignored, since they can't be matched reliably.
+static void find_moved_symbols(const elf_results& previous, const elf_results& output,
+	std::vector<elf_moved_symbol>& moved)
+{
+	std::unordered_map<std::string, const elf_symbol*> prev_by_name;
+	for (const elf_symbol& sym : previous.symbols)
+	{
+		uint8_t type = sym.st_info & 0xf;
+		if ((type != STT_FUNC && type != STT_OBJECT) || sym.name.empty())
+			continue;
+		std::pair<std::unordered_map<std::string, const elf_symbol*>::iterator, bool> res =
+			prev_by_name.insert(std::make_pair(sym.name, &sym));
+		if (!res.second)
+			res.first->second = nullptr;	// duplicate name
+	}
+
+	for (const elf_symbol& sym : output.symbols)
+	{
+		uint8_t type = sym.st_info & 0xf;
+		if (type != STT_FUNC && type != STT_OBJECT)
+			continue;
+		std::unordered_map<std::string, const elf_symbol*>::const_iterator it = prev_by_name.find(sym.name);
+		if (it == prev_by_name.end() || !it->second)
+			continue;
+		const elf_symbol& prev = *it->second;
+		if (prev.st_value == sym.st_value && prev.st_size == sym.st_size)
+			continue;
+
+		elf_moved_symbol m;
+		m.name = sym.name;
+		m.old_address = prev.st_value;
+		m.old_size = prev.st_size;
+		m.new_address = sym.st_value;
+		m.new_size = sym.st_size;
+		moved.push_back(m);
+	}
+}
+
+// ----------------------------------------------------------------------------
+int process_elf_file(FILE* file, elf_results& output)
 {
-	uint8_t data_class = elf.ident.ei_class;	// 32 bit or 64 bit
-	int ret = elf_error::OK;
-	// Load the necessary chunks:
-	// the symbol section...
-	ret = elf.load_section(section.section_id);
-	CHECK_RET(ret)
+	return process_elf_file(file, output, elf_parse_options());
+}
 
-	// ... and the strings for the symbols.
-	ret = elf.load_section(section.sh_link);
-	CHECK_RET(ret)
+// ----------------------------------------------------------------------------
+int process_elf_file(FILE* file, elf_results& output, const elf_parse_options& options)
+{
+	elf elf_data;
+	elf_data.sections = nullptr;
 
-	const elf_section_int& symbol_section = section;
-	buffer_access sym_buffer = symbol_section.chunk.buffer;
-	sym_buffer.set(0);
+	parse_progress progress(options);
+	int ret = process_elf_file_internal(elf_data, file, output, nullptr, progress);
+	delete [] elf_data.sections;
+	return ret;
+}
 
-	// The linked string table is in sh_link...
-	element_reader name_read = elf.create_reader(section.sh_link);
-	while (sym_buffer.get_pos() < section.sh_size)
+// ----------------------------------------------------------------------------
+const elf_symbol* find_elf_dynamic_symbol(const elf_results& results, const char* name)
+{
+	const elf_symbol_hash& hash = results.dynamic_hash;
+	const std::vector<elf_symbol>& symbols = results.dynamic_symbols;
+	if (hash.type == SHT_GNU_HASH)
 	{
-		elf_symbol sym;
-		if (data_class == ELFCLASS32)
-			ret = read_elf_symbol<Elf32_Sym>(sym, elf, sym_buffer);
-		else if (data_class == ELFCLASS64)
-			ret = read_elf_symbol<Elf64_Sym>(sym, elf, sym_buffer);
-		CHECK_RET(ret);
+		uint32_t h = 5381;
+		for (const uint8_t* p = (const uint8_t*)name; *p; ++p)
+			h = h * 33 + *p;
 
-		name_read.set(sym.st_name);
-		sym.name = name_read.read_null_term_string();
-		if (sym.st_shndx < elf.e_shnum)
+		// Most missing names are rejected by the bloom filter
+		uint32_t bits = hash.bloom_bits;
+		uint64_t word = hash.bloom[(h / bits) % hash.bloom.size()];
+		uint64_t mask = (1ULL << (h % bits)) | (1ULL << ((h >> hash.bloom_shift) % bits));
+		if ((word & mask) != mask)
+			return nullptr;
+
+		uint32_t index = hash.buckets[h % hash.buckets.size()];
+		if (index < hash.symoffset)
+			return nullptr;
+		// The chain holds the hashes of consecutive symbols, the last with bit 0 set
+		for (; index - hash.symoffset < hash.chains.size() && index < symbols.size(); ++index)
+		{
+			uint32_t chain_hash = hash.chains[index - hash.symoffset];
+			if ((chain_hash | 1) == (h | 1) && symbols[index].name == name)
+				return &symbols[index];
+			if (chain_hash & 1)
+				break;
+		}
+		return nullptr;
+	}
+
+	if (hash.type == SHT_HASH)
+	{
+		uint32_t h = 0;
+		for (const uint8_t* p = (const uint8_t*)name; *p; ++p)
 		{
-			const elf_section_int& ref_section = elf.sections[sym.st_shndx];
-			sym.section_type = ref_section.name_string;
+			h = (h << 4) + *p;
+			uint32_t g = h & 0xf0000000;
+			if (g)
+				h ^= g >> 24;
+			h &= ~g;
 		}
-		else if (sym.st_shndx == SHN_ABS)
-			sym.section_type = "ABS";
-		else if (sym.st_shndx == SHN_COMMON)
-			sym.section_type = "COMMON";
 
-		output.symbols.push_back(sym);
+		// The step limit stops a corrupt chain from looping
+		uint32_t index = hash.buckets[h % hash.buckets.size()];
+		for (size_t steps = 0; index != 0 && steps < hash.chains.size(); ++steps)
+		{
+			if (index >= symbols.size() || index >= hash.chains.size())
+				break;
+			if (symbols[index].name == name)
+				return &symbols[index];
+			index = hash.chains[index];
+		}
 	}
-	return elf_error::OK;
+	return nullptr;
 }
 
 // ----------------------------------------------------------------------------
-// Templated function to read either Elf32_hdr or Elf64_hdr
-template <typename ELF_FILE_HEADER>
-	static int read_elf_header(elf& elf_data, FILE* file)
+void find_elf_relocations_at(const elf_results& results, uint64_t address, uint64_t size,
+	std::vector<const elf_relocation*>& relocations)
 {
-	ELF_FILE_HEADER hdr;
-	if (read_file(file, hdr) != 0)
-		return elf_error::ERROR_READ_FILE;
-
-	uint8_t mode = elf_data.ident.ei_data;
-	elf_data.e_type 	 = conv_endian(hdr.e_type, mode);
-	elf_data.e_machine	 = conv_endian(hdr.e_machine, mode);
-	elf_data.e_version	 = conv_endian(hdr.e_version, mode);
-	elf_data.e_entry	 = conv_endian(hdr.e_entry, mode);
-	elf_data.e_phoff	 = conv_endian(hdr.e_phoff, mode);
-	elf_data.e_shoff	 = conv_endian(hdr.e_shoff, mode);
-	elf_data.e_flags	 = conv_endian(hdr.e_flags, mode);
-	elf_data.e_ehsize	 = conv_endian(hdr.e_ehsize, mode);
-	elf_data.e_phentsize = conv_endian(hdr.e_phentsize, mode);
-	elf_data.e_phnum	 = conv_endian(hdr.e_phnum, mode);
-	elf_data.e_shentsize = conv_endian(hdr.e_shentsize, mode);
-	elf_data.e_shnum	 = conv_endian(hdr.e_shnum, mode);
-	elf_data.e_shstrndx	 = conv_endian(hdr.e_shstrndx, mode);
-	return elf_error::OK;
+	relocations.clear();
+	const std::vector<elf_relocation>& relocs = results.relocations;
+	std::vector<uint32_t>::const_iterator it = std::lower_bound(results.relocation_sites.begin(),
+		results.relocation_sites.end(), address,
+		[&relocs](uint32_t index, uint64_t addr) { return relocs[index].site < addr; });
+	for (; it != results.relocation_sites.end() && relocs[*it].site - address < size; ++it)
+		relocations.push_back(&relocs[*it]);
 }
 
 // ----------------------------------------------------------------------------
-static int process_elf_file_internal(elf& elf_data, FILE* file, elf_results& output)
+void find_elf_references(const elf_results& results, uint32_t symbol,
+	std::vector<const elf_relocation*>& relocations)
 {
-	output.sections.clear();
-	output.line_info_units.clear();
-	output.symbols.clear();
+	relocations.clear();
+	const std::vector<elf_relocation>& relocs = results.relocations;
+	std::vector<uint32_t>::const_iterator it = std::lower_bound(results.relocation_symbols.begin(),
+		results.relocation_symbols.end(), symbol,
+		[&relocs](uint32_t index, uint32_t sym) { return relocs[index].symbol < sym; });
+	for (; it != results.relocation_symbols.end() && relocs[*it].symbol == symbol; ++it)
+		relocations.push_back(&relocs[*it]);
+}
 
-	elf_data.file = file;
+// ----------------------------------------------------------------------------
+const elf_function* find_elf_function(const elf_results& results, uint64_t address)
+{
+	const elf_address_range* range = results.function_ranges.find(address);
+	return range ? &results.functions[range->value] : nullptr;
+}
 
-	int ret = read_file(file, elf_data.ident);
-	CHECK_RET(ret);
+// ----------------------------------------------------------------------------
+void find_elf_inline_stack(const elf_results& results, uint64_t address,
+	std::vector<const elf_inline*>& stack)
+{
+	stack.clear();
+	const std::vector<elf_inline_range>& ranges = results.inline_ranges;
+	std::vector<elf_inline_range>::const_iterator it = std::upper_bound(ranges.begin(), ranges.end(), address,
+		[](uint64_t addr, const elf_inline_range& r) { return addr < r.start; });
 
-	// Check header
-	static char magic[4] = { 0x7f, 'E', 'L', 'F'};
-	for (size_t i = 0; i < 4; ++i)
-		if (elf_data.ident.ei_magic[i] != magic[i])
-			return elf_error::ERROR_HEADER_MAGIC_FAIL;
+	// Any range containing the address either is the last one starting at or
+	// below it, or encloses that one. So only its parents need checking.
+	int32_t index = (int32_t)(it - ranges.begin()) - 1;
+	while (index >= 0)
+	{
+		const elf_inline_range& r = ranges[index];
+		if (address < r.end)
+			stack.push_back(&results.inlines[r.inline_index]);
+		index = r.parent;
+	}
+}
 
-	uint8_t data_class = elf_data.ident.ei_class;	// 32 bit or 64 bit
+// ----------------------------------------------------------------------------
+//	PROGRAM LOADING
+// ----------------------------------------------------------------------------
+// Check a PT_LOAD segment fits in a memory image
+static int check_image_segment(const elf_segment& segment, uint64_t image_base, uint64_t image_size)
+{
+	if (segment.vaddr < image_base || segment.mem_size > image_size ||
+		segment.vaddr - image_base > image_size - segment.mem_size)
+		return elf_error::ERROR_SEGMENT_OUTSIDE_IMAGE;
+	return elf_error::OK;
+}
 
-	// Read main ELF header variants
-	if (data_class == ELFCLASS32)
-		ret = read_elf_header<Elf32_Ehdr>(elf_data, file);
-	else if (data_class == ELFCLASS64)
-		ret = read_elf_header<Elf64_Ehdr>(elf_data, file);
-	else
-		return elf_error::ERROR_UNKNOWN_CLASS;
+// ----------------------------------------------------------------------------
+// Check all the PT_LOAD segments fit before anything is written
+static int check_image_segments(const elf_results& results, uint64_t image_base, uint64_t image_size)
+{
+	for (const elf_segment& segment : results.segments)
+	{
+		if (segment.type != PT_LOAD)
+			continue;
+		int ret = check_image_segment(segment, image_base, image_size);
+		CHECK_RET(ret);
+	}
+	return elf_error::OK;
+}
 
-	if (elf_data.e_version != EV_CURRENT)
-		return elf_error::ERROR_ELF_VERSION;
+// ----------------------------------------------------------------------------
+int get_elf_load_segments(const elf_results& results, const uint8_t* file_data,
+	uint64_t file_size, std::vector<elf_segment_view>& views)
+{
+	views.clear();
+	for (const elf_segment& segment : results.segments)
+	{
+		if (segment.type != PT_LOAD)
+			continue;
+		if (segment.offset > file_size || segment.file_size > file_size - segment.offset)
+			return elf_error::ERROR_READ_FILE;
+		elf_segment_view view;
+		view.segment = &segment;
+		view.data = file_data + segment.offset;
+		views.push_back(view);
+	}
+	return elf_error::OK;
+}
 
-	// Load the section header data itself, into a custom block
-	loaded_chunk entries_chunk;
-	ret = entries_chunk.load(file, elf_data.e_shoff, elf_data.e_shnum * elf_data.e_shentsize);
+// ----------------------------------------------------------------------------
+int load_elf_image(const elf_results& results, const uint8_t* file_data, uint64_t file_size,
+	uint8_t* image, uint64_t image_base, uint64_t image_size)
+{
+	std::vector<elf_segment_view> views;
+	int ret = get_elf_load_segments(results, file_data, file_size, views);
+	CHECK_RET(ret);
+	ret = check_image_segments(results, image_base, image_size);
 	CHECK_RET(ret);
 
-	// Create a reader for the section headers
-	element_reader sh_reader(entries_chunk.buffer, elf_data.ident.ei_data, elf_data.ident.ei_class);
-
-	// Read sections' raw information
-	elf_data.sections = new elf_section_int[elf_data.e_shnum];
-	for (uint32_t sectionId = 0; sectionId < elf_data.e_shnum; ++sectionId)
+	for (const elf_segment_view& view : views)
 	{
-		elf_section_int& s = elf_data.sections[sectionId];
-		s.sh_name       = sh_reader.readU32();
-		s.sh_type       = sh_reader.readU32();
-		s.sh_flags      = sh_reader.readAddress();
-		s.sh_addr       = sh_reader.readAddress();
-		s.sh_offset     = sh_reader.readAddress();
-		s.sh_size       = sh_reader.readAddress();
-		s.sh_link       = sh_reader.readU32();
-		s.sh_info       = sh_reader.readU32();
-		s.sh_addralign  = sh_reader.readAddress();
-		s.sh_entsize    = sh_reader.readAddress();
-		s.section_id	= sectionId;
-		if (sh_reader.errored())
-			return elf_error::ERROR_READ_FILE;
+		const elf_segment& segment = *view.segment;
+		uint8_t* dest = image + (segment.vaddr - image_base);
+		uint64_t copy_size = std::min(segment.file_size, segment.mem_size);
+		memcpy(dest, view.data, copy_size);
+		memset(dest + copy_size, 0, segment.mem_size - copy_size);
 	}
+	return elf_error::OK;
+}
 
-	// Load the section with the section's name strings in
-	ret = elf_data.load_section(elf_data.e_shstrndx);
+// ----------------------------------------------------------------------------
+int read_elf_image(FILE* file, const elf_results& results,
+	uint8_t* image, uint64_t image_base, uint64_t image_size)
+{
+	int ret = check_image_segments(results, image_base, image_size);
 	CHECK_RET(ret);
 
-	// Now read the section names
-	element_reader name_reader = elf_data.create_reader(elf_data.e_shstrndx);
-	for (uint32_t sectionId = 0; sectionId < elf_data.e_shnum; ++sectionId)
+	for (const elf_segment& segment : results.segments)
 	{
-		elf_section_int& s = elf_data.sections[sectionId];
+		if (segment.type != PT_LOAD)
+			continue;
+		uint8_t* dest = image + (segment.vaddr - image_base);
+		uint64_t copy_size = std::min(segment.file_size, segment.mem_size);
+		if (copy_size)
+		{
+			fseek(file, segment.offset, SEEK_SET);
+			if (fread(dest, 1, copy_size, file) != copy_size)
+				return elf_error::ERROR_READ_FILE;
+		}
+		memset(dest + copy_size, 0, segment.mem_size - copy_size);
+	}
+	return elf_error::OK;
+}
 
-		// Jump into the section with strings and read a string
-		name_reader.set(s.sh_name);
-		std::string section_name = name_reader.read_null_term_string();
-		s.name_string = section_name;
-		if (name_reader.errored())
-			return elf_error::ERROR_READ_FILE;
+// ----------------------------------------------------------------------------
+//	SINGLE ADDRESS LOOKUP
+// ----------------------------------------------------------------------------
+// The first amount of data to read when the size needed isn't known
+static const uint64_t LOOKUP_WINDOW_SIZE = 4096;
 
-		// Copy to results now the name is known.
-		elf_section result_sec = {};
-		result_sec.section_id  = s.section_id;
-		result_sec.name_string = s.name_string;
-		result_sec.offset      = s.sh_offset;
-		result_sec.size        = s.sh_size;
-		result_sec.type        = s.sh_type;
-		result_sec.flags       = s.sh_flags;
-		result_sec.addr        = s.sh_addr;
-		output.sections.push_back(result_sec);			
+// ----------------------------------------------------------------------------
+// Read the header and root DIE of the unit at "offset" in .debug_info. Only
+// the data needed is read from the file, growing the windows read as needed.
+static int read_unit_root(dwarf_context& ctx, const elf_section_int& info, const elf_section_int& abbrevs,
+	uint64_t offset, dwarf_unit& unit, die_info& die)
+{
+	elf& elf_data = ctx.elf_data;
+	uint64_t debug_abbrev_offset;
+	abbrev_table table;
+	bool have_table = false;
+	loaded_chunk info_chunk;
+	loaded_chunk abbrev_chunk;
+	bool complete;
+	int ret;
+
+	for (uint64_t size = LOOKUP_WINDOW_SIZE; ; size *= 4)
+	{
+		ret = load_section_window(elf_data, info, offset, size, info_chunk, complete);
+		CHECK_RET(ret);
+		element_reader eread(info_chunk.buffer, elf_data.ident.ei_data, elf_data.ident.ei_class);
+		ret = read_unit_header_fields(unit, debug_abbrev_offset, eread);
+		if (ret == elf_error::OK && !have_table)
+		{
+			// The table must be read in full before it can be used
+			for (uint64_t abbrev_size = LOOKUP_WINDOW_SIZE; ; abbrev_size *= 4)
+			{
+				ret = load_section_window(elf_data, abbrevs, debug_abbrev_offset, abbrev_size,
+					abbrev_chunk, complete);
+				CHECK_RET(ret);
+				element_reader abbrev_read(abbrev_chunk.buffer, elf_data.ident.ei_data, elf_data.ident.ei_class);
+				table = abbrev_table();
+				ret = parse_abbrev_table(abbrev_read, table);
+				if (ret == elf_error::OK || complete)
+					break;
+			}
+			CHECK_RET(ret);
+			have_table = true;
+		}
+		if (ret == elf_error::OK)
+		{
+			unit.abbrevs = &table;
+			uint64_t code = eread.readULEB128();
+			if (code == 0 || code >= table.codes.size() || table.codes[code].tag == 0)
+				ret = elf_error::ERROR_DWARF_UNKNOWN_ABBREV;
+			else
+				ret = read_die(die, table.codes[code], ctx, unit, eread);
+		}
+		// Only retry if the data could have been cut off by the window size
+		if (ret != elf_error::ERROR_DWARF_DEBUGINFO_PARSE || complete)
+			break;
 	}
+	CHECK_RET(ret);
 
-	elf_section_int* debug_info_section = load_named_section(elf_data, ".debug_info");
-	if (debug_info_section)
+	// Convert the offsets to be within the section
+	unit.offset += offset;
+	unit.end += offset;
+	unit.abbrevs = nullptr;
+	unit.str_offsets_base = die.str_offsets_base;
+	unit.addr_base = die.addr_base;
+	unit.rnglists_base = die.rnglists_base;
+	unit.base_address = die.has_low_pc ? die.low_pc : 0;
+	die.offset = offset;
+	die.name = die.linkage_name = nullptr;	// pointed into the window
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// Set up a context for reading single DIEs. The sections are only loaded if
+// a range list is read.
+static void init_lookup_context(dwarf_context& ctx)
+{
+	ctx.str_offsets = find_named_section(ctx.elf_data, ".debug_str_offsets");
+	ctx.addr = find_named_section(ctx.elf_data, ".debug_addr");
+	ctx.ranges = find_named_section(ctx.elf_data, ".debug_ranges");
+	ctx.rnglists = find_named_section(ctx.elf_data, ".debug_rnglists");
+}
+
+// ----------------------------------------------------------------------------
+// Find the offset in .debug_info of the unit containing "address" without
+// loading the whole of .debug_info.
+static int find_address_unit(elf& elf_data, uint64_t address, uint64_t& unit_offset)
+{
+	const elf_section_int* aranges = load_named_section(elf_data, ".debug_aranges");
+	if (aranges)
 	{
-		ret = parse_section_debug_info(elf_data, *debug_info_section);
+		// This is usually tiny compared with the other debug sections
+		elf_range_map ranges;
+		element_reader eread = elf_data.create_reader(aranges->section_id);
+		int ret = parse_aranges(eread, aranges->sh_size, ranges);
 		CHECK_RET(ret);
+		const elf_address_range* range = ranges.find(address);
+		if (range)
+		{
+			unit_offset = range->value;
+			return elf_error::OK;
+		}
+		// .debug_aranges need not cover every unit, e.g. those from
+		// assembler sources or other compilers
 	}
 
-	const elf_section_int* debug_line_section = load_named_section(elf_data, ".debug_line");
-	if (debug_line_section)
+	// Otherwise check the root DIE of each unit in turn
+	const elf_section_int* info = find_named_section(elf_data, ".debug_info");
+	const elf_section_int* abbrevs = find_named_section(elf_data, ".debug_abbrev");
+	if (!info || !abbrevs)
+		return elf_error::ERROR_ADDRESS_NOT_FOUND;
+	dwarf_context ctx(elf_data);
+	init_lookup_context(ctx);
+	address_ranges ranges;
+	uint64_t offset = 0;
+	while (offset < info->sh_size)
 	{
-		ret = parse_section_debug_line(output, elf_data, *debug_line_section);
+		dwarf_unit unit;
+		die_info die;
+		int ret = read_unit_root(ctx, *info, *abbrevs, offset, unit, die);
 		CHECK_RET(ret);
+		if (get_die_ranges(ctx, unit, die, ranges) == elf_error::OK)
+		{
+			for (const std::pair<uint64_t, uint64_t>& r : ranges)
+			{
+				if (address >= r.first && address < r.second)
+				{
+					unit_offset = offset;
+					return elf_error::OK;
+				}
+			}
+		}
+		offset = unit.end;
 	}
+	return elf_error::ERROR_ADDRESS_NOT_FOUND;
+}
 
-	for (uint32_t sectionId = 0; sectionId < elf_data.e_shnum; ++sectionId)
+// ----------------------------------------------------------------------------
+int lookup_elf_address(FILE* file, uint64_t address, compilation_unit& unit, size_t& point_index)
+{
+	elf elf_data;
+	elf_data.read_strings_directly = true;
+	int ret = read_elf_sections(elf_data, file);
+
+	// Find the line program of the unit
+	uint64_t unit_offset = 0;
+	if (ret == elf_error::OK)
+		ret = find_address_unit(elf_data, address, unit_offset);
+
+	const elf_section_int* info = find_named_section(elf_data, ".debug_info");
+	const elf_section_int* abbrevs = find_named_section(elf_data, ".debug_abbrev");
+	const elf_section_int* lines = find_named_section(elf_data, ".debug_line");
+	if (ret == elf_error::OK && (!info || !abbrevs || !lines))
+		ret = elf_error::ERROR_ADDRESS_NOT_FOUND;
+
+	dwarf_context ctx(elf_data);
+	init_lookup_context(ctx);
+	dwarf_unit cu;
+	die_info die;
+	if (ret == elf_error::OK)
+		ret = read_unit_root(ctx, *info, *abbrevs, unit_offset, cu, die);
+	if (ret == elf_error::OK && !die.has_stmt_list)
+		ret = elf_error::ERROR_ADDRESS_NOT_FOUND;
+
+	// Read just the unit's part of .debug_line, after finding its length
+	loaded_chunk chunk;
+	bool complete;
+	if (ret == elf_error::OK)
+		ret = load_section_window(elf_data, *lines, die.stmt_list, 12, chunk, complete);
+	if (ret == elf_error::OK)
 	{
-		const elf_section_int& s = elf_data.sections[sectionId];
-		// Move to section start
-		if (s.sh_type == SHT_SYMTAB)
+		element_reader length_read(chunk.buffer, elf_data.ident.ei_data, elf_data.ident.ei_class);
+		bool is64bit = false;
+		uint64_t unit_length = length_read.read_ptrsize(is64bit);
+		uint64_t size = length_read.get_pos() + unit_length;
+		if (length_read.errored() || size > lines->sh_size - die.stmt_list)
+			ret = elf_error::ERROR_DWARF_DEBUGLINE_PARSE;
+		else
+			ret = load_section_window(elf_data, *lines, die.stmt_list, size, chunk, complete);
+	}
+	if (ret == elf_error::OK)
+	{
+		element_reader eread(chunk.buffer, elf_data.ident.ei_data, elf_data.ident.ei_class);
+		unit = compilation_unit();
+		ret = parse_line_unit(unit, elf_data, eread, cu.str_offsets_base);
+	}
+
+	// Choose the last code point at or below the address, preferring the
+	// start of a sequence to the end of another at the same address
+	if (ret == elf_error::OK)
+	{
+		ret = elf_error::ERROR_ADDRESS_NOT_FOUND;
+		for (size_t i = 0; i < unit.points.size(); ++i)
 		{
-			ret = parse_section_symbol(output, elf_data, s);
-			CHECK_RET(ret);
+			uint64_t point_address = unit.points[i].address;
+			if (point_address > address)
+				continue;
+			if (ret != elf_error::OK || point_address > unit.points[point_index].address ||
+				(point_address == unit.points[point_index].address && !unit.is_sequence_end(i)))
+			{
+				point_index = i;
+				ret = elf_error::OK;
+			}
 		}
+		if (ret == elf_error::OK && unit.is_sequence_end(point_index))
+			ret = elf_error::ERROR_ADDRESS_NOT_FOUND;
 	}
-	return elf_error::OK;
+	delete [] elf_data.sections;
+	return ret;
 }
 
 // ----------------------------------------------------------------------------
-int process_elf_file(FILE* file, elf_results& output)
+int decode_elf_line_program(FILE* file, const elf_line_program& program, compilation_unit& unit)
 {
+	elf elf_data;
+	elf_data.read_strings_directly = true;
+	int ret = read_elf_sections(elf_data, file);
+
+	const elf_section_int* lines = find_named_section(elf_data, ".debug_line");
+	if (ret == elf_error::OK && (!lines || program.size > lines->sh_size ||
+		program.offset > lines->sh_size - program.size))
+		ret = elf_error::ERROR_DWARF_DEBUGLINE_PARSE;
+
+	loaded_chunk chunk;
+	bool complete;
+	if (ret == elf_error::OK)
+		ret = load_section_window(elf_data, *lines, program.offset, program.size, chunk, complete);
+	if (ret == elf_error::OK)
+	{
+		element_reader eread(chunk.buffer, elf_data.ident.ei_data, elf_data.ident.ei_class);
+		unit = compilation_unit();
+		ret = parse_line_unit(unit, elf_data, eread, program.str_offsets_base);
+	}
+	delete [] elf_data.sections;
+	return ret;
+}
+
+// ----------------------------------------------------------------------------
+int reload_elf_file(FILE* file, const elf_results& previous,
+	elf_results& output, elf_reload_report& report)
+{
+	report.units_reused = 0;
+	report.symbols_reused = 0;
+	report.changed_units.clear();
+	report.moved_symbols.clear();
+
+	reload_context reload;
+	reload.previous = &previous;
+	reload.report = &report;
+	reload.strings_match = false;
+	reload.names_match = false;
+	reload.next_slice = 0;
+	for (size_t i = 0; i < previous.hashes.line_units.size(); ++i)
+		reload.prev_units[previous.hashes.line_units[i]] = i;
+
 	elf elf_data;
 	elf_data.sections = nullptr;
 
-	int ret = process_elf_file_internal(elf_data, file, output);
+	elf_parse_options options;
+	parse_progress progress(options);
+	int ret = process_elf_file_internal(elf_data, file, output, &reload, progress);
 	delete [] elf_data.sections;
+	if (ret == elf_error::OK)
+		find_moved_symbols(previous, output, report.moved_symbols);
 	return ret;
 }
 
@@ -1,6 +1,7 @@
 #ifndef FONDA_LIB_READELF_H
 #define FONDA_LIB_READELF_H
 
+#include <functional>
 #include "lineinfo.h"
 
 namespace fonda
@@ -17,6 +18,27 @@ struct elf_section
 	uint64_t 		addr;			// address offset
 };
 
+// ----------------------------------------------------------------------------
+// A program header
+struct elf_segment
+{
+	uint32_t		type;			// one of PT_*
+	uint32_t		flags;			// bitfield of PF_*
+	uint64_t		offset;			// position of the segment data in the elf file
+	uint64_t		vaddr;
+	uint64_t		paddr;
+	uint64_t		file_size;		// bytes in the file
+	uint64_t		mem_size;		// bytes in memory. Any after file_size are zeroed (bss).
+	uint64_t		align;
+};
+
+// ----------------------------------------------------------------------------
+// The file data of a PT_LOAD segment
+struct elf_segment_view
+{
+	const elf_segment*	segment;
+	const uint8_t*		data;		// segment->file_size bytes, within the caller's copy of the file
+};
 
 // ----------------------------------------------------------------------------
 struct elf_symbol
@@ -34,12 +56,249 @@ struct elf_symbol
 	std::string section_type;
 };
 
+// ----------------------------------------------------------------------------
+// The symbol hash table of the dynamic symbols, from .gnu.hash or .hash,
+// for name lookups without building an index.
+struct elf_symbol_hash
+{
+	uint32_t				type;			// SHT_GNU_HASH, SHT_HASH, or SHT_NULL if there is none
+	std::vector<uint32_t>	buckets;
+	std::vector<uint32_t>	chains;			// .gnu.hash: hashes of the symbols from "symoffset"
+	std::vector<uint64_t>	bloom;			// .gnu.hash only
+	uint32_t				symoffset;		// .gnu.hash: first symbol in the table
+	uint32_t				bloom_shift;	// .gnu.hash only
+	uint32_t				bloom_bits;		// .gnu.hash: bits per bloom word, 32 or 64
+};
+
+// ----------------------------------------------------------------------------
+// An entry of a SHT_REL or SHT_RELA section
+struct elf_relocation
+{
+	uint64_t		site;			// address patched (r_offset, plus the section address in ET_REL files)
+	uint32_t		type;			// machine-specific R_* type
+	uint32_t		symbol;			// index in elf_results::symbols, or ~0U if none or not loaded
+	int64_t			addend;			// 0 for SHT_REL, where the addend is in the patched data
+	uint32_t		section_id;		// the relocation section
+	uint32_t		target_section;	// section being patched (sh_info), or 0 for dynamic relocations
+};
+
+// ----------------------------------------------------------------------------
+// A function with code, from a DW_TAG_subprogram entry in .debug_info
+struct elf_function
+{
+	std::string		name;			// linkage name if there is one, else the plain name
+	uint64_t		low_pc;			// lowest address of any of the function's ranges
+	uint64_t		high_pc;		// first address after the highest range
+	uint64_t		unit_offset;	// offset of the owning unit in .debug_info
+};
+
+// ----------------------------------------------------------------------------
+// A function inlined into another, from a DW_TAG_inlined_subroutine entry
+struct elf_inline
+{
+	std::string		name;			// of the inlined function, as for elf_function
+	uint64_t		unit_offset;	// offset of the owning unit in .debug_info
+	uint32_t		line_unit;		// index in line_info_units of the unit's line program, or ~0U
+	uint32_t		call_file;		// index in that unit's files of the call site
+	uint32_t		call_line;
+	uint32_t		call_column;
+};
+
+// ----------------------------------------------------------------------------
+// One address range of an inlined function. The ranges of inlined functions
+// nest within each other, like the entries themselves.
+struct elf_inline_range
+{
+	uint64_t		start;
+	uint64_t		end;			// first address after the range
+	uint32_t		inline_index;	// index in elf_results::inlines
+	int32_t			parent;			// index in inline_ranges of the range this is inside, or -1
+};
+
+// ----------------------------------------------------------------------------
+// An address interval mapped to a value, e.g. a unit offset
+struct elf_address_range
+{
+	uint64_t		start;
+	uint64_t		end;			// first address after the range
+	uint64_t		value;
+};
+
+// ----------------------------------------------------------------------------
+// Sorted, non-overlapping address intervals. Used for code which needn't be
+// contiguous, such as units and functions described by DW_AT_ranges.
+struct elf_range_map
+{
+	std::vector<elf_address_range> ranges;	// sorted by start after build()
+
+	void add(uint64_t start, uint64_t end, uint64_t value);
+
+	// Sort the ranges, and merge ranges with the same value that overlap or
+	// touch. Where ranges with different values overlap, the one starting
+	// later wins the overlap, and the earlier one keeps the rest.
+	void build();
+
+	// Returns nullptr if no range contains the address
+	const elf_address_range* find(uint64_t address) const;
+};
+
+// ----------------------------------------------------------------------------
+// A Common Information Entry from .debug_frame or .eh_frame
+struct elf_cfi_cie
+{
+	uint64_t		code_align;
+	int64_t			data_align;
+	uint32_t		return_register;	// column holding the return address
+	uint8_t			address_size;
+	uint8_t			pointer_encoding;	// DW_EH_PE_* of addresses, absptr in .debug_frame
+	bool			signal_frame;		// from the 'S' augmentation
+	uint64_t		instructions;		// offset of the initial instructions in elf_cfi::instructions
+	uint64_t		instructions_size;
+};
+
+// ----------------------------------------------------------------------------
+// A Frame Description Entry: how to unwind one range of code
+struct elf_cfi_fde
+{
+	uint64_t		start;
+	uint64_t		end;				// first address after the range
+	uint32_t		cie_index;			// index in elf_cfi::cies
+	uint64_t		instructions;		// offset in elf_cfi::instructions
+	uint64_t		instructions_size;
+};
+
+// ----------------------------------------------------------------------------
+// The entries of .debug_frame and .eh_frame. Entries in .debug_frame are
+// preferred where both describe the same code.
+struct elf_cfi
+{
+	std::vector<elf_cfi_cie>		cies;
+	std::vector<elf_cfi_fde>		fdes;			// sorted by start, not overlapping
+	std::vector<uint8_t>			instructions;	// of all the entries, copied from the file
+	uint8_t							data_mode;		// ELFDATA2LSB or ELFDATA2MSB
+};
+
+// ----------------------------------------------------------------------------
+namespace cfi_rule
+{
+	enum
+	{
+		UNDEFINED,					// can't be recovered
+		SAME_VALUE,					// unchanged in the caller
+		OFFSET,						// saved at CFA + offset
+		VAL_OFFSET,					// the value is CFA + offset; for the CFA, "reg" + offset
+		REGISTER,					// saved in register "reg"
+		EXPRESSION,					// saved at the address computed by a DWARF expression
+		VAL_EXPRESSION,				// the value is computed by a DWARF expression
+	};
+}
+
+// ----------------------------------------------------------------------------
+// How to recover one register (column) of the caller
+struct elf_cfi_rule
+{
+	uint32_t		column;
+	uint8_t			type;				// one of cfi_rule
+	uint32_t		reg;
+	int64_t			offset;
+	uint64_t		expression;			// offset of the expression in elf_cfi::instructions
+	uint64_t		expression_size;
+};
+
+// ----------------------------------------------------------------------------
+// The rules for a range of addresses within an FDE
+struct elf_cfi_row
+{
+	uint64_t		start;
+	uint64_t		end;				// first address after the range
+	elf_cfi_rule	cfa;				// VAL_OFFSET or VAL_EXPRESSION
+	uint32_t		first_rule;			// index in elf_cfi_table::rules
+	uint32_t		num_rules;			// columns without a rule are unchanged
+};
+
+// ----------------------------------------------------------------------------
+// The decoded instructions of one FDE, as flat rows of rules.
+struct elf_cfi_table
+{
+	std::vector<elf_cfi_row>		rows;			// sorted by start
+	std::vector<elf_cfi_rule>		rules;			// sorted by column within each row
+};
+
+// ----------------------------------------------------------------------------
+// Where a unit's line program is in .debug_line, so it can be decoded later
+// with decode_elf_line_program().
+struct elf_line_program
+{
+	uint64_t		offset;				// of the unit header in .debug_line
+	uint64_t		size;				// of the header and opcodes
+	uint64_t		str_offsets_base;	// DW_AT_str_offsets_base of the owning unit
+	uint64_t		unit_offset;		// of the owning unit in .debug_info, or ~0ULL if unknown
+};
+
+// ----------------------------------------------------------------------------
+// A hashed run of entries from the symbol table.
+struct elf_hash_slice
+{
+	uint64_t hash;
+	uint32_t first;				// index of first entry in elf_results::symbols
+	uint32_t count;
+};
+
+// Hashes of the raw file data that the results were built from. These are
+// used by reload_elf_file() to find out which parts of a file have changed.
+struct elf_content_hashes
+{
+	uint64_t						section_names;	// all section names, in order
+	uint64_t						line_strings;	// .debug_line_str, .debug_str and .debug_str_offsets
+	std::vector<uint64_t>			line_units;		// one per entry in line_info_units
+	std::vector<uint64_t>			symbol_strings;	// string table of each symbol table
+	std::vector<elf_hash_slice>		symbol_slices;
+};
+
 // ----------------------------------------------------------------------------
 struct elf_results
 {
+	uint64_t						entry;			// e_entry
 	std::vector<elf_section>		sections;
+	std::vector<elf_segment>		segments;		// all program headers, in file order
 	std::vector<compilation_unit>	line_info_units;
+	std::vector<elf_line_program>	line_programs;	// with elf_parts::LINE_PROGRAMS, in file order
 	std::vector<elf_symbol>			symbols;
+	std::vector<elf_symbol>			dynamic_symbols;	// from SHT_DYNSYM
+	elf_symbol_hash					dynamic_hash;
+	std::vector<elf_relocation>		relocations;	// in file order
+	std::vector<uint32_t>			relocation_sites;	// indices in relocations patching allocated sections, by site
+	std::vector<uint32_t>			relocation_symbols;	// indices in relocations with a symbol, by symbol then site
+	std::vector<elf_function>		functions;		// sorted by low_pc
+	elf_range_map					function_ranges;	// value is the index in functions
+	elf_range_map					unit_ranges;	// value is the unit offset in .debug_info
+	std::vector<elf_inline>			inlines;
+	std::vector<elf_inline_range>	inline_ranges;	// sorted by start, enclosing ranges first
+	elf_cfi							cfi;
+	elf_content_hashes				hashes;
+	std::string						debuglink;		// file named by .gnu_debuglink, or empty
+	uint32_t						debuglink_crc;	// CRC32 of that file
+	std::vector<uint8_t>			build_id;		// from the NT_GNU_BUILD_ID note, or empty
+};
+
+// ----------------------------------------------------------------------------
+// A function or object symbol that has changed address or size after a reload.
+struct elf_moved_symbol
+{
+	std::string name;
+	uint64_t old_address;
+	uint64_t old_size;
+	uint64_t new_address;
+	uint64_t new_size;
+};
+
+// ----------------------------------------------------------------------------
+struct elf_reload_report
+{
+	size_t units_reused;					// line units copied from the previous results
+	size_t symbols_reused;					// symbols copied from the previous results
+	std::vector<size_t> changed_units;		// indices of re-parsed units in the new line_info_units
+	std::vector<elf_moved_symbol> moved_symbols;
 };
 
 // ----------------------------------------------------------------------------
@@ -54,17 +313,148 @@ namespace elf_error
 		ERROR_UNKNOWN_CLASS = 4,					// Neither LSB or MSB mode in header
 		ERROR_INVALID_SECTION = 5,					// Tried to access an invalid section number
 		ERROR_DWARF_VERSION_TOO_NEW = 6,			// DWARF version is greater than 5
+		ERROR_ADDRESS_NOT_FOUND = 7,				// No unit or line information covers the address
+		ERROR_SEGMENT_OUTSIDE_IMAGE = 8,			// A loadable segment doesn't fit in the memory image
+		ERROR_CANCELLED = 9,						// The progress callback asked to stop
 
 		ERROR_DWARF_UNKNOWN_OPCODE = 1000,			// Dwarf main opcode not recognised
 		ERROR_DWARF_UNKNOWN_EXTENDED_OPCODE = 1001,	// Dwarf extended opcode not recognised
 		ERROR_DWARF_DEBUGLINE_PARSE = 1002,			// Over-read expected bounds of .debug_line data
 		ERROR_DWARF_UNKNOWN_CONTENT_FORM = 1003,	// One of DW_FORM not supported
 		ERROR_DWARF_UNKNOWN_CONTENT_TYPE = 1004,	// One of DW_TYPE not supported
+		ERROR_DWARF_DEBUGINFO_PARSE = 1005,			// Over-read expected bounds of .debug_info data
+		ERROR_DWARF_UNKNOWN_ABBREV = 1006,			// Entry uses an abbreviation code not in .debug_abbrev
+		ERROR_DWARF_DEBUGARANGES_PARSE = 1007,		// Over-read expected bounds of .debug_aranges data
+		ERROR_DWARF_FRAME_PARSE = 1008,				// Bad entry in .debug_frame or .eh_frame
+	};
+}
+
+// ----------------------------------------------------------------------------
+// Parts of a file process_elf_file() can decode. Section and segment headers,
+// and .debug_aranges, are always read.
+namespace elf_parts
+{
+	enum
+	{
+		SYMBOLS = 1 << 0,			// .symtab, .dynsym and the dynamic hash table
+		DEBUG_INFO = 1 << 1,		// functions, inlines and unit ranges from .debug_info
+		LINES = 1 << 2,				// .debug_line
+		FRAMES = 1 << 3,			// .eh_frame and .debug_frame
+		RELOCATIONS = 1 << 4,		// SHT_REL and SHT_RELA sections (needs SYMBOLS)
+		ALL = 0x1f,
+
+		// Only record where each line program is, without decoding it. Use
+		// with DEBUG_INFO, which links the programs to their units.
+		LINE_PROGRAMS = 1 << 5
 	};
 }
 
+// ----------------------------------------------------------------------------
+// What process_elf_file() should decode, and how to report on it
+struct elf_parse_options
+{
+	elf_parse_options() :
+		parts(elf_parts::ALL),
+		symbols_from(nullptr)
+	{}
+
+	uint32_t					parts;			// elf_parts flags
+
+	// If not empty, only these units of .debug_info (by offset, see
+	// elf_results::unit_ranges) and their line programs are decoded
+	std::vector<uint64_t>		units;
+
+	// With SYMBOLS, copy the symbols, dynamic symbols and hash table from
+	// these results of an earlier parse of the same file instead of
+	// decoding them again, e.g. to add parts to a SYMBOLS-only parse.
+	const elf_results*			symbols_from;
+
+	// Called as the work proceeds, with the number of section bytes decoded
+	// so far and the total to decode. Return false to stop, which makes
+	// process_elf_file() return ERROR_CANCELLED.
+	std::function<bool(uint64_t done, uint64_t total)> progress;
+};
+
 // ----------------------------------------------------------------------------
 extern int process_elf_file(FILE* file, elf_results& output);
 
+// As above, decoding only the parts given in the options. Parts not decoded
+// are left empty; a separate debug file is only looked for with DEBUG_INFO
+// or LINES.
+extern int process_elf_file(FILE* file, elf_results& output, const elf_parse_options& options);
+
+// Get views of the PT_LOAD segments over a copy of the whole file, e.g. from
+// mmap(). Nothing is copied.
+extern int get_elf_load_segments(const elf_results& results, const uint8_t* file_data,
+	uint64_t file_size, std::vector<elf_segment_view>& views);
+
+// Copy the PT_LOAD segments into a memory image covering the addresses
+// [image_base, image_base + image_size), by virtual address, and zero the
+// bss part of each. The rest of the image is left alone.
+extern int load_elf_image(const elf_results& results, const uint8_t* file_data, uint64_t file_size,
+	uint8_t* image, uint64_t image_base, uint64_t image_size);
+
+// As load_elf_image(), reading the segment data from the file straight into the image
+extern int read_elf_image(FILE* file, const elf_results& results,
+	uint8_t* image, uint64_t image_base, uint64_t image_size);
+
+// CRC32 as used by .gnu_debuglink. Pass 0 to start, or the previous result
+// to continue.
+extern uint32_t elf_crc32(uint32_t crc, const uint8_t* data, uint64_t size);
+
+// Find the separate debug file of "fname", whose results are given, by
+// build ID ("<debug dir>/.build-id/xx/yyyy.debug") then by .gnu_debuglink
+// (next to the file, in its ".debug" directory, then under each debug dir).
+// A debuglink match must have the right CRC. Returns false if none is found.
+extern bool find_elf_debug_file(const elf_results& results, const std::string& fname,
+	const std::vector<std::string>& debug_dirs, std::string& debug_fname);
+
+// Find a dynamic symbol by name using the file's own hash table, so no index
+// is needed. Returns nullptr if it isn't found or there is no hash table.
+extern const elf_symbol* find_elf_dynamic_symbol(const elf_results& results, const char* name);
+
+// Find the relocations patching any of [address, address + size)
+extern void find_elf_relocations_at(const elf_results& results, uint64_t address, uint64_t size,
+	std::vector<const elf_relocation*>& relocations);
+
+// Find the relocations referring to a symbol, i.e. what references it.
+// "symbol" is an index in results.symbols.
+extern void find_elf_references(const elf_results& results, uint32_t symbol,
+	std::vector<const elf_relocation*>& relocations);
+
+// Find the function containing "address" in output.functions, or nullptr
+extern const elf_function* find_elf_function(const elf_results& results, uint64_t address);
+
+// Find the functions inlined at "address", innermost first. The call site of
+// each is in the function after it in the stack, or the function from
+// find_elf_function() for the last one. Takes O(log n + depth) time.
+extern void find_elf_inline_stack(const elf_results& results, uint64_t address,
+	std::vector<const elf_inline*>& stack);
+
+// Find the FDE covering "address", or nullptr
+extern const elf_cfi_fde* find_elf_fde(const elf_cfi& cfi, uint64_t address);
+
+// Run the instructions of an FDE and its CIE to build its table of rules.
+// This is relatively slow, so the tables are best cached (see frame_index).
+extern int decode_elf_cfi(const elf_cfi& cfi, const elf_cfi_fde& fde, elf_cfi_table& table);
+
+// Find the line information for a single address while reading as little of
+// the file as possible: the owning unit is found from .debug_aranges (or the
+// unit headers when that is missing or does not cover the address) and only
+// its line program is decoded.
+// For many lookups, use process_elf_file() and an index instead.
+// On success "point_index" is the entry of unit.points covering the address.
+extern int lookup_elf_address(FILE* file, uint64_t address,
+	compilation_unit& unit, size_t& point_index);
+
+// Decode one line program recorded with elf_parts::LINE_PROGRAMS, reading
+// only its part of .debug_line and the strings it uses.
+extern int decode_elf_line_program(FILE* file, const elf_line_program& program, compilation_unit& unit);
+
+// Re-read a rebuilt file, reusing any line units and symbol table slices that
+// are unchanged since "previous" was parsed. "output" must not be "previous".
+extern int reload_elf_file(FILE* file, const elf_results& previous,
+	elf_results& output, elf_reload_report& report);
+
 }
 #endif
@@ -1,5 +1,8 @@
 #include "readtos.h"
 
+#include <algorithm>
+#include <string.h>
+
 namespace fonda
 {
 // ----------------------------------------------------------------------------
@@ -104,23 +107,6 @@ private:
 
 // ----------------------------------------------------------------------------
 //	TOS EXECUTABLE READING
-// ----------------------------------------------------------------------------
-struct tos_header
-{
-   //  See http://toshyp.atari.org/en/005005.html for TOS header details
-	uint16_t  ph_branch;	  /* Branch to start of the program  */
-							  /* (must be 0x601a!)			   */
-
-	uint32_t  ph_tlen;		  /* Length of the TEXT segment	  */
-	uint32_t  ph_dlen;		  /* Length of the DATA segment	  */
-	uint32_t  ph_blen;		  /* Length of the BSS segment	   */
-	uint32_t  ph_slen;		  /* Length of the symbol table	  */
-	uint32_t  ph_res1;		  /* Reserved, should be 0;		  */
-							  /* Required by PureC			   */
-	uint32_t  ph_prgflags;	  /* Program flags				   */
-	uint16_t  ph_absflag;	  /* 0 = Relocation info present	 */
-};
-
 // ----------------------------------------------------------------------------
 //	DEBUG LINE READING
 // ----------------------------------------------------------------------------
@@ -139,9 +125,20 @@ static int read_string(buffer_reader& buf, uint32_t length, std::string& str)
 }
 
 // ----------------------------------------------------------------------------
-// Read hunk of "LINE" format line information.
-// This is a simple set of "line", "pc" 8-byte structures
-static int read_debug_line_info(buffer_reader& buf, fonda::compilation_unit& cu, uint32_t offset)
+// Big-endian reads from memory already bounds-checked by the caller
+static inline uint32_t get_word(const uint8_t* p)
+{
+	return ((uint32_t)p[0] << 8) | p[1];
+}
+
+static inline uint32_t get_long(const uint8_t* p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// ----------------------------------------------------------------------------
+// Read the filename at the start of a LINE or HCLN hunk and add it to the unit
+static int read_hunk_file(buffer_reader& buf, fonda::compilation_unit& cu, size_t& file_index)
 {
 	// Filename length is stored as divided by 4
 	uint32_t flen;
@@ -152,31 +149,40 @@ static int read_debug_line_info(buffer_reader& buf, fonda::compilation_unit& cu,
 	if (read_string(buf, flen, fname))
 		return tos_error::ERROR_READ_EOF;
 
-	size_t file_index = cu.files.size();
+	file_index = cu.files.size();
 	compilation_unit::file f;
 	f.dir_index = 0;
 	f.length = 0;
 	f.timestamp = 0;
 	f.path = fname.c_str();
 	cu.files.push_back(f);
+	return tos_error::OK;
+}
 
-	// Calculate remaining number of structures to read
+// ----------------------------------------------------------------------------
+// Read hunk of "LINE" format line information.
+// This is a simple set of "line", "pc" 8-byte structures
+static int read_debug_line_info(buffer_reader& buf, fonda::compilation_unit& cu, uint32_t offset)
+{
+	size_t file_index;
+	int ret = read_hunk_file(buf, cu, file_index);
+	if (ret != tos_error::OK)
+		return ret;
+
+	// Calculate remaining number of structures to read. The whole block is
+	// in bounds, so is decoded directly.
 	uint32_t numlines = buf.get_remain() / 8;
-	while (numlines)
-	{
-		uint32_t line, pc;
-		if (buf.read_long(line))
-			return tos_error::ERROR_READ_EOF;
-		if (buf.read_long(pc))
-			return tos_error::ERROR_READ_EOF;
+	const uint8_t* p = buf.get_data();
+	buf.advance(numlines * 8);
 
-		code_point cp;
-		cp.address = pc + offset;
-		cp.column = 0;
-		cp.file_index = file_index;
-		cp.line = line;
+	code_point cp;
+	cp.column = 0;
+	cp.file_index = file_index;
+	for (; numlines; --numlines, p += 8)
+	{
+		cp.line = get_long(p);
+		cp.address = get_long(p + 4) + offset;
 		cu.points.push_back(cp);
-		--numlines;
 	}
 	return tos_error::OK;
 }
@@ -210,47 +216,81 @@ static int read_hcln_long(buffer_reader& buf, uint32_t& val)
 	return buf.read_long(val);
 }
 
+// ----------------------------------------------------------------------------
+// As read_hcln_long, without bounds checks. Returns the byte after the value.
+static inline const uint8_t* get_hcln_long(const uint8_t* p, uint32_t& val)
+{
+	if (p[0])
+	{
+		val = p[0];
+		return p + 1;
+	}
+	val = get_word(p + 1);
+	if (val)
+		return p + 3;
+	val = get_long(p + 3);
+	return p + 7;
+}
+
+// Longest encoding of a line/PC pair
+static const uint32_t HCLN_MAX_ENTRY_SIZE = 2 * 7;
+
 // ----------------------------------------------------------------------------
 // Read hunk of "HCLN" (HiSoft Compressed Line Number) format line information.
+// Lines and PCs are stored as deltas from the previous entry.
 static int read_debug_hcln_info(buffer_reader& buf, fonda::compilation_unit& cu, uint32_t offset)
 {
-	uint32_t flen, numlines;
-	// Filename length is stored as divided by 4
-	if (buf.read_long(flen))
-		return tos_error::ERROR_READ_EOF;
-	std::string fname;
-	flen <<= 2;
-	if (read_string(buf, flen, fname))
-		return tos_error::ERROR_READ_EOF;
-
-	size_t file_index = cu.files.size();
-	compilation_unit::file f;
-	f.dir_index = 0;
-	f.length = 0;
-	f.timestamp = 0;
-	f.path = fname.c_str();
-	cu.files.push_back(f);
+	size_t file_index;
+	int ret = read_hunk_file(buf, cu, file_index);
+	if (ret != tos_error::OK)
+		return ret;
 
+	uint32_t numlines;
 	if (buf.read_long(numlines))
 		return tos_error::ERROR_READ_EOF;
+
+	code_point cp;
+	cp.column = 0;
+	cp.file_index = file_index;
 	uint32_t curr_line = 0;
 	uint32_t curr_pc = offset;
 	while (numlines)
 	{
 		uint32_t line, pc;
+		// Decode as many entries as are certainly in bounds without checks,
+		// then check again
+		uint32_t count = buf.get_remain() / HCLN_MAX_ENTRY_SIZE;
+		if (count)
+		{
+			if (count > numlines)
+				count = numlines;
+			const uint8_t* start = buf.get_data();
+			const uint8_t* p = start;
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				p = get_hcln_long(p, line);
+				p = get_hcln_long(p, pc);
+				// Accumulate current position
+				curr_line += line;
+				curr_pc += pc;
+				cp.address = curr_pc;
+				cp.line = curr_line;
+				cu.points.push_back(cp);
+			}
+			buf.advance(p - start);
+			numlines -= count;
+			continue;
+		}
+
+		// Near the end of the hunk, entries might be truncated
 		if (read_hcln_long(buf, line))
 			return tos_error::ERROR_READ_EOF;
 		if (read_hcln_long(buf, pc))
 			return tos_error::ERROR_READ_EOF;
-		// Accumulate current position
 		curr_line += line;
 		curr_pc += pc;
-
-		code_point cp;
-		cp.address = pc + offset;
-		cp.column = 0;
-		cp.file_index = file_index;
-		cp.line = line;
+		cp.address = curr_pc;
+		cp.line = curr_line;
 		cu.points.push_back(cp);
 		--numlines;
 	}
@@ -258,8 +298,54 @@ static int read_debug_hcln_info(buffer_reader& buf, fonda::compilation_unit& cu,
 }
 
 // ----------------------------------------------------------------------------
-// Read relocation information and debug line number information.
-static int read_reloc(buffer_reader& buf, compilation_unit& cu)
+//	SYMBOL READING
+// ----------------------------------------------------------------------------
+// Size of a DRI symbol record: 8 name bytes, type word, value long
+static const uint32_t DRI_SYMBOL_SIZE = 14;
+
+// ----------------------------------------------------------------------------
+// Decode the DRI symbol table. GST/HiSoft long names use the whole of the
+// following record for 14 more characters of the name.
+static int read_symbols(buffer_reader& buf, tos_results& results)
+{
+	// Any partial record at the end is ignored
+	results.symbols.reserve(buf.get_remain() / DRI_SYMBOL_SIZE);
+	while (buf.get_remain() >= DRI_SYMBOL_SIZE)
+	{
+		tos_symbol sym;
+		if (read_string(buf, 8, sym.name))
+			return tos_error::ERROR_READ_EOF;
+		if (buf.read_word(sym.type))
+			return tos_error::ERROR_READ_EOF;
+		if (buf.read_long(sym.value))
+			return tos_error::ERROR_READ_EOF;
+
+		if ((sym.type & tos_symbol_type::LONG_NAME) == tos_symbol_type::LONG_NAME &&
+			buf.get_remain() >= DRI_SYMBOL_SIZE)
+		{
+			if (read_string(buf, DRI_SYMBOL_SIZE, sym.name))
+				return tos_error::ERROR_READ_EOF;
+		}
+		results.symbols.push_back(sym);
+	}
+
+	// Build the indexes
+	const std::vector<tos_symbol>& symbols = results.symbols;
+	for (uint32_t i = 0; i < symbols.size(); ++i)
+	{
+		if (symbols[i].type & tos_symbol_type::SEGMENT_MASK)
+			results.symbol_addresses.push_back(i);
+		results.symbol_names.insert(std::make_pair(symbols[i].name, i));
+	}
+	std::stable_sort(results.symbol_addresses.begin(), results.symbol_addresses.end(),
+		[&symbols](uint32_t a, uint32_t b) { return symbols[a].value < symbols[b].value; });
+	return tos_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// Decode the relocation table. Each offset is above the previous one, so
+// the output is already sorted.
+static int read_relocations(buffer_reader& buf, std::vector<uint32_t>& relocations)
 {
 	uint32_t addr;
 	if (buf.read_long(addr))
@@ -268,25 +354,43 @@ static int read_reloc(buffer_reader& buf, compilation_unit& cu)
 	// 0 at start meeans "no reloc info"
 	if (addr)
 	{
-		while (1)
-		{
-			uint8_t offset;
-			if (buf.read_byte(offset))
-				return tos_error::ERROR_READ_EOF;
-			if (offset == 0)
-				break;
+		// Find the end of the deltas and count the entries first, so the
+		// table is allocated once at its final size
+		const uint8_t* p = buf.get_data();
+		const uint8_t* end = (const uint8_t*)memchr(p, 0, buf.get_remain());
+		if (!end)
+			return tos_error::ERROR_READ_EOF;
+		buf.advance(end - p + 1);
+
+		size_t count = 1;
+		for (const uint8_t* q = p; q != end; ++q)
+			count += (*q != 1);
+		relocations.reserve(count);
 
-			if (offset == 1)
+		// 1 skips 254 bytes, anything else is the offset to the next entry
+		relocations.push_back(addr);
+		for (; p != end; ++p)
+		{
+			if (*p == 1)
 			{
 				addr += 254;
 				continue;
 			}
-			else
-			{
-				addr += offset;
-			}
+			addr += *p;
+			relocations.push_back(addr);
 		}
 	}
+	return tos_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+// Read relocation information and debug line number information.
+static int read_reloc(buffer_reader& buf, tos_results& results)
+{
+	int ret = read_relocations(buf, results.relocations);
+	if (ret != tos_error::OK)
+		return ret;
+	compilation_unit& cu = results.line_info_units.back();
 
 	// Read debugging information
 	// Align to word
@@ -313,7 +417,9 @@ static int read_reloc(buffer_reader& buf, compilation_unit& cu)
 		// Read hunk length, which is number of 32-byte longs
 		if (buf.read_long(hlen))
 			return tos_error::ERROR_READ_EOF;
-		// Convert header length to bytes
+		// Convert header length to bytes. A truncated hunk can't be decoded.
+		if (hlen > buf.get_remain() / 4)
+			return tos_error::ERROR_READ_EOF;
 		hlen <<= 2;
 		hstart = buf.get_pos();	// record position for jumping
 
@@ -325,6 +431,7 @@ static int read_reloc(buffer_reader& buf, compilation_unit& cu)
 		if (hunk_buffer.read_long(htype))
 			return tos_error::ERROR_READ_EOF;
 
+		ret = tos_error::OK;
 		switch (htype)
 		{
 			// NOTE: the X-Debug example does stricter checks on format here.
@@ -334,15 +441,17 @@ static int read_reloc(buffer_reader& buf, compilation_unit& cu)
 				got_header = true;
 				break;
 			case 0x4c494e45: // "LINE"
-				read_debug_line_info(hunk_buffer, cu, offset);
+				ret = read_debug_line_info(hunk_buffer, cu, offset);
 				break;
 			case 0x48434c4e: // "HCLN"
-				read_debug_hcln_info(hunk_buffer, cu, offset);
+				ret = read_debug_hcln_info(hunk_buffer, cu, offset);
 				break;
 			default:
 				// For the moment, skip unknown chunks rather than error.
 				break;
 		}
+		if (ret != tos_error::OK)
+			return ret;
 
 		// Jump to next hunk
 		buf.set_pos(hstart + hlen);
@@ -351,11 +460,8 @@ static int read_reloc(buffer_reader& buf, compilation_unit& cu)
 }
 
 // ----------------------------------------------------------------------------
-int process_tos_file(const uint8_t* data_ptr, long size, tos_results& results)
+static int read_header(buffer_reader& buf, tos_header& header)
 {
-	buffer_reader buf(data_ptr, size, 0);
-	tos_header header = {};
-
 	if (buf.read_word(header.ph_branch))
 		return tos_error::ERROR_READ_EOF;
 	if (buf.read_long(header.ph_tlen))
@@ -375,26 +481,21 @@ int process_tos_file(const uint8_t* data_ptr, long size, tos_results& results)
 
 	if (header.ph_branch != 0x601a)
 		return tos_error::ERROR_HEADER_MAGIC;
+	return tos_error::OK;
+}
 
-	if (header.ph_tlen > buf.get_remain())
-		return tos_error::ERROR_SECTION_OVERFLOW;
-	buffer_reader text_buf(buf.get_data(), header.ph_tlen, 0);
-
-	// Skip the text
-	buf.advance(header.ph_tlen);
-	if (header.ph_dlen > buf.get_remain())
-		return tos_error::ERROR_SECTION_OVERFLOW;
-	buffer_reader data_buf(buf.get_data(), header.ph_dlen, 0);
-
-	// Skip the data
-	buf.advance(header.ph_dlen);
-
+// ----------------------------------------------------------------------------
+// Parse everything after TEXT and DATA: the symbols, then the relocations
+// and line information.
+static int read_tail(buffer_reader& buf, const tos_header& header, tos_results& results)
+{
 	// (No BSS in the file, so symbols should be next)
 	if (header.ph_slen > buf.get_remain())
 		return tos_error::ERROR_SECTION_OVERFLOW;
 	buffer_reader symbol_buf(buf.get_data(), header.ph_slen, 0);
-
-	// Skip symbols here
+	int ret = read_symbols(symbol_buf, results);
+	if (ret != tos_error::OK)
+		return ret;
 
 	// Parse the reloc section, which also contains the line information
 	buf.advance(header.ph_slen);
@@ -407,28 +508,137 @@ int process_tos_file(const uint8_t* data_ptr, long size, tos_results& results)
 	single_cu.dirs.push_back(std::string("."));
 	results.line_info_units.push_back(single_cu);
 
-	return read_reloc(reloc_buf, results.line_info_units.back());
+	return read_reloc(reloc_buf, results);
 }
 
 // ----------------------------------------------------------------------------
+int process_tos_file(const uint8_t* data_ptr, long size, tos_results& results)
+{
+	buffer_reader buf(data_ptr, size, 0);
+	tos_header& header = results.header;
+	int ret = read_header(buf, header);
+	if (ret != tos_error::OK)
+		return ret;
+
+	// Skip the text and data
+	if (header.ph_tlen > buf.get_remain())
+		return tos_error::ERROR_SECTION_OVERFLOW;
+	buf.advance(header.ph_tlen);
+	if (header.ph_dlen > buf.get_remain())
+		return tos_error::ERROR_SECTION_OVERFLOW;
+	buf.advance(header.ph_dlen);
+
+	buffer_reader tail_buf(buf.get_data(), buf.get_remain(), 0);
+	return read_tail(tail_buf, header, results);
+}
+
+// ----------------------------------------------------------------------------
+// Only the header and the tail of the file are read: TEXT and DATA are
+// skipped with a seek, since they can be much bigger than the debug info.
 int process_tos_file(FILE* file, tos_results& output)
 {
+	uint8_t header_data[TOS_HEADER_SIZE];
+	fseek(file, 0, SEEK_SET);
+	if (fread(header_data, 1, TOS_HEADER_SIZE, file) != TOS_HEADER_SIZE)
+		return tos_error::ERROR_READ_EOF;
+
+	buffer_reader header_buf(header_data, TOS_HEADER_SIZE, 0);
+	tos_header& header = output.header;
+	int ret = read_header(header_buf, header);
+	if (ret != tos_error::OK)
+		return ret;
+
 	fseek(file, 0, SEEK_END);
 	long length = ftell(file);
-	fseek(file, 0, SEEK_SET);
-	uint8_t* data = new uint8_t[length];
-	if (!data)
-		return tos_error::ERROR_ALLOC_FAIL;
+	uint64_t tail_pos = (uint64_t)TOS_HEADER_SIZE + header.ph_tlen + header.ph_dlen;
+	if (length < 0 || tail_pos > (uint64_t)length)
+		return tos_error::ERROR_SECTION_OVERFLOW;
 
-	size_t count = fread(data, 1, length, file);
-	if ((long)count != length)
-	{
-		delete [] data;
+	long tail_size = length - (long)tail_pos;
+	std::vector<uint8_t> tail(tail_size);
+	fseek(file, (long)tail_pos, SEEK_SET);
+	if ((long)fread(tail.data(), 1, tail_size, file) != tail_size)
 		return tos_error::ERROR_FILE_READ;
+
+	buffer_reader tail_buf(tail.data(), tail_size, 0);
+	return read_tail(tail_buf, header, output);
+}
+
+// ----------------------------------------------------------------------------
+int get_tos_segments(const tos_results& results, const uint8_t* file_data, uint64_t file_size,
+	tos_segments& segments)
+{
+	const tos_header& header = results.header;
+	uint64_t data_pos = (uint64_t)TOS_HEADER_SIZE + header.ph_tlen;
+	if (data_pos + header.ph_dlen > file_size)
+		return tos_error::ERROR_SECTION_OVERFLOW;
+
+	segments.text = file_data + TOS_HEADER_SIZE;
+	segments.text_size = header.ph_tlen;
+	segments.data = file_data + data_pos;
+	segments.data_size = header.ph_dlen;
+	segments.bss_size = header.ph_blen;
+	return tos_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+int relocate_tos_image(const tos_results& results, uint8_t* image, uint32_t image_size,
+	uint32_t from_base, uint32_t to_base)
+{
+	const std::vector<uint32_t>& relocations = results.relocations;
+	if (relocations.empty())
+		return tos_error::OK;
+
+	// The offsets are sorted, so only the last needs checking
+	if (image_size < 4 || relocations.back() > image_size - 4)
+		return tos_error::ERROR_RELOC_OVERFLOW;
+
+	uint32_t delta = to_base - from_base;
+	const uint32_t* offsets = relocations.data();
+	const uint32_t* end = offsets + relocations.size();
+	for (; offsets != end; ++offsets)
+	{
+		// Big-endian longs, at any alignment
+		uint8_t* p = image + *offsets;
+		uint32_t val = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+		val += delta;
+		p[0] = (uint8_t)(val >> 24);
+		p[1] = (uint8_t)(val >> 16);
+		p[2] = (uint8_t)(val >> 8);
+		p[3] = (uint8_t)val;
 	}
-	int ret = process_tos_file(data, length, output);
-	delete [] data;
-	return ret;
+	return tos_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+const tos_symbol* find_tos_symbol(const tos_results& results, uint32_t offset)
+{
+	const std::vector<tos_symbol>& symbols = results.symbols;
+	std::vector<uint32_t>::const_iterator it = std::upper_bound(results.symbol_addresses.begin(),
+		results.symbol_addresses.end(), offset,
+		[&symbols](uint32_t value, uint32_t index) { return value < symbols[index].value; });
+	if (it == results.symbol_addresses.begin())
+		return nullptr;
+	return &symbols[*(it - 1)];
+}
+
+// ----------------------------------------------------------------------------
+const tos_symbol* find_tos_symbol(const tos_results& results, const std::string& name)
+{
+	std::unordered_map<std::string, uint32_t>::const_iterator it = results.symbol_names.find(name);
+	if (it == results.symbol_names.end())
+		return nullptr;
+	return &results.symbols[it->second];
+}
+
+// ----------------------------------------------------------------------------
+bool is_tos_file(FILE* file)
+{
+	// TOS executables start with a "bra.s" instruction (0x601a)
+	uint8_t magic[2] = { 0, 0 };
+	size_t count = fread(magic, 1, 2, file);
+	fseek(file, 0, SEEK_SET);
+	return count == 2 && magic[0] == 0x60 && magic[1] == 0x1a;
 }
 
 }
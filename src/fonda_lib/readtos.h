@@ -1,14 +1,80 @@
 #ifndef FONDA_LIB_READTOS_H
 #define FONDA_LIB_READTOS_H
 
+#include <unordered_map>
 #include "lineinfo.h"
 
 namespace fonda
 {
+// ----------------------------------------------------------------------------
+// Size of the header in the file
+static const uint32_t TOS_HEADER_SIZE = 28;
+
+// ----------------------------------------------------------------------------
+struct tos_header
+{
+   //  See http://toshyp.atari.org/en/005005.html for TOS header details
+	uint16_t  ph_branch;	  /* Branch to start of the program  */
+							  /* (must be 0x601a!)			   */
+
+	uint32_t  ph_tlen;		  /* Length of the TEXT segment	  */
+	uint32_t  ph_dlen;		  /* Length of the DATA segment	  */
+	uint32_t  ph_blen;		  /* Length of the BSS segment	   */
+	uint32_t  ph_slen;		  /* Length of the symbol table	  */
+	uint32_t  ph_res1;		  /* Reserved, should be 0;		  */
+							  /* Required by PureC			   */
+	uint32_t  ph_prgflags;	  /* Program flags				   */
+	uint16_t  ph_absflag;	  /* 0 = Relocation info present	 */
+};
+
+// ----------------------------------------------------------------------------
+// The TEXT and DATA segments within a copy of the file. BSS isn't stored.
+struct tos_segments
+{
+	const uint8_t*	text;
+	uint32_t		text_size;
+	const uint8_t*	data;
+	uint32_t		data_size;
+	uint32_t		bss_size;
+};
+
+// ----------------------------------------------------------------------------
+// Bits of tos_symbol::type
+namespace tos_symbol_type
+{
+	enum
+	{
+		BSS = 0x0100,
+		TEXT = 0x0200,
+		DATA = 0x0400,
+		EXTERNAL = 0x0800,
+		REGISTER = 0x1000,					// equated register
+		GLOBAL = 0x2000,
+		EQUATED = 0x4000,
+		DEFINED = 0x8000,
+		SEGMENT_MASK = 0x0700,
+		LONG_NAME = 0x0048					// GST/HiSoft: name continues in the next record
+	};
+}
+
+// ----------------------------------------------------------------------------
+// A symbol from the DRI symbol table
+struct tos_symbol
+{
+	std::string		name;
+	uint32_t		value;			// offset from the start of TEXT for TEXT/DATA/BSS symbols
+	uint16_t		type;			// tos_symbol_type bits
+};
+
 // ----------------------------------------------------------------------------
 struct tos_results
 {
+	tos_header						header;
 	std::vector<compilation_unit>	line_info_units;
+	std::vector<uint32_t>			relocations;	// offsets in TEXT+DATA of the longs to relocate, ascending
+	std::vector<tos_symbol>			symbols;		// in file order
+	std::vector<uint32_t>			symbol_addresses;	// indices in symbols of TEXT/DATA/BSS symbols, by value
+	std::unordered_map<std::string, uint32_t> symbol_names;	// name -> index in symbols of the first with the name
 };
 
 // ----------------------------------------------------------------------------
@@ -21,12 +87,38 @@ namespace tos_error
 		ERROR_HEADER_MAGIC = 2,				// Missing "ELF" signature
 		ERROR_ALLOC_FAIL = 3,				// Can't allocate file data
 		ERROR_FILE_READ = 4,				// Can't read from FILE*
-		ERROR_SECTION_OVERFLOW = 5			// Stated size of section is bigger than file data
+		ERROR_SECTION_OVERFLOW = 5,			// Stated size of section is bigger than file data
+		ERROR_RELOC_OVERFLOW = 6			// A relocation is outside the image
 	};
 }
 
 // ----------------------------------------------------------------------------
 extern int process_tos_file(FILE* file, tos_results& output);
 
+// As above, for a copy of the whole file in memory
+extern int process_tos_file(const uint8_t* data_ptr, long size, tos_results& output);
+
+// Get views of the TEXT and DATA segments over a copy of the whole file,
+// e.g. from mmap(). Nothing is copied.
+extern int get_tos_segments(const tos_results& results, const uint8_t* file_data, uint64_t file_size,
+	tos_segments& segments);
+
+// Relocate a loaded TEXT+DATA image from one base address to another, using
+// output.relocations. A freshly loaded image has a base of 0, but an image
+// already relocated can be moved again without reloading it.
+extern int relocate_tos_image(const tos_results& results, uint8_t* image, uint32_t image_size,
+	uint32_t from_base, uint32_t to_base);
+
+// Find the TEXT/DATA/BSS symbol at or below "offset" (from the start of TEXT),
+// or nullptr if there is none.
+extern const tos_symbol* find_tos_symbol(const tos_results& results, uint32_t offset);
+
+// Returns nullptr if there is no symbol with the name
+extern const tos_symbol* find_tos_symbol(const tos_results& results, const std::string& name);
+
+// Returns true if the file starts with the TOS executable magic number.
+// The file position is reset to the start.
+extern bool is_tos_file(FILE* file);
+
 }
 #endif // FONDA_LIB_READTOS_H
@@ -0,0 +1,299 @@
+#include "symbolizer.h"
+#include "elf_struct.h"
+
+namespace fonda
+{
+// ----------------------------------------------------------------------------
+int symbolizer::load(const char* fname, bool force_tos)
+{
+	return load(fname, force_tos, elf_parse_options());
+}
+
+// ----------------------------------------------------------------------------
+int symbolizer::load(const char* fname, bool force_tos, const elf_parse_options& options)
+{
+	FILE* file = fopen(fname, "rb");
+	if (!file)
+		return -1;
+	int ret = load(file, force_tos, get_lazy_options(options));
+	fclose(file);
+	m_fname = fname;
+	if (ret == 0 && m_lazy_max_bytes && !m_is_tos)
+	{
+		m_is_lazy = true;
+		m_lazy_lines.set_max_bytes(m_lazy_max_bytes);
+		m_lazy_lines.build(m_elf, m_fname);
+	}
+	return ret;
+}
+
+// ----------------------------------------------------------------------------
+elf_parse_options symbolizer::get_lazy_options(const elf_parse_options& options) const
+{
+	elf_parse_options lazy = options;
+	if (m_lazy_max_bytes && (lazy.parts & elf_parts::LINES))
+		lazy.parts = (lazy.parts & ~elf_parts::LINES) | elf_parts::LINE_PROGRAMS;
+	return lazy;
+}
+
+// ----------------------------------------------------------------------------
+int symbolizer::reload(const char* fname, const symbolizer& previous, bool force_tos)
+{
+	// Lazily decoded units gain nothing from being reused
+	if (force_tos || previous.is_tos() || m_lazy_max_bytes)
+		return load(fname, force_tos);
+
+	FILE* file = fopen(fname, "rb");
+	if (!file)
+		return -1;
+	int ret;
+	if (is_tos_file(file))
+		ret = load(file, false);
+	else
+	{
+		elf_results results;
+		elf_reload_report report;
+		ret = reload_elf_file(file, previous.m_elf, results, report);
+		if (ret == elf_error::OK)
+			build(std::move(results));
+	}
+	fclose(file);
+	m_fname = fname;
+	return ret;
+}
+
+// ----------------------------------------------------------------------------
+void symbolizer::freeze()
+{
+	load_debug_file();
+	m_frames.decode_all();
+}
+
+// ----------------------------------------------------------------------------
+int symbolizer::load(FILE* file, bool force_tos)
+{
+	return load(file, force_tos, elf_parse_options());
+}
+
+// ----------------------------------------------------------------------------
+int symbolizer::load(FILE* file, bool force_tos, const elf_parse_options& options)
+{
+	m_fname.clear();
+	if (force_tos || is_tos_file(file))
+	{
+		tos_results results;
+		int ret = process_tos_file(file, results);
+		if (ret != tos_error::OK)
+			return ret;
+		build(std::move(results));
+		return tos_error::OK;
+	}
+
+	elf_results results;
+	int ret = process_elf_file(file, results, options);
+	if (ret != elf_error::OK)
+		return ret;
+	build(std::move(results));
+	return elf_error::OK;
+}
+
+// ----------------------------------------------------------------------------
+void symbolizer::build(elf_results&& results)
+{
+	m_is_tos = false;
+	m_is_lazy = false;
+	m_elf = std::move(results);
+	m_tos = tos_results();
+	m_debug = elf_results();
+	m_pDebugInfo = &m_elf;
+	m_lines.build(m_elf.line_info_units);
+	m_frames.build(m_elf.cfi);
+	m_dynamic.build(m_elf);
+	// Only look for a debug file when it would add something
+	m_debug_checked = m_elf.line_info_units.size() || m_elf.line_programs.size() ||
+		(m_elf.debuglink.empty() && m_elf.build_id.empty());
+
+	// Fully stripped files still have their exported symbols
+	m_symbols = symbol_index();
+	for (const elf_section& sec : m_elf.sections)
+	{
+		if (sec.flags & SHF_ALLOC)
+			m_symbols.add_extent(sec.addr, sec.addr + sec.size);
+	}
+	// Without section headers, the segments are all there is
+	if (m_elf.sections.empty())
+	{
+		for (const elf_segment& seg : m_elf.segments)
+		{
+			if (seg.type == PT_LOAD)
+				m_symbols.add_extent(seg.vaddr, seg.vaddr + seg.mem_size);
+		}
+	}
+	const std::vector<elf_symbol>& symbols = m_elf.symbols.size() ? m_elf.symbols : m_elf.dynamic_symbols;
+	for (const elf_symbol& sym : symbols)
+	{
+		uint8_t type = sym.st_info & 0xf;
+		if (sym.name.empty() || sym.st_shndx == SHN_UNDEF ||
+			type == STT_SECTION || type == STT_FILE)
+			continue;
+		m_symbols.add(sym.name, sym.st_value, sym.st_size);
+	}
+	// Functions from the debug info cover static and stripped symbols.
+	// Each range of a function split into parts is added separately.
+	for (const elf_address_range& range : m_elf.function_ranges.ranges)
+	{
+		const elf_function& func = m_elf.functions[range.value];
+		if (!func.name.empty())
+			m_symbols.add(func.name, range.start, range.end - range.start);
+	}
+	m_symbols.build();
+}
+
+// ----------------------------------------------------------------------------
+void symbolizer::build(tos_results&& results)
+{
+	m_is_tos = true;
+	m_is_lazy = false;
+	m_tos = std::move(results);
+	m_elf = elf_results();
+	m_debug = elf_results();
+	m_pDebugInfo = &m_elf;
+	// Line tables have no sequence ends, so stop them at the end of the text
+	const tos_header& header = m_tos.header;
+	m_lines.build(m_tos.line_info_units, header.ph_tlen);
+	m_frames.build(m_elf.cfi);
+	m_dynamic.build(m_elf);
+	m_debug_checked = true;
+
+	m_symbols = symbol_index();
+	m_symbols.add_extent(0, (uint64_t)header.ph_tlen + header.ph_dlen + header.ph_blen);
+	// Symbols have no size, so extend to the next one
+	for (uint32_t index : m_tos.symbol_addresses)
+	{
+		const tos_symbol& sym = m_tos.symbols[index];
+		m_symbols.add(sym.name, sym.value, 0);
+	}
+	m_symbols.build();
+}
+
+// ----------------------------------------------------------------------------
+void symbolizer::find_inline_stack(uint64_t address, std::vector<inline_call>& stack) const
+{
+	stack.clear();
+	if (m_is_tos)
+		return;
+
+	load_debug_file();
+	const elf_results& elf = *m_pDebugInfo;
+	std::vector<const elf_inline*> inlines;
+	find_elf_inline_stack(elf, address, inlines);
+	for (const elf_inline* inl : inlines)
+	{
+		inline_call call;
+		call.name = &inl->name;
+		call.unit = nullptr;
+		call.file = nullptr;
+		call.line = inl->call_line;
+		call.column = inl->call_column;
+		if (m_is_lazy)
+		{
+			call.holder = m_lazy_lines.find_unit(inl->unit_offset);
+			if (call.holder && inl->call_file < call.holder->files.size())
+			{
+				call.unit = call.holder.get();
+				call.file = &call.unit->files[inl->call_file];
+			}
+		}
+		else if (inl->line_unit < elf.line_info_units.size() &&
+			inl->call_file < elf.line_info_units[inl->line_unit].files.size())
+		{
+			call.unit = &elf.line_info_units[inl->line_unit];
+			call.file = &call.unit->files[inl->call_file];
+		}
+		stack.push_back(call);
+	}
+}
+
+// ----------------------------------------------------------------------------
+bool symbolizer::find_frame(uint64_t address, frame_location& loc) const
+{
+	// Stripped files usually keep .eh_frame, so only .debug_frame-only
+	// files need the debug file
+	if (m_elf.cfi.fdes.empty())
+		load_debug_file();
+	return m_frames.find(address, loc);
+}
+
+// ----------------------------------------------------------------------------
+void symbolizer::load_debug_file_locked() const
+{
+	std::lock_guard<std::mutex> lock(m_debug_mutex);
+	if (m_debug_checked.load(std::memory_order_relaxed))
+		return;
+
+	std::string debug_fname;
+	FILE* file = nullptr;
+	if (m_fname.size() && find_elf_debug_file(m_elf, m_fname, m_debug_dirs, debug_fname))
+		file = fopen(debug_fname.c_str(), "rb");
+	if (file)
+	{
+		if (process_elf_file(file, m_debug, get_lazy_options(elf_parse_options())) == elf_error::OK)
+		{
+			m_pDebugInfo = &m_debug;
+			if (m_is_lazy)
+				m_lazy_lines.build(m_debug, debug_fname);
+			else
+				m_lines.build(m_debug.line_info_units);
+			if (m_elf.cfi.fdes.empty())
+				m_frames.build(m_debug.cfi);
+		}
+		else
+			m_debug = elf_results();
+		fclose(file);
+	}
+	m_debug_checked.store(true, std::memory_order_release);
+}
+
+// ----------------------------------------------------------------------------
+//	SHARED SNAPSHOTS
+// ----------------------------------------------------------------------------
+int shared_symbolizer::load(const char* fname, bool force_tos)
+{
+	std::lock_guard<std::mutex> lock(m_update_mutex);
+	std::shared_ptr<symbolizer> next = create();
+	int ret = next->load(fname, force_tos);
+	if (ret == 0)
+		publish(next);
+	return ret;
+}
+
+// ----------------------------------------------------------------------------
+int shared_symbolizer::reload(const char* fname, bool force_tos)
+{
+	std::lock_guard<std::mutex> lock(m_update_mutex);
+	snapshot previous = get();
+	std::shared_ptr<symbolizer> next = create();
+	int ret = previous ? next->reload(fname, *previous, force_tos) : next->load(fname, force_tos);
+	if (ret == 0)
+		publish(next);
+	return ret;
+}
+
+// ----------------------------------------------------------------------------
+std::shared_ptr<symbolizer> shared_symbolizer::create() const
+{
+	std::shared_ptr<symbolizer> next(new symbolizer);
+	next->set_debug_dirs(m_debug_dirs);
+	next->set_lazy_lines(m_lazy_max_bytes);
+	return next;
+}
+
+// ----------------------------------------------------------------------------
+void shared_symbolizer::publish(const std::shared_ptr<symbolizer>& next)
+{
+	next->freeze();
+	// Readers still holding the old snapshot keep it alive until they finish
+	std::atomic_store(&m_current, snapshot(next));
+}
+
+}
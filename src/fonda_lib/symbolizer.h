@@ -0,0 +1,218 @@
+#ifndef FONDA_LIB_SYMBOLIZER_H
+#define FONDA_LIB_SYMBOLIZER_H
+
+// Address and name lookups over a parsed program, whatever its format.
+#include <stdio.h>
+#include <atomic>
+#include <memory>
+#include "lookup_index.h"
+#include "readelf.h"
+#include "readtos.h"
+
+namespace fonda
+{
+// ----------------------------------------------------------------------------
+// An inlined function, and where it is called from in the function it is
+// inlined into.
+struct inline_call
+{
+	const std::string*				name;
+	const compilation_unit*			unit;		// nullptr if the call site is unknown
+	const compilation_unit::file*	file;		// nullptr if the call site is unknown
+	uint32_t						line;
+	uint32_t						column;
+	std::shared_ptr<const compilation_unit> holder;	// keeps a lazily decoded unit alive, or null
+};
+
+// ----------------------------------------------------------------------------
+// symbolizer -- owns the results of either parser and the indexes over them,
+// so that queries don't depend on the input format. Parts a format doesn't
+// have, such as call frame information in TOS files, are empty.
+// Queries can be made from several threads once built.
+//
+// When an ELF file has no line information but names a separate debug file
+// (by build ID or .gnu_debuglink), that file is only opened and parsed the
+// first time line, inline or frame information is needed. Symbol lookups
+// only ever use the main file.
+class symbolizer
+{
+public:
+	symbolizer() :
+		m_is_tos(false),
+		m_lazy_max_bytes(0),
+		m_is_lazy(false),
+		m_pDebugInfo(&m_elf),
+		m_debug_checked(true)
+	{
+		m_debug_dirs.push_back("/usr/lib/debug");
+	}
+
+	// Directories searched for separate debug files. Set before loading.
+	void set_debug_dirs(const std::vector<std::string>& dirs)	{ m_debug_dirs = dirs; }
+
+	// Decode the line programs of ELF files loaded by filename only when a
+	// query first needs them, keeping at most about "max_bytes" of decoded
+	// units (see lazy_line_index). 0, the default, decodes everything while
+	// loading. Set before loading. lines() is then empty.
+	void set_lazy_lines(uint64_t max_bytes)		{ m_lazy_max_bytes = max_bytes; }
+
+	// Parse a file, detecting TOS files unless force_tos is set, and build
+	// the indexes. Returns the parser's error code, 0 for success.
+	int load(FILE* file, bool force_tos);
+
+	// As above, by filename, which also allows separate debug files to be
+	// found. Returns -1 if the file can't be opened.
+	int load(const char* fname, bool force_tos);
+
+	// As the above, decoding only the parts of an ELF file given in the
+	// options. TOS files are always read whole.
+	int load(FILE* file, bool force_tos, const elf_parse_options& options);
+	int load(const char* fname, bool force_tos, const elf_parse_options& options);
+
+	// As load(fname), reusing the parts of "previous" that are unchanged in
+	// the file. "previous" can be released afterwards. The settings used are
+	// this symbolizer's own, as for load().
+	int reload(const char* fname, const symbolizer& previous, bool force_tos);
+
+	// Do all the work that would otherwise happen lazily in queries: load any
+	// separate debug file and decode all the call frame information. After
+	// this queries take no locks, except for line queries with lazy lines,
+	// which still decode and cache units under lazy_line_index's lock.
+	void freeze();
+
+	// Take over already parsed results and build the indexes
+	void build(elf_results&& results);
+	void build(tos_results&& results);
+
+	// Find the code point covering "address". Returns false if there is none.
+	bool find_line(uint64_t address, line_location& loc) const
+	{
+		load_debug_file();
+		return m_is_lazy ? m_lazy_lines.find(address, loc) : m_lines.find(address, loc);
+	}
+
+	// Find the addresses of a line of a file, see line_index::find_addresses()
+	void find_addresses(const char* path, uint32_t line, std::vector<uint64_t>& addresses) const
+	{
+		load_debug_file();
+		if (m_is_lazy)
+			m_lazy_lines.find_addresses(path, line, addresses);
+		else
+			m_lines.find_addresses(path, line, addresses);
+	}
+
+	// Returns nullptr if not found
+	const lookup_symbol* find_symbol(uint64_t address) const	{ return m_symbols.find(address); }
+	const lookup_symbol* find_symbol(const std::string& name) const	{ return m_symbols.find(name); }
+
+	// Find an exported symbol of a shared object or executable. Returns nullptr
+	// if not found, and always for TOS files.
+	const elf_symbol* find_dynamic_symbol(const char* name) const	{ return m_dynamic.find(name); }
+
+	// Find the functions inlined at "address", innermost first. The call site
+	// of each is in the function after it, or the symbol at the address for
+	// the last one.
+	void find_inline_stack(uint64_t address, std::vector<inline_call>& stack) const;
+
+	// Returns false if there are no unwinding rules for the address
+	bool find_frame(uint64_t address, frame_location& loc) const;
+
+	// The indexes, for callers doing their own sorted walks
+	const line_index& lines() const			{ load_debug_file(); return m_lines; }
+	const symbol_index& symbols() const		{ return m_symbols; }
+
+	// The parsed results. Only the one matching the format is filled in.
+	bool is_tos() const						{ return m_is_tos; }
+	const elf_results& elf() const			{ return m_elf; }
+	const tos_results& tos() const			{ return m_tos; }
+
+	// The results holding the debug info: the separate debug file's once
+	// loaded, otherwise the main file's
+	const elf_results& debug_info() const	{ load_debug_file(); return *m_pDebugInfo; }
+
+private:
+	symbolizer(const symbolizer&);			// the indexes point into the results
+	symbolizer& operator=(const symbolizer&);
+
+	// Load the separate debug file if there is one and it hasn't been tried
+	void load_debug_file() const
+	{
+		if (!m_debug_checked.load(std::memory_order_acquire))
+			load_debug_file_locked();
+	}
+	void load_debug_file_locked() const;
+
+	// Options to parse with, taking lazy lines into account
+	elf_parse_options get_lazy_options(const elf_parse_options& options) const;
+
+	bool				m_is_tos;
+	elf_results			m_elf;
+	tos_results			m_tos;
+	symbol_index		m_symbols;
+	dynamic_symbol_index m_dynamic;
+	std::string			m_fname;
+	std::vector<std::string> m_debug_dirs;
+	uint64_t			m_lazy_max_bytes;
+	bool				m_is_lazy;			// lines are in m_lazy_lines rather than m_lines
+
+	// Changed when the debug file is loaded
+	mutable elf_results			m_debug;
+	mutable const elf_results*	m_pDebugInfo;
+	mutable line_index			m_lines;
+	mutable lazy_line_index		m_lazy_lines;
+	mutable frame_index			m_frames;
+	mutable std::atomic<bool>	m_debug_checked;
+	mutable std::mutex			m_debug_mutex;
+};
+
+// ----------------------------------------------------------------------------
+// shared_symbolizer -- the current symbolizer of a program, shared between
+// threads. Readers take a snapshot, which stays valid and unchanged for as
+// long as they hold it, whatever is reloaded meanwhile. Snapshots are frozen
+// before they are published, so queries on them take no locks (see
+// symbolizer::freeze() for lazy lines); only taking and replacing a snapshot
+// is synchronised.
+class shared_symbolizer
+{
+public:
+	typedef std::shared_ptr<const symbolizer> snapshot;
+
+	shared_symbolizer() :
+		m_lazy_max_bytes(0)
+	{
+		m_debug_dirs.push_back("/usr/lib/debug");
+	}
+
+	// Settings for the symbolizers of later loads and reloads, see
+	// symbolizer::set_debug_dirs() and symbolizer::set_lazy_lines()
+	void set_debug_dirs(const std::vector<std::string>& dirs)	{ m_debug_dirs = dirs; }
+	void set_lazy_lines(uint64_t max_bytes)		{ m_lazy_max_bytes = max_bytes; }
+
+	// An empty symbolizer with these settings, e.g. to publish() later
+	std::shared_ptr<symbolizer> create() const;
+
+	// Returns nullptr before the first successful load
+	snapshot get() const		{ return std::atomic_load(&m_current); }
+
+	// Parse a file into a new snapshot and publish it. On failure the current
+	// snapshot is kept. Returns as symbolizer::load(fname).
+	int load(const char* fname, bool force_tos);
+
+	// As load(), reusing the unchanged parts of the current snapshot
+	int reload(const char* fname, bool force_tos);
+
+	// Freeze a symbolizer and make it the current snapshot
+	void publish(const std::shared_ptr<symbolizer>& next);
+
+	// Drop the current snapshot, e.g. when switching to another program
+	void clear()				{ std::atomic_store(&m_current, snapshot()); }
+
+private:
+	snapshot					m_current;
+	std::mutex					m_update_mutex;		// one load or reload at a time
+	std::vector<std::string>	m_debug_dirs;
+	uint64_t					m_lazy_max_bytes;
+};
+
+}
+#endif // FONDA_LIB_SYMBOLIZER_H
@@ -1,21 +1,43 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string>
 #include <cstring>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "fonda_lib/readelf.h"
 #include "fonda_lib/readtos.h"
+#include "dump_writer.h"
+#include "server.h"
+#include "addr2line.h"
 
 // ----------------------------------------------------------------------------
 void usage()
 {
 	fprintf(stdout,
-		"Usage: fonda <input_filename>\n\n"
+		"Usage: fonda [options] <input_filename>\n"
+		"       fonda --batch [options] <input_filename...>\n"
+		"       fonda --server [--socket <path>] <input_filename...>\n"
+		"       fonda addr2line [options] [address...]\n\n"
+		"Options:\n"
+		"  --tos            Parse input as a TOS/PRG executable\n"
+		"  --format <fmt>   Output format: text (default), tsv or json (JSON lines)\n"
+		"  --batch          Parse many files. A filename of '-' reads a list of\n"
+		"                   filenames from stdin, one per line. TOS files are\n"
+		"                   detected automatically unless --tos is given.\n"
+		"  --jobs <n>       Number of worker threads in batch mode\n"
+		"  --outdir <dir>   Write one output file per input in batch mode\n"
+		"  --server         Load the files once and answer queries on stdin/stdout.\n"
+		"                   See server.h for the protocol.\n"
+		"  --socket <path>  In server mode, listen on a Unix socket instead\n\n"
 	);
 }
 
 const char* title = "fonda v0.0\n";
 
-int elf_file(FILE* pFile)
+int elf_file(FILE* pFile, dump_writer& writer)
 {
 	fonda::elf_results results;
 	int ret = process_elf_file(pFile, results);
@@ -23,42 +45,22 @@ int elf_file(FILE* pFile)
 		return ret;
 
 	// Dump output
-	printf("\n==== SECTION INFORMATION ===\n\n");
+	writer.section_header();
 	for (const fonda::elf_section& s : results.sections)
-	{
-		printf("[%03d] [%20s] [%08lx] [%08lx] [type: %08x] [addr:%08lx]\n", s.section_id, s.name_string.c_str(),
-			s.offset, s.size, s.type, s.addr);
-	}
+		writer.section(s);
 
-	printf("\n\n==== LINE INFORMATION ===\n\n");
+	writer.line_header();
 	for (const fonda::compilation_unit& unit : results.line_info_units)
-	{
-		for (const fonda::compilation_unit::file& file : unit.files)
-		{
-			printf("\tfile %s/%s\n",
-				unit.dirs[file.dir_index].c_str(), file.path.c_str());
-		}
-		for (const fonda::code_point& cp : unit.points)
-		{
-			const fonda::compilation_unit::file& file = unit.files[cp.file_index];
-			printf("\t\tAddress: %lx File: \"%s/%s\" Line: %d Col: %u\n", 
-				cp.address,
-				unit.dirs[file.dir_index].c_str(),
-				file.path.c_str(),
-				cp.line, cp.column);
-		}
-	}
+		writer.unit(unit);
 
-	printf("\n\n==== SYMBOL INFORMATION ===\n\n");
+	writer.symbol_header();
 	for (const fonda::elf_symbol& sym : results.symbols)
-		printf("Symbol: %08lx (size: %08lx) binding=%x type=%x section=(%d, name %s) \"%s\"\n",
-					sym.st_value, sym.st_size, sym.st_other >> 4, sym.st_other & 0xf,
-					sym.st_shndx, sym.section_type.c_str(), sym.name.c_str());
+		writer.symbol(sym);
 
 	return 0;
 }
 
-int tos_file(FILE* pFile)
+int tos_file(FILE* pFile, dump_writer& writer)
 {
 	fonda::tos_results results;
 	int ret = process_tos_file(pFile, results);
@@ -66,31 +68,234 @@ int tos_file(FILE* pFile)
 		return ret;
 
 	// Dump output
-	printf("\n\n==== LINE INFORMATION ===\n\n");
+	writer.line_header();
 	for (const fonda::compilation_unit& unit : results.line_info_units)
+		writer.unit(unit);
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+static int dump_file(FILE* pInfile, const char* fname, bool parse_tos,
+	dump_format format, FILE* pOut)
+{
+	dump_writer writer(pOut, format);
+	writer.input_file(fname);
+	if (parse_tos)
+		return tos_file(pInfile, writer);
+	return elf_file(pInfile, writer);
+}
+
+// ----------------------------------------------------------------------------
+//	BATCH MODE
+// ----------------------------------------------------------------------------
+// Upper limit for --jobs
+static const int MAX_JOBS = 1024;
+
+struct batch_options
+{
+	bool force_tos;
+	dump_format format;
+	unsigned int num_jobs;
+	const char* outdir;			// when set, write one output file per input
+};
+
+struct batch_job
+{
+	std::string fname;
+	FILE* output;				// temp file with the dump, until flushed to stdout
+	int ret;					// parser error code, 0 for success
+	std::string error;			// set when the failure isn't a parser error
+	bool done;
+};
+
+// Shared state between the worker threads and the thread writing output.
+// Workers may only run ahead of the writer by "window" jobs, so the number
+// of pending outputs (and open files) stays bounded however many inputs there are.
+struct batch_queue
+{
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::vector<batch_job> jobs;
+	size_t next_job;			// next job to hand out to a worker
+	size_t next_flush;			// next job to write to stdout
+	size_t window;
+};
+
+// ----------------------------------------------------------------------------
+// Create the output filename for --outdir. Paths are flattened so that inputs
+// with the same basename in different directories don't collide.
+static std::string batch_output_name(const batch_options& opts, const std::string& fname)
+{
+	std::string flat = fname;
+	for (size_t i = 0; i < flat.size(); ++i)
+		if (flat[i] == '/' || flat[i] == '\\' || flat[i] == ':')
+			flat[i] = '_';
+	// Don't create hidden files for relative paths such as "../foo"
+	size_t start = flat.find_first_not_of("._");
+	if (start != std::string::npos)
+		flat = flat.substr(start);
+	static const char* extensions[] = { ".txt", ".tsv", ".jsonl" };
+	return std::string(opts.outdir) + "/" + flat + extensions[opts.format];
+}
+
+// ----------------------------------------------------------------------------
+static void batch_run_job(batch_job& job, const batch_options& opts)
+{
+	FILE* pInfile = fopen(job.fname.c_str(), "rb");
+	if (!pInfile)
+	{
+		job.error = "can't open file";
+		return;
+	}
+
+	FILE* pOut;
+	std::string out_name;
+	if (opts.outdir)
 	{
-		for (const fonda::compilation_unit::file& file : unit.files)
+		out_name = batch_output_name(opts, job.fname);
+		pOut = fopen(out_name.c_str(), "w");
+	}
+	else
+		pOut = tmpfile();
+
+	if (!pOut)
+	{
+		fclose(pInfile);
+		job.error = opts.outdir ? "can't create output file " + out_name : "can't create temp file";
+		return;
+	}
+
+	bool parse_tos = opts.force_tos || fonda::is_tos_file(pInfile);
+	job.ret = dump_file(pInfile, job.fname.c_str(), parse_tos, opts.format, pOut);
+	fclose(pInfile);
+
+	if (opts.outdir)
+		fclose(pOut);
+	else
+		job.output = pOut;
+}
+
+// ----------------------------------------------------------------------------
+static void batch_worker(batch_queue& queue, const batch_options& opts)
+{
+	while (1)
+	{
+		size_t job_id;
 		{
-			printf("\tfile %s/%s\n",
-				unit.dirs[file.dir_index].c_str(), file.path.c_str());
+			std::unique_lock<std::mutex> lock(queue.mutex);
+			queue.cond.wait(lock, [&queue] {
+				return queue.next_job >= queue.jobs.size() ||
+					queue.next_job < queue.next_flush + queue.window;
+			});
+			if (queue.next_job >= queue.jobs.size())
+				return;
+			job_id = queue.next_job++;
 		}
-		for (const fonda::code_point& cp : unit.points)
+
+		// The job is only touched by this thread until "done" is set
+		batch_run_job(queue.jobs[job_id], opts);
 		{
-			const fonda::compilation_unit::file& file = unit.files[cp.file_index];
-			printf("\t\tAddress: %lx File: \"%s/%s\" Line: %d Col: %u\n", 
-				cp.address,
-				unit.dirs[file.dir_index].c_str(),
-				file.path.c_str(),
-				cp.line, cp.column);
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.jobs[job_id].done = true;
 		}
+		queue.cond.notify_all();
 	}
-	return 0;
+}
+
+// ----------------------------------------------------------------------------
+static void copy_to_stdout(FILE* pFile)
+{
+	char buffer[65536];
+	fseek(pFile, 0, SEEK_SET);
+	size_t count;
+	while ((count = fread(buffer, 1, sizeof(buffer), pFile)) != 0)
+		fwrite(buffer, 1, count, stdout);
+}
+
+// ----------------------------------------------------------------------------
+static void read_filenames(FILE* pFile, std::vector<std::string>& fnames)
+{
+	char line[4096];
+	while (fgets(line, sizeof(line), pFile))
+	{
+		size_t len = strlen(line);
+		while (len && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+			line[--len] = 0;
+		if (len)
+			fnames.push_back(line);
+	}
+}
+
+// ----------------------------------------------------------------------------
+static int batch_main(const std::vector<std::string>& fnames, const batch_options& opts)
+{
+	batch_queue queue;
+	queue.next_job = 0;
+	queue.next_flush = 0;
+	queue.window = opts.num_jobs * 2;
+	for (const std::string& fname : fnames)
+	{
+		batch_job job;
+		job.fname = fname;
+		job.output = nullptr;
+		job.ret = 0;
+		job.done = false;
+		queue.jobs.push_back(job);
+	}
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 0; i < opts.num_jobs; ++i)
+		workers.push_back(std::thread(batch_worker, std::ref(queue), std::cref(opts)));
+
+	// Write completed outputs in input order
+	while (queue.next_flush < queue.jobs.size())
+	{
+		batch_job* job;
+		{
+			std::unique_lock<std::mutex> lock(queue.mutex);
+			queue.cond.wait(lock, [&queue] { return queue.jobs[queue.next_flush].done; });
+			job = &queue.jobs[queue.next_flush];
+		}
+		if (job->output)
+		{
+			copy_to_stdout(job->output);
+			fclose(job->output);
+			job->output = nullptr;
+		}
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			++queue.next_flush;
+		}
+		queue.cond.notify_all();
+	}
+
+	for (std::thread& worker : workers)
+		worker.join();
+	fflush(stdout);
+
+	// Summarise failures
+	size_t num_failed = 0;
+	for (const batch_job& job : queue.jobs)
+	{
+		if (job.error.size())
+			fprintf(stderr, "FAILED: %s: %s\n", job.fname.c_str(), job.error.c_str());
+		else if (job.ret)
+			fprintf(stderr, "FAILED: %s: parsing failed with error %d\n", job.fname.c_str(), job.ret);
+		else
+			continue;
+		++num_failed;
+	}
+	fprintf(stderr, "Processed %lu files, %lu failed\n",
+		(unsigned long)queue.jobs.size(), (unsigned long)num_failed);
+	return num_failed ? 2 : 0;
 }
 
 // ----------------------------------------------------------------------------
 int main(int argc, char** argv)
 {
-	printf("%s\n", title);
+	if (argc >= 2 && strcmp(argv[1], "addr2line") == 0)
+		return addr2line_main(argc - 1, argv + 1);
+
 	if (argc < 2)
 	{
 		fprintf(stderr, "Error: No filename\n");
@@ -98,41 +303,112 @@ int main(int argc, char** argv)
 		return 1;
 	}
 
-	const int last_arg = argc - 1;							// last arg is reserved for filename
 	bool parse_tos = false;
-	for (int opt = 1; opt < last_arg; ++opt)
+	bool batch = false;
+	bool server = false;
+	dump_format format = DUMP_FORMAT_TEXT;
+	batch_options opts;
+	opts.num_jobs = std::thread::hardware_concurrency();
+	opts.outdir = nullptr;
+	server_options server_opts;
+	server_opts.socket_path = nullptr;
+	std::vector<std::string> fnames;
+
+	for (int opt = 1; opt < argc; ++opt)
 	{
 		if (strcmp(argv[opt], "--tos") == 0)
 		{
 			parse_tos = true;
 		}
-		else
+		else if (strcmp(argv[opt], "--format") == 0 && opt + 1 < argc)
+		{
+			if (!parse_dump_format(argv[++opt], format))
+			{
+				fprintf(stderr, "Error: Unknown format: '%s'\n", argv[opt]);
+				usage();
+				return 1;
+			}
+		}
+		else if (strcmp(argv[opt], "--batch") == 0)
+		{
+			batch = true;
+		}
+		else if (strcmp(argv[opt], "--server") == 0)
 		{
+			server = true;
+		}
+		else if (strcmp(argv[opt], "--socket") == 0 && opt + 1 < argc)
+		{
+			server_opts.socket_path = argv[++opt];
+		}
+		else if (strcmp(argv[opt], "--jobs") == 0 && opt + 1 < argc)
+		{
+			char* end;
+			long num_jobs = strtol(argv[++opt], &end, 10);
+			if (end == argv[opt] || *end || num_jobs < 1 || num_jobs > MAX_JOBS)
+			{
+				fprintf(stderr, "Error: --jobs needs a number from 1 to %d: '%s'\n", MAX_JOBS, argv[opt]);
+				usage();
+				return 1;
+			}
+			opts.num_jobs = (unsigned int)num_jobs;
+		}
+		else if (strcmp(argv[opt], "--outdir") == 0 && opt + 1 < argc)
+		{
+			opts.outdir = argv[++opt];
+		}
+		else if (strcmp(argv[opt], "-") == 0 && batch)
+		{
+			read_filenames(stdin, fnames);
+		}
+		else if (argv[opt][0] == '-' || (!batch && !server && opt != argc - 1))
+		{
+			// Outside batch and server modes, the last arg is reserved for filename
 			fprintf(stderr, "Error: Unknown option: '%s'\n", argv[opt]);
 			usage();
 			return 1;
 		}
+		else
+		{
+			fnames.push_back(argv[opt]);
+		}
 	}
 
-	const char* fname = argv[argc - 1];
-	FILE* pInfile = fopen(fname, "rb");
-	if (!pInfile)
+	// The title would break the machine-readable formats
+	if (format == DUMP_FORMAT_TEXT && !server)
+		printf("%s\n", title);
+
+	if (fnames.size() == 0)
 	{
-		fprintf(stderr, "Error: Can't open file: %s\n", fname);
+		fprintf(stderr, "Error: No filename\n");
+		usage();
 		return 1;
 	}
 
-	printf("File: \"%s\"\n", fname);
+	if (server)
+	{
+		server_opts.force_tos = parse_tos;
+		return server_main(fnames, server_opts);
+	}
 
-	int ret;
-	if (parse_tos)
+	if (batch)
 	{
-		ret = tos_file(pInfile);
+		if (opts.num_jobs == 0)
+			opts.num_jobs = 1;
+		opts.force_tos = parse_tos;
+		opts.format = format;
+		return batch_main(fnames, opts);
 	}
-	else
+
+	const char* fname = fnames[0].c_str();
+	FILE* pInfile = fopen(fname, "rb");
+	if (!pInfile)
 	{
-		ret = elf_file(pInfile);
+		fprintf(stderr, "Error: Can't open file: %s\n", fname);
+		return 1;
 	}
+
+	int ret = dump_file(pInfile, fname, parse_tos, format, stdout);
 	fclose(pInfile);
 	if (ret)
 	{
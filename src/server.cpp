@@ -0,0 +1,406 @@
+#include "server.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "fonda_lib/symbolizer.h"
+
+// ----------------------------------------------------------------------------
+//	LATENCY HISTOGRAMS
+// ----------------------------------------------------------------------------
+// Bucket N counts requests that took less than 2^N nanoseconds.
+static const int NUM_BUCKETS = 40;
+
+struct server_stats
+{
+	std::atomic<uint64_t> buckets[SERVER_OP_COUNT][NUM_BUCKETS];
+
+	server_stats()
+	{
+		for (int op = 0; op < SERVER_OP_COUNT; ++op)
+			for (int b = 0; b < NUM_BUCKETS; ++b)
+				buckets[op][b] = 0;
+	}
+
+	void record(uint8_t op, uint64_t nanoseconds)
+	{
+		if (op >= SERVER_OP_COUNT)
+			op = 0;				// unknown ops are counted together
+		int bucket = 0;
+		while (bucket < NUM_BUCKETS - 1 && (nanoseconds >> bucket))
+			++bucket;
+		buckets[op][bucket].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	std::string format() const;
+};
+
+// ----------------------------------------------------------------------------
+std::string server_stats::format() const
+{
+	static const char* op_names[SERVER_OP_COUNT] =
+		{ "unknown", "addr_to_line", "addr_to_symbol", "name_to_addr", "line_to_addrs", "stats" };
+
+	std::string text;
+	char line[128];
+	for (int op = 0; op < SERVER_OP_COUNT; ++op)
+	{
+		uint64_t counts[NUM_BUCKETS];
+		uint64_t total = 0;
+		for (int b = 0; b < NUM_BUCKETS; ++b)
+		{
+			counts[b] = buckets[op][b].load(std::memory_order_relaxed);
+			total += counts[b];
+		}
+		if (!total)
+			continue;
+
+		// Percentiles are reported as the upper bound of their bucket
+		uint64_t p50 = 0, p99 = 0, seen = 0;
+		for (int b = 0; b < NUM_BUCKETS; ++b)
+		{
+			seen += counts[b];
+			if (!p50 && seen * 2 >= total)
+				p50 = 1ULL << b;
+			if (!p99 && seen * 100 >= total * 99)
+				p99 = 1ULL << b;
+		}
+		snprintf(line, sizeof(line), "%s: count=%llu p50<%lluns p99<%lluns\n", op_names[op],
+			(unsigned long long)total, (unsigned long long)p50, (unsigned long long)p99);
+		text += line;
+		for (int b = 0; b < NUM_BUCKETS; ++b)
+		{
+			if (!counts[b])
+				continue;
+			snprintf(line, sizeof(line), "  <%lluns: %llu\n",
+				(unsigned long long)(1ULL << b), (unsigned long long)counts[b]);
+			text += line;
+		}
+	}
+	return text;
+}
+
+// ----------------------------------------------------------------------------
+//	PROTOCOL
+// ----------------------------------------------------------------------------
+static const size_t REQUEST_HEADER_SIZE = 8;
+static const size_t REPLY_HEADER_SIZE = 12;
+
+static uint64_t get_le(const uint8_t* data, int size)
+{
+	uint64_t val = 0;
+	for (int i = size; i > 0; --i)
+		val = (val << 8) | data[i - 1];
+	return val;
+}
+
+// ----------------------------------------------------------------------------
+// Builds up replies to be written in one go
+class reply_writer
+{
+public:
+	void begin(uint8_t op, uint32_t tag)
+	{
+		m_start = m_data.size();
+		put(0, 4);			// length, filled in by end()
+		put(op, 1);
+		put(SERVER_STATUS_OK, 1);
+		put(0, 2);
+		put(tag, 4);
+	}
+
+	void end(uint8_t status)
+	{
+		uint64_t length = m_data.size() - m_start - REPLY_HEADER_SIZE;
+		for (int i = 0; i < 4; ++i)
+			m_data[m_start + i] = (uint8_t)(length >> (i * 8));
+		m_data[m_start + 5] = status;
+	}
+
+	// Discard any payload written since begin()
+	void clear_payload()
+	{
+		m_data.resize(m_start + REPLY_HEADER_SIZE);
+	}
+
+	void put(uint64_t val, int size)
+	{
+		for (int i = 0; i < size; ++i)
+			m_data.push_back((uint8_t)(val >> (i * 8)));
+	}
+
+	void put_string(const std::string& str)
+	{
+		size_t len = str.size() > 0xffff ? 0xffff : str.size();
+		put(len, 2);
+		m_data.insert(m_data.end(), str.begin(), str.begin() + len);
+	}
+
+	void put_bytes(const std::string& str)
+	{
+		m_data.insert(m_data.end(), str.begin(), str.end());
+	}
+
+	std::vector<uint8_t>& data()	{ return m_data; }
+
+private:
+	std::vector<uint8_t>	m_data;
+	size_t					m_start;
+};
+
+// ----------------------------------------------------------------------------
+struct server_state
+{
+	std::vector<std::unique_ptr<fonda::symbolizer> >	modules;
+	server_stats									stats;
+};
+
+// ----------------------------------------------------------------------------
+// Handle one request, writing the reply payload. Returns one of server_status.
+static int handle_request(const server_state& state, uint8_t op, uint8_t module_id,
+	const uint8_t* payload, size_t length, reply_writer& reply)
+{
+	if (op == SERVER_OP_STATS)
+	{
+		reply.put_bytes(state.stats.format());
+		return SERVER_STATUS_OK;
+	}
+	if (module_id >= state.modules.size())
+		return SERVER_STATUS_BAD_MODULE;
+	const fonda::symbolizer& mod = *state.modules[module_id];
+
+	switch (op)
+	{
+		case SERVER_OP_ADDR_TO_LINE:
+		{
+			if (length != 8)
+				return SERVER_STATUS_BAD_REQUEST;
+			fonda::line_location loc;
+			if (!mod.find_line(get_le(payload, 8), loc))
+				return SERVER_STATUS_NOT_FOUND;
+			std::string path;
+			if (loc.file)
+			{
+				if (loc.file->dir_index < loc.unit->dirs.size())
+					path = loc.unit->dirs[loc.file->dir_index] + "/";
+				path += loc.file->path;
+			}
+			reply.put(loc.point->address, 8);
+			reply.put(loc.point->line, 4);
+			reply.put(loc.point->column, 2);
+			reply.put_string(path);
+			return SERVER_STATUS_OK;
+		}
+		case SERVER_OP_ADDR_TO_SYMBOL:
+		{
+			if (length != 8)
+				return SERVER_STATUS_BAD_REQUEST;
+			const fonda::lookup_symbol* sym = mod.find_symbol(get_le(payload, 8));
+			if (!sym)
+				return SERVER_STATUS_NOT_FOUND;
+			reply.put(sym->address, 8);
+			reply.put(sym->size, 8);
+			reply.put_string(sym->name);
+			return SERVER_STATUS_OK;
+		}
+		case SERVER_OP_NAME_TO_ADDR:
+		{
+			const fonda::lookup_symbol* sym = mod.find_symbol(std::string((const char*)payload, length));
+			if (!sym)
+				return SERVER_STATUS_NOT_FOUND;
+			reply.put(sym->address, 8);
+			reply.put(sym->size, 8);
+			return SERVER_STATUS_OK;
+		}
+		case SERVER_OP_LINE_TO_ADDRS:
+		{
+			if (length < 4)
+				return SERVER_STATUS_BAD_REQUEST;
+			std::vector<uint64_t> addresses;
+			std::string path((const char*)payload + 4, length - 4);
+			mod.find_addresses(path.c_str(), get_le(payload, 4), addresses);
+			if (addresses.empty())
+				return SERVER_STATUS_NOT_FOUND;
+			reply.put(addresses.size(), 4);
+			for (uint64_t addr : addresses)
+				reply.put(addr, 8);
+			return SERVER_STATUS_OK;
+		}
+		default:
+			break;
+	}
+	return SERVER_STATUS_BAD_REQUEST;
+}
+
+// ----------------------------------------------------------------------------
+static bool write_all(int fd, const uint8_t* data, size_t size)
+{
+	while (size)
+	{
+		ssize_t count = write(fd, data, size);
+		if (count <= 0)
+			return false;
+		data += count;
+		size -= count;
+	}
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+// Serve requests from one input until it closes.
+static void serve_stream(server_state& state, int in_fd, int out_fd)
+{
+	// Large enough for several maximum-size requests
+	std::vector<uint8_t> input(256 * 1024);
+	size_t start = 0, end = 0;
+	reply_writer reply;
+
+	while (1)
+	{
+		// Handle every complete request already read
+		while (end - start >= REQUEST_HEADER_SIZE)
+		{
+			const uint8_t* header = &input[start];
+			size_t length = get_le(header, 2);
+			if (end - start < REQUEST_HEADER_SIZE + length)
+				break;
+
+			uint8_t op = header[2];
+			uint8_t module_id = header[3];
+			uint32_t tag = get_le(header + 4, 4);
+
+			std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+			reply.begin(op, tag);
+			int status = handle_request(state, op, module_id, header + REQUEST_HEADER_SIZE, length, reply);
+			if (status != SERVER_STATUS_OK)
+				reply.clear_payload();
+			reply.end(status);
+			std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+			state.stats.record(op, std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+
+			start += REQUEST_HEADER_SIZE + length;
+		}
+
+		// Input is drained, so send the batch of replies
+		std::vector<uint8_t>& out = reply.data();
+		if (out.size())
+		{
+			if (!write_all(out_fd, out.data(), out.size()))
+				return;
+			out.clear();
+		}
+
+		// Move any partial request to the front and read more
+		memmove(input.data(), input.data() + start, end - start);
+		end -= start;
+		start = 0;
+		ssize_t count = read(in_fd, input.data() + end, input.size() - end);
+		if (count <= 0)
+			return;
+		end += count;
+	}
+}
+
+// ----------------------------------------------------------------------------
+static int serve_socket(server_state& state, const char* path)
+{
+	int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd < 0)
+	{
+		fprintf(stderr, "Error: Can't create socket\n");
+		return 1;
+	}
+
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr, "Error: Socket path too long: %s\n", path);
+		close(listen_fd);
+		return 1;
+	}
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_fd, 8) != 0)
+	{
+		fprintf(stderr, "Error: Can't listen on socket: %s\n", path);
+		close(listen_fd);
+		return 1;
+	}
+
+	// Each client gets its own thread. The modules are not modified after
+	// loading, so no locking is needed for queries.
+	std::mutex clients_mutex;
+	std::condition_variable clients_done;
+	size_t active_clients = 0;
+	while (1)
+	{
+		int client_fd = accept(listen_fd, nullptr, nullptr);
+		if (client_fd < 0)
+		{
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			break;
+		}
+		{
+			std::lock_guard<std::mutex> lock(clients_mutex);
+			++active_clients;
+		}
+		std::thread([&, client_fd] {
+			serve_stream(state, client_fd, client_fd);
+			close(client_fd);
+			std::lock_guard<std::mutex> lock(clients_mutex);
+			--active_clients;
+			clients_done.notify_all();
+		}).detach();
+	}
+	close(listen_fd);
+
+	// "state" must outlive every client
+	std::unique_lock<std::mutex> lock(clients_mutex);
+	clients_done.wait(lock, [&] { return active_clients == 0; });
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+int server_main(const std::vector<std::string>& fnames, const server_options& opts)
+{
+	// A client closing early must only end its own stream, with EPIPE
+	signal(SIGPIPE, SIG_IGN);
+
+	server_state state;
+	for (const std::string& fname : fnames)
+	{
+		std::unique_ptr<fonda::symbolizer> mod(new fonda::symbolizer);
+		int ret = mod->load(fname.c_str(), opts.force_tos);
+		if (ret)
+		{
+			fprintf(stderr, "Error: Can't load %s (error %d)\n", fname.c_str(), ret);
+			return 2;
+		}
+		// Do the lazy work now, so client threads never wait on each other
+		mod->freeze();
+		state.modules.push_back(std::move(mod));
+	}
+
+	int ret = 0;
+	if (opts.socket_path)
+		ret = serve_socket(state, opts.socket_path);
+	else
+		serve_stream(state, STDIN_FILENO, STDOUT_FILENO);
+
+	fprintf(stderr, "%s", state.stats.format().c_str());
+	return ret;
+}
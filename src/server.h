@@ -0,0 +1,57 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string>
+#include <vector>
+
+// ----------------------------------------------------------------------------
+// Query server mode. Binaries are loaded and indexed once, then requests are
+// answered over stdin/stdout or a Unix domain socket until the input closes.
+//
+// Requests and replies are binary frames. All integers are little-endian.
+//
+// Request header (8 bytes):
+//   u16 length		number of payload bytes after the header
+//   u8  op			one of server_op
+//   u8  module		index of the binary, in command-line order
+//   u32 tag		copied to the reply, to match pipelined requests
+//
+// Reply header (12 bytes):
+//   u32 length		number of payload bytes after the header
+//   u8  op
+//   u8  status		one of server_status
+//   u16 reserved	always 0
+//   u32 tag
+//
+// Strings in replies are a u16 length followed by the bytes.
+//
+// Replies to all requests that arrive together are written together.
+// ----------------------------------------------------------------------------
+enum server_op
+{
+	SERVER_OP_ADDR_TO_LINE = 1,		// u64 address -> u64 row address, u32 line, u16 column, string path
+	SERVER_OP_ADDR_TO_SYMBOL = 2,	// u64 address -> u64 address, u64 size, string name
+	SERVER_OP_NAME_TO_ADDR = 3,		// name bytes -> u64 address, u64 size
+	SERVER_OP_LINE_TO_ADDRS = 4,	// u32 line, path bytes -> u32 count, u64 addresses[count]
+	SERVER_OP_STATS = 5,			// (empty) -> latency histogram text
+	SERVER_OP_COUNT
+};
+
+enum server_status
+{
+	SERVER_STATUS_OK = 0,
+	SERVER_STATUS_NOT_FOUND = 1,
+	SERVER_STATUS_BAD_REQUEST = 2,
+	SERVER_STATUS_BAD_MODULE = 3
+};
+
+struct server_options
+{
+	bool force_tos;					// parse every input as TOS, rather than auto-detecting
+	const char* socket_path;		// listen on this Unix socket, or use stdin/stdout if null
+};
+
+// Returns the process exit code
+extern int server_main(const std::vector<std::string>& fnames, const server_options& opts);
+
+#endif // SERVER_H
@@ -0,0 +1,942 @@
+// Prints what the decoders found in a fixture, for run_tests.sh to compare
+// against the expected output. Each command prints one part of the results.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fonda_lib/address_space.h"
+#include "fonda_lib/async_loader.h"
+#include "fonda_lib/readelf.h"
+#include "fonda_lib/readtos.h"
+#include "fonda_lib/symbolizer.h"
+#include "server.h"
+
+using namespace fonda;
+
+// ----------------------------------------------------------------------------
+static void usage()
+{
+	fprintf(stdout,
+		"Usage: fixture_dump <command> [file] [args...]\n\n"
+		"Commands:\n"
+		"  async <stop> <addr...>\n"
+		"                   Stages of a background load prioritising the addresses,\n"
+		"                   stopping after stage <stop> (0 for none)\n"
+		"  debug <dir...>   Build ID, .gnu_debuglink and the separate debug file found\n"
+		"  dynsym <name...> Dynamic symbol lookups through the file's hash table\n"
+		"  frames <addr...> Call frame rules from .eh_frame and .debug_frame\n"
+		"  functions        Functions from .debug_info\n"
+		"  image <addr...>  Program headers, and the load image bytes at the addresses\n"
+		"  lazy <max_bytes> [path:line...]\n"
+		"                   Lazily decoded line lookups compared with the eager index\n"
+		"  lookup <addr...> Single line lookups through .debug_aranges\n"
+		"  rangemap <start-end:value...>\n"
+		"                   Address ranges built into an elf_range_map, with no file\n"
+		"  ranges           Address ranges of units and functions\n"
+		"  relocs           Relocations and the symbols they refer to\n"
+		"  reload <new>     Reload <new> reusing what is unchanged from <file>\n"
+		"  replies          Decode fonda --server replies from stdin, with no file\n"
+		"  requests <request...>\n"
+		"                   Encode fonda --server requests to stdout, with no file. Each is\n"
+		"                   line|symbol <module> <addr>, name <module> <name>,\n"
+		"                   addrs <module> <path:line>, or op <op> <module> with no payload\n"
+		"  shared <addr...> Lookups in shared_symbolizer snapshots, while reloading\n"
+		"  space <file@bias...> -- <addr...>\n"
+		"                   Runtime address lookups in modules loaded at the biases, with no file\n"
+		"  tos              TOS header, symbols and relocations\n"
+	);
+}
+
+// ----------------------------------------------------------------------------
+static int load_elf(const char* fname, elf_results& results)
+{
+	FILE* file = fopen(fname, "rb");
+	if (!file)
+	{
+		fprintf(stdout, "Can't open file: %s\n", fname);
+		return 1;
+	}
+	int ret = process_elf_file(file, results);
+	fclose(file);
+	if (ret != elf_error::OK)
+		fprintf(stdout, "Parsing failed with error %d\n", ret);
+	return ret;
+}
+
+// ----------------------------------------------------------------------------
+static int dump_functions(const char* fname, int, char**)
+{
+	elf_results results;
+	int ret = load_elf(fname, results);
+	if (ret != elf_error::OK)
+		return ret;
+
+	for (const elf_function& func : results.functions)
+		fprintf(stdout, "%llx-%llx unit %llx %s\n", (unsigned long long)func.low_pc,
+			(unsigned long long)func.high_pc, (unsigned long long)func.unit_offset, func.name.c_str());
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+static int find_debug_file(const char* fname, int argc, char** argv)
+{
+	elf_results results;
+	int ret = load_elf(fname, results);
+	if (ret != elf_error::OK)
+		return ret;
+
+	fprintf(stdout, "build id ");
+	for (uint8_t b : results.build_id)
+		fprintf(stdout, "%02x", b);
+	fprintf(stdout, "\ndebuglink \"%s\" crc %08x\n", results.debuglink.c_str(), results.debuglink_crc);
+
+	std::vector<std::string> debug_dirs(argv, argv + argc);
+	std::string debug_fname;
+	if (find_elf_debug_file(results, fname, debug_dirs, debug_fname))
+		fprintf(stdout, "found %s\n", debug_fname.c_str());
+	else
+		fprintf(stdout, "not found\n");
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+static int lookup_dynamic_symbols(const char* fname, int argc, char** argv)
+{
+	elf_results results;
+	int ret = load_elf(fname, results);
+	if (ret != elf_error::OK)
+		return ret;
+
+	fprintf(stdout, "hash type %x, %u dynamic symbols\n", results.dynamic_hash.type,
+		(uint32_t)results.dynamic_symbols.size());
+	for (int i = 0; i < argc; ++i)
+	{
+		const elf_symbol* sym = find_elf_dynamic_symbol(results, argv[i]);
+		if (sym)
+			fprintf(stdout, "%s %llx size %llu section %u\n", argv[i], (unsigned long long)sym->st_value,
+				(unsigned long long)sym->st_size, sym->st_shndx);
+		else
+			fprintf(stdout, "%s not found\n", argv[i]);
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+static void print_rule(const elf_cfi_rule& rule)
+{
+	switch (rule.type)
+	{
+		case cfi_rule::UNDEFINED:		fprintf(stdout, "undefined"); break;
+		case cfi_rule::SAME_VALUE:		fprintf(stdout, "same"); break;
+		case cfi_rule::OFFSET:			fprintf(stdout, "[cfa%+lld]", (long long)rule.offset); break;
+		case cfi_rule::VAL_OFFSET:		fprintf(stdout, "r%u%+lld", rule.reg, (long long)rule.offset); break;
+		case cfi_rule::REGISTER:		fprintf(stdout, "r%u", rule.reg); break;
+		case cfi_rule::EXPRESSION:		fprintf(stdout, "[expr %llu bytes]", (unsigned long long)rule.expression_size); break;
+		case cfi_rule::VAL_EXPRESSION:	fprintf(stdout, "expr %llu bytes", (unsigned long long)rule.expression_size); break;
+	}
+}
+
+// ----------------------------------------------------------------------------
+static int dump_frames(const char* fname, int argc, char** argv)
+{
+	symbolizer sym;
+	int ret = sym.load(fname, false);
+	if (ret != elf_error::OK)
+	{
+		fprintf(stdout, "Parsing failed with error %d\n", ret);
+		return ret;
+	}
+
+	for (int i = 0; i < argc; ++i)
+	{
+		uint64_t address = strtoull(argv[i], nullptr, 16);
+		frame_location loc;
+		if (!sym.find_frame(address, loc))
+		{
+			fprintf(stdout, "%llx no frame\n", (unsigned long long)address);
+			continue;
+		}
+		fprintf(stdout, "%llx row %llx-%llx return r%u cfa ", (unsigned long long)address,
+			(unsigned long long)loc.row->start, (unsigned long long)loc.row->end, loc.cie->return_register);
+		print_rule(loc.row->cfa);
+		for (uint32_t r = 0; r < loc.row->num_rules; ++r)
+		{
+			const elf_cfi_rule& rule = loc.table->rules[loc.row->first_rule + r];
+			fprintf(stdout, " r%u ", rule.column);
+			print_rule(rule);
+		}
+		fprintf(stdout, "\n");
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+static int dump_ranges(const char* fname, int, char**)
+{
+	elf_results results;
+	int ret = load_elf(fname, results);
+	if (ret != elf_error::OK)
+		return ret;
+
+	for (const elf_address_range& range : results.unit_ranges.ranges)
+		fprintf(stdout, "unit %llx-%llx %llx\n", (unsigned long long)range.start,
+			(unsigned long long)range.end, (unsigned long long)range.value);
+	for (const elf_address_range& range : results.function_ranges.ranges)
+		fprintf(stdout, "function %llx-%llx %s\n", (unsigned long long)range.start,
+			(unsigned long long)range.end, results.functions[range.value].name.c_str());
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+static int build_range_map(const char*, int argc, char** argv)
+{
+	elf_range_map map;
+	for (int i = 0; i < argc; ++i)
+	{
+		unsigned long long start, end, value;
+		if (sscanf(argv[i], "%llx-%llx:%llx", &start, &end, &value) != 3)
+		{
+			fprintf(stdout, "Bad range: %s\n", argv[i]);
+			return 1;
+		}
+		map.add(start, end, value);
+	}
+	map.build();
+	for (const elf_address_range& range : map.ranges)
+		fprintf(stdout, "%llx-%llx %llx\n", (unsigned long long)range.start,
+			(unsigned long long)range.end, (unsigned long long)range.value);
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+static int dump_relocations(const char* fname, int, char**)
+{
+	elf_results results;
+	int ret = load_elf(fname, results);
+	if (ret != elf_error::OK)
+		return ret;
+
+	for (const elf_relocation& rel : results.relocations)
+	{
+		// Names are quoted, since section symbols have none
+		std::string name = rel.symbol == ~0U ? "-" : "\"" + results.symbols[rel.symbol].name + "\"";
+		fprintf(stdout, "%llx type %u section %u target %u addend %lld %s\n", (unsigned long long)rel.site,
+			rel.type, rel.section_id, rel.target_section, (long long)rel.addend, name.c_str());
+	}
+
+	// The indexes, by site and by symbol
+	for (uint32_t index : results.relocation_sites)
+		fprintf(stdout, "site %llx %u\n", (unsigned long long)results.relocations[index].site, index);
+	for (uint32_t index : results.relocation_symbols)
+		fprintf(stdout, "symbol \"%s\" %u\n", results.symbols[results.relocations[index].symbol].name.c_str(), index);
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+static bool read_file(const char* fname, std::vector<uint8_t>& data)
+{
+	FILE* file = fopen(fname, "rb");
+	if (!file)
+	{
+		fprintf(stdout, "Can't open file: %s\n", fname);
+		return false;
+	}
+	uint8_t buf[4096];
+	size_t count;
+	while ((count = fread(buf, 1, sizeof(buf), file)) != 0)
+		data.insert(data.end(), buf, buf + count);
+	fclose(file);
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+static int dump_image(const char* fname, int argc, char** argv)
+{
+	elf_results results;
+	int ret = load_elf(fname, results);
+	if (ret != elf_error::OK)
+		return ret;
+	std::vector<uint8_t> data;
+	if (!read_file(fname, data))
+		return 1;
+
+	for (const elf_segment& seg : results.segments)
+		fprintf(stdout, "segment type %x flags %x offset %llx vaddr %llx paddr %llx file %llx mem %llx align %llx\n",
+			seg.type, seg.flags, (unsigned long long)seg.offset, (unsigned long long)seg.vaddr,
+			(unsigned long long)seg.paddr, (unsigned long long)seg.file_size, (unsigned long long)seg.mem_size,
+			(unsigned long long)seg.align);
+
+	std::vector<elf_segment_view> views;
+	ret = get_elf_load_segments(results, data.data(), data.size(), views);
+	if (ret != elf_error::OK)
+	{
+		fprintf(stdout, "No load segments, error %d\n", ret);
+		return ret;
+	}
+	uint64_t start = ~0ULL, end = 0;
+	for (const elf_segment_view& view : views)
+	{
+		fprintf(stdout, "load vaddr %llx from file offset %llx\n", (unsigned long long)view.segment->vaddr,
+			(unsigned long long)(view.data - data.data()));
+		start = std::min(start, view.segment->vaddr);
+		end = std::max(end, view.segment->vaddr + view.segment->mem_size);
+	}
+	if (views.empty())
+		return 0;
+
+	// The gaps between segments are left alone, so fill them to show that
+	std::vector<uint8_t> image(end - start, 0xaa);
+	ret = load_elf_image(results, data.data(), data.size(), image.data(), start, image.size());
+	fprintf(stdout, "image %llx-%llx: error %d\n", (unsigned long long)start, (unsigned long long)end, ret);
+	std::vector<uint8_t> read_image(end - start, 0xaa);
+	FILE* file = fopen(fname, "rb");
+	ret = file ? read_elf_image(file, results, read_image.data(), start, read_image.size()) : -1;
+	if (file)
+		fclose(file);
+	fprintf(stdout, "read from the file: error %d, %s\n", ret, read_image == image ? "same" : "different");
+
+	// One byte short of the last segment
+	ret = load_elf_image(results, data.data(), data.size(), image.data(), start, image.size() - 1);
+	fprintf(stdout, "image one byte short: error %d\n", ret);
+
+	for (int i = 0; i < argc; ++i)
+	{
+		uint64_t address = strtoull(argv[i], nullptr, 16);
+		fprintf(stdout, "%llx", (unsigned long long)address);
+		for (uint64_t a = address; a < address + 8 && a >= start && a < end; ++a)
+			fprintf(stdout, " %02x", image[a - start]);
+		fprintf(stdout, "\n");
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+// A line lookup result, for comparing indexes
+static std::string describe_location(bool found, const line_location& loc)
+{
+	if (!found)
+		return "none";
+	char buf[256];
+	snprintf(buf, sizeof(buf), "%s:%u:%u at %llx", loc.file ? loc.file->path.c_str() : "?",
+		loc.point->line, loc.point->column, (unsigned long long)loc.point->address);
+	return buf;
+}
+
+// ----------------------------------------------------------------------------
+static void print_addresses(const char* name, const std::vector<uint64_t>& addresses)
+{
+	fprintf(stdout, " %s", name);
+	for (uint64_t address : addresses)
+		fprintf(stdout, " %llx", (unsigned long long)address);
+}
+
+// ----------------------------------------------------------------------------
+static int compare_lazy_lines(const char* fname, int argc, char** argv)
+{
+	if (argc < 1)
+	{
+		usage();
+		return 1;
+	}
+	uint64_t max_bytes = strtoull(argv[0], nullptr, 0);
+
+	symbolizer eager;
+	int ret = eager.load(fname, false);
+	if (ret != 0)
+	{
+		fprintf(stdout, "Parsing failed with error %d\n", ret);
+		return ret;
+	}
+	elf_results results;
+	FILE* file = fopen(fname, "rb");
+	if (!file)
+	{
+		fprintf(stdout, "Can't open file: %s\n", fname);
+		return 1;
+	}
+	elf_parse_options options;
+	options.parts = elf_parts::DEBUG_INFO | elf_parts::LINE_PROGRAMS;
+	ret = process_elf_file(file, results, options);
+	fclose(file);
+	if (ret != elf_error::OK)
+	{
+		fprintf(stdout, "Parsing failed with error %d\n", ret);
+		return ret;
+	}
+
+	// Once with every unit kept, for the memory they take together
+	lazy_line_index all;
+	all.build(results, fname);
+	lazy_line_index lazy;
+	lazy.set_max_bytes(max_bytes);
+	lazy.build(results, fname);
+
+	// Look up each code point and the address before it, in address order
+	// and then backwards, so units are evicted and decoded again
+	std::vector<uint64_t> addresses;
+	for (const line_index::entry& e : eager.lines().entries())
+	{
+		if (e.address)
+			addresses.push_back(e.address - 1);
+		addresses.push_back(e.address);
+	}
+	addresses.insert(addresses.end(), addresses.rbegin(), addresses.rend());
+
+	uint32_t differed = 0;
+	uint64_t peak = 0;
+	for (uint64_t address : addresses)
+	{
+		line_location eager_loc, lazy_loc, all_loc;
+		std::string expected = describe_location(eager.find_line(address, eager_loc), eager_loc);
+		std::string found = describe_location(lazy.find(address, lazy_loc), lazy_loc);
+		all.find(address, all_loc);
+		peak = std::max(peak, lazy.cached_bytes());
+		if (found != expected && differed++ < 10)
+			fprintf(stdout, "%llx eager %s lazy %s\n", (unsigned long long)address, expected.c_str(), found.c_str());
+	}
+	fprintf(stdout, "%u units, %u lookups, %u differed\n", (uint32_t)results.line_programs.size(),
+		(uint32_t)addresses.size(), differed);
+	fprintf(stdout, "cache peak below all units: %s\n", peak < all.cached_bytes() ? "yes" : "no");
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string path = argv[i];
+		size_t colon = path.rfind(':');
+		if (colon == std::string::npos)
+			continue;
+		uint32_t line = (uint32_t)strtoul(path.c_str() + colon + 1, nullptr, 10);
+		path.resize(colon);
+		std::vector<uint64_t> eager_addresses, lazy_addresses;
+		eager.find_addresses(path.c_str(), line, eager_addresses);
+		lazy.find_addresses(path.c_str(), line, lazy_addresses);
+		fprintf(stdout, "%s:%u", path.c_str(), line);
+		print_addresses("eager", eager_addresses);
+		print_addresses("lazy", lazy_addresses);
+		fprintf(stdout, "\n");
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+static int lookup_addresses(const char* fname, int argc, char** argv)
+{
+	for (int i = 0; i < argc; ++i)
+	{
+		uint64_t address = strtoull(argv[i], nullptr, 16);
+		FILE* file = fopen(fname, "rb");
+		if (!file)
+		{
+			fprintf(stdout, "Can't open file: %s\n", fname);
+			return 1;
+		}
+		compilation_unit unit;
+		size_t point_index = 0;
+		int ret = lookup_elf_address(file, address, unit, point_index);
+		fclose(file);
+		if (ret != elf_error::OK)
+		{
+			fprintf(stdout, "%llx error %d\n", (unsigned long long)address, ret);
+			continue;
+		}
+		const code_point& point = unit.points[point_index];
+		fprintf(stdout, "%llx %s:%u:%u at %llx\n", (unsigned long long)address,
+			unit.files[point.file_index].path.c_str(), point.line, point.column,
+			(unsigned long long)point.address);
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+// The symbol, line and whether there is a frame at an address, as one line
+static std::string describe_address(const symbolizer& sym, uint64_t address)
+{
+	char buf[256];
+	int len = snprintf(buf, sizeof(buf), "%llx", (unsigned long long)address);
+	const lookup_symbol* symbol = sym.find_symbol(address);
+	if (symbol)
+		len += snprintf(buf + len, sizeof(buf) - len, " %s+%llx", symbol->name.c_str(),
+			(unsigned long long)(address - symbol->address));
+	line_location loc;
+	if (sym.find_line(address, loc))
+		len += snprintf(buf + len, sizeof(buf) - len, " %s:%u", loc.file->path.c_str(), loc.point->line);
+	frame_location frame;
+	snprintf(buf + len, sizeof(buf) - len, " frame %s", sym.find_frame(address, frame) ? "yes" : "no");
+	return buf;
+}
+
+// ----------------------------------------------------------------------------
+// Counts of what a snapshot of a background load holds
+static void print_snapshot(const symbolizer& sym)
+{
+	fprintf(stdout, "%s: %u symbols, %u lines, %u functions, %u frames\n", sym.is_tos() ? "tos" : "elf",
+		(uint32_t)sym.symbols().symbols().size(), (uint32_t)sym.lines().entries().size(),
+		(uint32_t)sym.elf().functions.size(), (uint32_t)sym.elf().cfi.fdes.size());
+}
+
+// ----------------------------------------------------------------------------
+static int load_async(const char* fname, int argc, char** argv)
+{
+	if (argc < 1)
+	{
+		usage();
+		return 1;
+	}
+	uint32_t stop_stage = (uint32_t)strtoul(argv[0], nullptr, 10);
+	std::vector<uint64_t> priority_addresses;
+	for (int i = 1; i < argc; ++i)
+		priority_addresses.push_back(strtoull(argv[i], nullptr, 16));
+
+	// Each snapshot is shown as it is published, while the worker waits
+	async_loader loader;
+	loader.set_stage_callback([&](uint32_t stage)
+	{
+		shared_symbolizer::snapshot snap = loader.get();
+		fprintf(stdout, "stage %u ", stage);
+		print_snapshot(*snap);
+		for (uint64_t address : priority_addresses)
+			fprintf(stdout, "  %s\n", describe_address(*snap, address).c_str());
+		return stage != stop_stage;
+	});
+	loader.start(fname, false, priority_addresses);
+	int ret = loader.wait();
+	load_progress progress = loader.get_progress();
+	fprintf(stdout, "result %d, stage %u, progress result %d\n", ret, progress.stage, progress.result);
+
+	// The last snapshot published stays after the load ends
+	loader.cancel();
+	shared_symbolizer::snapshot last = loader.get();
+	fprintf(stdout, "after cancel: ");
+	if (last)
+		print_snapshot(*last);
+	else
+		fprintf(stdout, "no snapshot\n");
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+static int lookup_shared(const char* fname, int argc, char** argv)
+{
+	shared_symbolizer shared;
+	fprintf(stdout, "before load: %s\n", shared.get() ? "snapshot" : "none");
+	int ret = shared.load(fname, false);
+	if (ret != 0)
+	{
+		fprintf(stdout, "Parsing failed with error %d\n", ret);
+		return ret;
+	}
+
+	shared_symbolizer::snapshot first = shared.get();
+	std::vector<uint64_t> addresses;
+	std::vector<std::string> expected;
+	for (int i = 0; i < argc; ++i)
+	{
+		addresses.push_back(strtoull(argv[i], nullptr, 16));
+		expected.push_back(describe_address(*first, addresses.back()));
+		fprintf(stdout, "%s\n", expected.back().c_str());
+	}
+
+	// Readers take snapshots while the file is reloaded and loaded again.
+	// Each snapshot must give the same answers.
+	static const int NUM_READERS = 4;
+	static const int NUM_UPDATES = 10;
+	std::atomic<bool> updating(true);
+	std::atomic<uint32_t> lookups(0), differed(0);
+	std::vector<std::thread> readers;
+	for (int r = 0; r < NUM_READERS; ++r)
+	{
+		readers.push_back(std::thread([&]()
+		{
+			do
+			{
+				shared_symbolizer::snapshot snap = shared.get();
+				for (size_t i = 0; i < addresses.size(); ++i)
+				{
+					if (describe_address(*snap, addresses[i]) != expected[i])
+						++differed;
+					++lookups;
+				}
+			} while (updating);
+		}));
+	}
+	int update_errors = 0;
+	for (int u = 0; u < NUM_UPDATES; ++u)
+		update_errors += (u & 1 ? shared.load(fname, false) : shared.reload(fname, false)) != 0;
+	updating = false;
+	for (std::thread& t : readers)
+		t.join();
+	fprintf(stdout, "%d updates, %d failed, lookups differed %u times\n", NUM_UPDATES, update_errors,
+		differed.load());
+	if (!lookups)
+		fprintf(stdout, "no lookups made\n");
+
+	// The first snapshot is still held, and unchanged
+	bool unchanged = true;
+	for (size_t i = 0; i < addresses.size(); ++i)
+		unchanged &= describe_address(*first, addresses[i]) == expected[i];
+	fprintf(stdout, "first snapshot %s, %s\n", first == shared.get() ? "current" : "replaced",
+		unchanged ? "unchanged" : "changed");
+
+	// A failed load keeps the current snapshot
+	shared_symbolizer::snapshot current = shared.get();
+	ret = shared.load("missing", false);
+	fprintf(stdout, "missing file: error %d, snapshot %s\n", ret, shared.get() == current ? "kept" : "lost");
+	shared.clear();
+	fprintf(stdout, "after clear: %s\n", shared.get() ? "snapshot" : "none");
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+static int lookup_address_space(const char*, int argc, char** argv)
+{
+	// The modules must outlive the address space
+	std::vector<std::unique_ptr<symbolizer> > modules;
+	address_space space;
+	int i = 0;
+	for (; i < argc && strcmp(argv[i], "--") != 0; ++i)
+	{
+		std::string name = argv[i];
+		size_t at = name.rfind('@');
+		if (at == std::string::npos)
+		{
+			fprintf(stdout, "Bad module: %s\n", argv[i]);
+			return 1;
+		}
+		uint64_t bias = strtoull(name.c_str() + at + 1, nullptr, 16);
+		name.resize(at);
+
+		modules.push_back(std::unique_ptr<symbolizer>(new symbolizer));
+		int ret = modules.back()->load(name.c_str(), false);
+		if (ret != 0)
+		{
+			fprintf(stdout, "Parsing failed with error %d\n", ret);
+			return ret;
+		}
+		bool added = space.add(name, *modules.back(), bias);
+		fprintf(stdout, "add %s at %llx: %s\n", name.c_str(), (unsigned long long)bias,
+			added ? "ok" : "rejected");
+	}
+	for (const module_mapping& m : space.mappings())
+		fprintf(stdout, "mapping %llx-%llx bias %llx %s\n", (unsigned long long)m.start,
+			(unsigned long long)m.end, (unsigned long long)m.bias, m.name.c_str());
+
+	// Results are in module addresses
+	for (++i; i < argc; ++i)
+	{
+		uint64_t address = strtoull(argv[i], nullptr, 16);
+		const module_mapping* mapping = space.find(address);
+		if (!mapping)
+		{
+			fprintf(stdout, "%llx no module\n", (unsigned long long)address);
+			continue;
+		}
+		fprintf(stdout, "%llx %s %llx", (unsigned long long)address, mapping->name.c_str(),
+			(unsigned long long)mapping->to_module(address));
+		const module_mapping* sym_mapping;
+		const lookup_symbol* sym = space.find_symbol(address, sym_mapping);
+		if (sym)
+			fprintf(stdout, " %s+%llx", sym->name.c_str(),
+				(unsigned long long)(mapping->to_module(address) - sym->address));
+		line_location loc;
+		if (space.find_line(address, loc))
+			fprintf(stdout, " %s:%u", loc.file->path.c_str(), loc.point->line);
+		fprintf(stdout, "\n");
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+// True if the line units and symbols of two parses are the same
+static bool same_lines_and_symbols(const elf_results& a, const elf_results& b)
+{
+	if (a.line_info_units.size() != b.line_info_units.size() || a.symbols.size() != b.symbols.size())
+		return false;
+	for (size_t u = 0; u < a.line_info_units.size(); ++u)
+	{
+		const compilation_unit& ua = a.line_info_units[u];
+		const compilation_unit& ub = b.line_info_units[u];
+		if (ua.points.size() != ub.points.size() || ua.files.size() != ub.files.size())
+			return false;
+		for (size_t i = 0; i < ua.points.size(); ++i)
+		{
+			const code_point& pa = ua.points[i];
+			const code_point& pb = ub.points[i];
+			if (pa.address != pb.address || pa.line != pb.line || pa.column != pb.column ||
+				pa.file_index != pb.file_index)
+				return false;
+		}
+		for (size_t i = 0; i < ua.files.size(); ++i)
+			if (ua.files[i].path != ub.files[i].path)
+				return false;
+	}
+	for (size_t i = 0; i < a.symbols.size(); ++i)
+	{
+		if (a.symbols[i].name != b.symbols[i].name || a.symbols[i].st_value != b.symbols[i].st_value ||
+			a.symbols[i].st_size != b.symbols[i].st_size)
+			return false;
+	}
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+static int reload_file(const char* fname, int argc, char** argv)
+{
+	if (argc < 1)
+	{
+		usage();
+		return 1;
+	}
+	elf_results previous, full;
+	int ret = load_elf(fname, previous);
+	if (ret == elf_error::OK)
+		ret = load_elf(argv[0], full);
+	if (ret != elf_error::OK)
+		return ret;
+
+	FILE* file = fopen(argv[0], "rb");
+	if (!file)
+	{
+		fprintf(stdout, "Can't open file: %s\n", argv[0]);
+		return 1;
+	}
+	elf_results results;
+	elf_reload_report report;
+	ret = reload_elf_file(file, previous, results, report);
+	fclose(file);
+	if (ret != elf_error::OK)
+	{
+		fprintf(stdout, "Reload failed with error %d\n", ret);
+		return ret;
+	}
+
+	fprintf(stdout, "%u of %u units reused, %u of %u symbols reused\n", (uint32_t)report.units_reused,
+		(uint32_t)results.line_info_units.size(), (uint32_t)report.symbols_reused, (uint32_t)results.symbols.size());
+	for (size_t index : report.changed_units)
+		fprintf(stdout, "changed unit %u\n", (uint32_t)index);
+	for (const elf_moved_symbol& sym : report.moved_symbols)
+		fprintf(stdout, "moved %s %llx size %llu -> %llx size %llu\n", sym.name.c_str(),
+			(unsigned long long)sym.old_address, (unsigned long long)sym.old_size,
+			(unsigned long long)sym.new_address, (unsigned long long)sym.new_size);
+	fprintf(stdout, "same as a full parse: %s\n", same_lines_and_symbols(results, full) ? "yes" : "no");
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+static void put_le(std::string& data, uint64_t val, int size)
+{
+	for (int i = 0; i < size; ++i)
+		data.push_back((char)(val >> (i * 8)));
+}
+
+// ----------------------------------------------------------------------------
+static uint64_t get_le(const uint8_t* data, int size)
+{
+	uint64_t val = 0;
+	for (int i = size; i > 0; --i)
+		val = (val << 8) | data[i - 1];
+	return val;
+}
+
+// ----------------------------------------------------------------------------
+static int write_requests(const char*, int argc, char** argv)
+{
+	std::string out;
+	uint32_t tag = 1;
+	for (int i = 0; i + 2 < argc; i += 3, ++tag)
+	{
+		std::string kind = argv[i];
+		uint8_t module = (uint8_t)strtoul(argv[i + 1], nullptr, 10);
+		std::string payload;
+		uint8_t op;
+		if (kind == "line" || kind == "symbol")
+		{
+			op = kind == "line" ? SERVER_OP_ADDR_TO_LINE : SERVER_OP_ADDR_TO_SYMBOL;
+			put_le(payload, strtoull(argv[i + 2], nullptr, 16), 8);
+		}
+		else if (kind == "name")
+		{
+			op = SERVER_OP_NAME_TO_ADDR;
+			payload = argv[i + 2];
+		}
+		else if (kind == "addrs")
+		{
+			op = SERVER_OP_LINE_TO_ADDRS;
+			std::string path = argv[i + 2];
+			size_t colon = path.rfind(':');
+			if (colon == std::string::npos)
+			{
+				fprintf(stderr, "Bad path:line: %s\n", argv[i + 2]);
+				return 1;
+			}
+			put_le(payload, strtoul(path.c_str() + colon + 1, nullptr, 10), 4);
+			payload += path.substr(0, colon);
+		}
+		else if (kind == "op")
+		{
+			// The module follows the op here
+			op = (uint8_t)strtoul(argv[i + 1], nullptr, 10);
+			module = (uint8_t)strtoul(argv[i + 2], nullptr, 10);
+		}
+		else
+		{
+			fprintf(stderr, "Bad request: %s\n", argv[i]);
+			return 1;
+		}
+		put_le(out, payload.size(), 2);
+		put_le(out, op, 1);
+		put_le(out, module, 1);
+		put_le(out, tag, 4);
+		out += payload;
+	}
+	fwrite(out.data(), 1, out.size(), stdout);
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+static int read_replies(const char*, int, char**)
+{
+	std::vector<uint8_t> data;
+	uint8_t buf[4096];
+	size_t count;
+	while ((count = fread(buf, 1, sizeof(buf), stdin)) != 0)
+		data.insert(data.end(), buf, buf + count);
+
+	static const size_t HEADER_SIZE = 12;
+	size_t pos = 0;
+	while (data.size() - pos >= HEADER_SIZE)
+	{
+		const uint8_t* header = data.data() + pos;
+		uint32_t length = (uint32_t)get_le(header, 4);
+		if (data.size() - pos - HEADER_SIZE < length)
+			break;
+		uint8_t op = header[4];
+		uint8_t status = header[5];
+		fprintf(stdout, "tag %u op %u status %u", (uint32_t)get_le(header + 8, 4), op, status);
+
+		const uint8_t* p = header + HEADER_SIZE;
+		if (status == SERVER_STATUS_OK && op == SERVER_OP_ADDR_TO_LINE && length >= 16)
+			fprintf(stdout, ": row %llx line %u column %u %.*s", (unsigned long long)get_le(p, 8),
+				(uint32_t)get_le(p + 8, 4), (uint32_t)get_le(p + 12, 2), (int)get_le(p + 14, 2), p + 16);
+		else if (status == SERVER_STATUS_OK && op == SERVER_OP_ADDR_TO_SYMBOL && length >= 18)
+			fprintf(stdout, ": %llx size %llu %.*s", (unsigned long long)get_le(p, 8),
+				(unsigned long long)get_le(p + 8, 8), (int)get_le(p + 16, 2), p + 18);
+		else if (status == SERVER_STATUS_OK && op == SERVER_OP_NAME_TO_ADDR && length >= 16)
+			fprintf(stdout, ": %llx size %llu", (unsigned long long)get_le(p, 8),
+				(unsigned long long)get_le(p + 8, 8));
+		else if (status == SERVER_STATUS_OK && op == SERVER_OP_LINE_TO_ADDRS && length >= 4)
+		{
+			fprintf(stdout, ":");
+			for (uint32_t i = 0; i < get_le(p, 4) && 4 + i * 8 + 8 <= length; ++i)
+				fprintf(stdout, " %llx", (unsigned long long)get_le(p + 4 + i * 8, 8));
+		}
+		else if (length)
+			// The statistics vary with timing, so aren't shown
+			fprintf(stdout, ": %s", op == SERVER_OP_STATS ? "statistics" : "unexpected payload");
+		fprintf(stdout, "\n");
+		pos += HEADER_SIZE + length;
+	}
+	if (pos != data.size())
+		fprintf(stdout, "%u bytes left over\n", (uint32_t)(data.size() - pos));
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+static int dump_tos(const char* fname, int, char**)
+{
+	std::vector<uint8_t> data;
+	if (!read_file(fname, data))
+		return 1;
+
+	tos_results results;
+	int ret = process_tos_file(data.data(), data.size(), results);
+	if (ret != tos_error::OK)
+	{
+		fprintf(stdout, "Parsing failed with error %d\n", ret);
+		return ret;
+	}
+
+	const tos_header& header = results.header;
+	fprintf(stdout, "text %x data %x bss %x symbols %x\n", header.ph_tlen, header.ph_dlen,
+		header.ph_blen, header.ph_slen);
+	for (const tos_symbol& sym : results.symbols)
+		fprintf(stdout, "symbol %04x %08x \"%s\"\n", sym.type, sym.value, sym.name.c_str());
+
+	// Relocate a copy of TEXT and DATA to 0x10000, and show the longs changed
+	tos_segments segments;
+	ret = get_tos_segments(results, data.data(), data.size(), segments);
+	if (ret != tos_error::OK)
+	{
+		fprintf(stdout, "No segments, error %d\n", ret);
+		return ret;
+	}
+	std::vector<uint8_t> image(segments.text, segments.text + segments.text_size);
+	image.insert(image.end(), segments.data, segments.data + segments.data_size);
+	ret = relocate_tos_image(results, image.data(), image.size(), 0, 0x10000);
+	if (ret != tos_error::OK)
+	{
+		fprintf(stdout, "Relocation failed with error %d\n", ret);
+		return ret;
+	}
+	for (uint32_t offset : results.relocations)
+	{
+		const uint8_t* p = image.data() + offset;
+		fprintf(stdout, "reloc %x %02x%02x%02x%02x\n", offset, p[0], p[1], p[2], p[3]);
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+struct command
+{
+	const char* name;
+	bool file;
+	int (*func)(const char* fname, int argc, char** argv);
+};
+
+static const command commands[] =
+{
+	{ "async", true, load_async },
+	{ "debug", true, find_debug_file },
+	{ "dynsym", true, lookup_dynamic_symbols },
+	{ "frames", true, dump_frames },
+	{ "functions", true, dump_functions },
+	{ "image", true, dump_image },
+	{ "lazy", true, compare_lazy_lines },
+	{ "lookup", true, lookup_addresses },
+	{ "rangemap", false, build_range_map },
+	{ "ranges", true, dump_ranges },
+	{ "relocs", true, dump_relocations },
+	{ "reload", true, reload_file },
+	{ "replies", false, read_replies },
+	{ "requests", false, write_requests },
+	{ "shared", true, lookup_shared },
+	{ "space", false, lookup_address_space },
+	{ "tos", true, dump_tos },
+};
+
+// ----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		usage();
+		return 1;
+	}
+	for (const command& cmd : commands)
+	{
+		if (strcmp(cmd.name, argv[1]) != 0)
+			continue;
+		if (!cmd.file)
+			return cmd.func(nullptr, argc - 2, argv + 2) ? 1 : 0;
+		if (argc < 3)
+			break;
+		return cmd.func(argv[2], argc - 3, argv + 3) ? 1 : 0;
+	}
+	usage();
+	return 1;
+}
@@ -0,0 +1,38 @@
+// Source of the ELF fixtures, built by make_fixtures.sh
+int counter;
+int* counter_ptr = &counter;
+
+static inline __attribute__((always_inline)) int square(int x)
+{
+	return x * x;
+}
+
+__attribute__((noinline)) int sum_squares(int n)
+{
+	int total = 0;
+	for (int i = 0; i < n; ++i)
+		total += square(i);
+	return total;
+}
+
+// The throw goes in a separate .cold range
+__attribute__((noinline)) int checked_div(int a, int b)
+{
+	if (b == 0)
+		throw b;
+	return a / b;
+}
+
+int main(int argc, char** argv)
+{
+	(void)argv;
+	*counter_ptr += sum_squares(argc + 3);
+	try
+	{
+		return checked_div(counter, argc - 1);
+	}
+	catch (int)
+	{
+		return 1;
+	}
+}
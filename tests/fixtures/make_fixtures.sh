@@ -0,0 +1,111 @@
+#!/usr/bin/env sh
+# Rebuild the fixtures in this directory. They are checked in, since the
+# expected output depends on the exact compiler; after rebuilding them,
+# regenerate the expected output with "../run_tests.sh --update" and
+# check the differences by hand.
+set -e
+cd "$(dirname "$0")"
+CXX=g++
+# Keep the build directory out of the debug info
+CFLAGS="-O2 -g -fdebug-prefix-map=$(pwd)=."
+
+set -x
+${CXX} ${CFLAGS} -gdwarf-4 -Wl,--build-id=sha1 -o dwarf4 decoders.cpp
+${CXX} ${CFLAGS} -gdwarf-5 -Wl,--build-id=sha1 -o dwarf5 decoders.cpp
+objcopy --remove-section .debug_aranges dwarf4 noaranges
+# dwarf4 with .debug_aranges missing the cold parts at 0x1090, which must then
+# be found from the unit's DW_AT_ranges
+objcopy --dump-section .debug_aranges=aranges.tmp dwarf4
+python3 - <<'ARANGES'
+import struct
+data = open('aranges.tmp', 'rb').read()
+# One set: the header is padded to 16 bytes, then (address, length) pairs
+length, = struct.unpack_from('<I', data)
+tuples = [struct.unpack_from('<QQ', data, o) for o in range(16, 4 + length, 16)]
+tuples = [t for t in tuples if t[0] != 0x1090]
+body = data[4:16] + b''.join(struct.pack('<QQ', *t) for t in tuples)
+open('aranges.tmp', 'wb').write(struct.pack('<I', len(body)) + body)
+ARANGES
+objcopy --update-section .debug_aranges=aranges.tmp dwarf4 partial_aranges
+rm aranges.tmp
+${CXX} -O2 -c -o relocatable.o decoders.cpp
+${CXX} -O2 -fPIC -shared -Wl,--hash-style=gnu -o gnu_hash.so decoders.cpp
+${CXX} -O2 -fPIC -shared -Wl,--hash-style=sysv -o sysv_hash.so decoders.cpp
+
+# dwarf5 with its debug info moved to a separate file, which can be found
+# both by build ID and by .gnu_debuglink
+objcopy --only-keep-debug dwarf5 stripped.debug
+objcopy --strip-debug --add-gnu-debuglink=stripped.debug dwarf5 stripped
+build_id=$(readelf -n stripped | sed -n 's/.*Build ID: //p')
+rm -rf debug
+mkdir -p debug/.build-id/$(echo ${build_id} | cut -c1-2)
+ln -s ../../../stripped.debug debug/.build-id/$(echo ${build_id} | cut -c1-2)/$(echo ${build_id} | cut -c3-).debug
+
+# A TOS executable with relocations, a DRI symbol table with GST long names,
+# and LINE and HCLN line information hunks
+python3 - <<'PRG'
+import struct
+
+def symbol(name, type, value):
+	return name.ljust(8, b'\0')[:8] + struct.pack('>HI', type, value)
+
+def long_symbol(name, type, value):
+	# The name continues in the whole of the next record
+	return symbol(name[:8], type | 0x48, value) + name[8:22].ljust(14, b'\0')
+
+def hunk(offset, type, body):
+	body = struct.pack('>I', offset) + type + body
+	body = body.ljust((len(body) + 3) & ~3, b'\0')
+	return struct.pack('>II', 0x3f1, len(body) // 4) + body
+
+def hunk_file(name):
+	name = name.ljust((len(name) + 4) & ~3, b'\0')
+	return struct.pack('>I', len(name) // 4) + name
+
+def hcln_long(value):
+	if value < 0x100:
+		return bytes([value])
+	if value < 0x10000:
+		return b'\0' + struct.pack('>H', value)
+	return b'\0\0\0' + struct.pack('>I', value)
+
+text = bytearray(b'\x4e\x75' * 0x100)
+data = bytearray(8)
+bss_size = 0x10
+
+# Longs to relocate, as offsets from the start of TEXT. 0x10c needs a
+# 254 byte skip.
+relocs = [0x4, 0xc, 0x10c, 0x200]
+image = text + data
+for r in relocs:
+	struct.pack_into('>I', image, r, 0x100 + r)
+reloc_table = struct.pack('>I', relocs[0])
+for prev, r in zip(relocs, relocs[1:]):
+	gap = r - prev
+	while gap > 254:
+		reloc_table += b'\x01'
+		gap -= 254
+	reloc_table += bytes([gap])
+reloc_table += b'\0'
+if len(reloc_table) & 1:
+	reloc_table += b'\0'
+
+symbols = symbol(b'_start', 0xa200, 0)
+symbols += symbol(b'func_a', 0xa200, 0x20)
+symbols += long_symbol(b'a_long_function_name', 0xa200, 0x40)
+symbols += long_symbol(b'exactly_22_characters_', 0xa200, 0x80)
+symbols += symbol(b'mydata', 0xa400, 0x200)
+symbols += symbol(b'mybss', 0xa100, 0x208)
+symbols += symbol(b'CONST', 0xc000, 0x1234)
+
+lines = [(5, 0x100), (6, 0x104), (9, 0x110)]
+line_body = hunk_file(b'a.c') + b''.join(struct.pack('>II', l, pc) for l, pc in lines)
+# Line and PC deltas using each size of encoding
+hcln = [(10, 0x10), (2, 4), (300, 6), (70000, 2), (1, 0x20)]
+hcln_body = hunk_file(b'b.c') + struct.pack('>I', len(hcln)) + \
+	b''.join(hcln_long(l) + hcln_long(pc) for l, pc in hcln)
+debug = hunk(0, b'HEAD', bytes(8)) + hunk(0, b'LINE', line_body) + hunk(0x10, b'HCLN', hcln_body)
+
+header = struct.pack('>HIIIIIIH', 0x601a, len(text), len(data), bss_size, len(symbols), 0, 0, 0)
+open('symbols.prg', 'wb').write(header + image + symbols + reloc_table + debug + struct.pack('>I', 0))
+PRG
@@ -0,0 +1,183 @@
+#!/usr/bin/env sh
+# Compare what fonda decodes from the fixtures with the expected output in
+# expected/. Build fonda with src/build.sh first. Prints the differences and
+# fails if any output has changed. With --update, rewrite the expected
+# output instead.
+cd "$(dirname "$0")"
+SRC_PATH=../src
+CC=g++
+CFLAGS="-DDEBUG -I${SRC_PATH} -I${SRC_PATH}/lib -std=c++11 -g -O0 -Wall -pthread"
+LDFLAGS="-lc -pthread"
+FONDA=${SRC_PATH}/fonda
+
+if [ ! -x ${FONDA} ]; then
+	echo "Build ${FONDA} with build.sh first"
+	exit 1
+fi
+
+# The library objects are left by build.sh
+${CC} ${CFLAGS} -o fixture_dump fixture_dump.cpp \
+	${SRC_PATH}/fonda_lib/readelf.o ${SRC_PATH}/fonda_lib/readtos.o ${SRC_PATH}/fonda_lib/lookup_index.o \
+	${SRC_PATH}/fonda_lib/symbolizer.o ${SRC_PATH}/fonda_lib/address_space.o \
+	${SRC_PATH}/fonda_lib/async_loader.o ${LDFLAGS} || exit 1
+
+update=0
+if [ "$1" = "--update" ]; then
+	update=1
+fi
+out=$(mktemp -d)
+failed=0
+
+# check <name> <command...>: run the command, and compare its output with expected/<name>.txt
+check()
+{
+	name=$1
+	shift
+	"$@" > ${out}/${name}.txt 2>&1
+	if [ ${update} = 1 ]; then
+		cp ${out}/${name}.txt expected/${name}.txt
+	elif ! diff -u expected/${name}.txt ${out}/${name}.txt; then
+		echo "FAILED: ${name}"
+		failed=1
+	fi
+}
+
+# DWARF 4 and 5 units: line programs and functions
+check dwarf4_lines ${FONDA} fixtures/dwarf4
+check dwarf5_lines ${FONDA} fixtures/dwarf5
+check dwarf4_functions ./fixture_dump functions fixtures/dwarf4
+check dwarf5_functions ./fixture_dump functions fixtures/dwarf5
+
+# The same dumps as tab-separated values and as JSON lines
+check dwarf5_tsv ${FONDA} --format tsv fixtures/dwarf5
+check dwarf5_json ${FONDA} --format json fixtures/dwarf5
+check tos_json ${FONDA} --tos --format json fixtures/symbols.prg
+
+# Range lists: .debug_ranges in DWARF 4, .debug_rnglists in DWARF 5
+check dwarf4_ranges ./fixture_dump ranges fixtures/dwarf4
+check dwarf5_ranges ./fixture_dump ranges fixtures/dwarf5
+
+# Building range maps: ranges with the same value merge where they overlap or
+# touch; where values differ, the later range takes the overlap and the
+# earlier one keeps what is either side of it
+check range_map_merge ./fixture_dump rangemap 10-20:1 18-30:1 30-40:1 50-60:1 60-60:2 5-8:3
+check range_map_overlap ./fixture_dump rangemap 10-40:1 20-30:2 20-28:3 30-50:4 35-38:1 60-70:5 60-64:6 64-70:7
+
+# An inlined call: square() at 1210-1215, called from sum_squares()
+check dwarf4_inlines ${FONDA} addr2line -e fixtures/dwarf4 -a -f -i --column 1200 1210 1212 1215
+check dwarf5_inlines ${FONDA} addr2line -e fixtures/dwarf5 -a -f -i --column 1200 1210 1212 1215
+
+# Call frame information from .eh_frame: the PLT, whose CFA is an expression,
+# prologues, function bodies, an epilogue followed by DW_CFA_restore_state,
+# cold parts, and an address without an FDE
+FRAMES="1060 1090 1091 1095 10b6 10d0 10d1 10d5 10f7 10fb 10fc 1100 1200 1230 1240"
+check dwarf5_frames ./fixture_dump frames fixtures/dwarf5 ${FRAMES}
+
+# Program headers, and the PT_LOAD segments copied into a memory image: the
+# ELF header, code, read-only data, a gap between segments which is left
+# alone, initialised data and the bss after it
+check dwarf5_image ./fixture_dump image fixtures/dwarf5 0 1200 2000 3000 3da0 4048 4050
+
+# Relocations: dynamic ones in an executable, and section ones in an
+# object file, whose symbols are in .symtab
+check dwarf5_relocs ./fixture_dump relocs fixtures/dwarf5
+check relocatable_relocs ./fixture_dump relocs fixtures/relocatable.o
+
+# Dynamic symbol lookups through .gnu.hash and .hash. Only .hash has the
+# undefined symbols.
+DYNSYMS="_Z11sum_squaresi _Z11checked_divii counter counter_ptr main __cxa_throw missing"
+check gnu_hash_dynsym ./fixture_dump dynsym fixtures/gnu_hash.so ${DYNSYMS}
+check sysv_hash_dynsym ./fixture_dump dynsym fixtures/sysv_hash.so ${DYNSYMS}
+
+# Reloading a file reuses the line units and symbols that are unchanged since
+# the previous parse, and gives the same results as a full parse. When the
+# section table changes, here with .debug_aranges removed, the symbols are
+# parsed again but the unit is still reused. A unit rebuilt with DWARF 5 is
+# parsed again.
+check reload_unchanged ./fixture_dump reload fixtures/dwarf5 fixtures/dwarf5
+check reload_cpptest ./fixture_dump reload cpptest.elf cpptest.elf
+check reload_aranges ./fixture_dump reload fixtures/dwarf4 fixtures/partial_aranges
+check reload_section_removed ./fixture_dump reload fixtures/dwarf4 fixtures/noaranges
+check reload_rebuilt ./fixture_dump reload fixtures/dwarf4 fixtures/dwarf5
+
+# Separate debug files: by build ID under a debug directory, else by
+# .gnu_debuglink next to the file. Lines and inlines come from the debug file.
+check debug_build_id ./fixture_dump debug fixtures/stripped fixtures/debug
+check debug_link ./fixture_dump debug fixtures/stripped
+check debug_none ./fixture_dump debug fixtures/dwarf5
+check debug_addr2line ${FONDA} addr2line -e fixtures/stripped -a -f -i 1200 1210
+
+# Single lookups, with and without .debug_aranges, and with .debug_aranges
+# missing the cold parts at 1090-10cf. addr2line looks up a single address
+# without an index.
+LOOKUPS="1090 10b0 1200 1215 123d 1240 5000"
+check dwarf4_lookup ./fixture_dump lookup fixtures/dwarf4 ${LOOKUPS}
+check dwarf5_lookup ./fixture_dump lookup fixtures/dwarf5 ${LOOKUPS}
+check noaranges_lookup ./fixture_dump lookup fixtures/noaranges ${LOOKUPS}
+check partial_aranges_lookup ./fixture_dump lookup fixtures/partial_aranges ${LOOKUPS}
+check partial_aranges_addr2line ${FONDA} addr2line -e fixtures/partial_aranges -a -f 10b0
+
+# A TOS executable: GST long names, relocations, LINE and HCLN hunks
+check tos_symbols ./fixture_dump tos fixtures/symbols.prg
+check tos_lines ${FONDA} --tos fixtures/symbols.prg
+check tos_addr2line ${FONDA} addr2line -e fixtures/symbols.prg -a -f 0 20 2c 44 4c 80 104 112 200 20a 300
+
+# Snapshots of a symbolizer shared between threads: readers get the same
+# answers from every snapshot while the file is reloaded, and snapshots held
+# stay valid
+check shared_snapshots ./fixture_dump shared fixtures/dwarf5 1060 10b0 1200 1212 1235 5000
+
+# Line programs decoded lazily give the same lookups as the eager index, even
+# with a cache too small for more than the last unit used
+check lazy_lines_dwarf5 ./fixture_dump lazy fixtures/dwarf5 1 decoders.cpp:13 decoders.cpp:7 decoders.cpp:99
+check lazy_lines_test_fonda ./fixture_dump lazy test_fonda 1 main.cpp:10 main.cpp:40
+
+# Background loads in stages: symbols, the units covering the priority
+# addresses, then everything. Without .debug_aranges there is no priority
+# stage, and TOS files are read whole. A load stopped after its first stage
+# keeps that stage's snapshot, and a missing file publishes nothing.
+check async_stages ./fixture_dump async fixtures/dwarf5 0 1212 10b0
+check async_stopped ./fixture_dump async fixtures/dwarf5 1 1212
+check async_noaranges ./fixture_dump async fixtures/noaranges 0 1212
+check async_tos ./fixture_dump async fixtures/symbols.prg 0 20
+check async_missing ./fixture_dump async fixtures/missing 0
+
+# Runtime addresses in modules loaded at different biases: dwarf5 at 10000 and
+# 40000, the TOS executable at 80000, and two placements which overlap these
+MODULES="fixtures/dwarf5@10000 fixtures/dwarf5@40000 fixtures/symbols.prg@80000 fixtures/dwarf4@12000 fixtures/symbols.prg@7ff00"
+SPACE_LOOKUPS="f000 10000 11200 11212 41090 44100 80020 80104 80300 90000"
+check address_space ./fixture_dump space ${MODULES} -- ${SPACE_LOOKUPS}
+
+# A round trip through fonda --server, with two modules: each kind of query,
+# queries with no answer, a bad module, a bad payload, an unknown op and the
+# statistics. The server prints its statistics to stderr on exit, which
+# varies with timing.
+REQUESTS="line 0 1200 symbol 0 1212 name 0 _Z11sum_squaresi addrs 0 decoders.cpp:13 line 1 20 symbol 1 104"
+REQUESTS="${REQUESTS} name 1 a_long_function_name line 0 5000 name 0 missing addrs 1 b.c:99"
+REQUESTS="${REQUESTS} symbol 2 0 op 1 0 op 99 0 op 5 0"
+check server_round_trip sh -c "./fixture_dump requests ${REQUESTS} |
+	${FONDA} --server fixtures/dwarf5 fixtures/symbols.prg 2>/dev/null | ./fixture_dump replies"
+
+# Batch mode: output in command-line order whatever the number of jobs,
+# failures summarised on stderr with exit code 2, a list of inputs from
+# stdin, one output file per input with --outdir, and bad --jobs values
+BATCH="fixtures/symbols.prg fixtures/dwarf5 fixtures/missing fixtures/relocatable.o"
+check batch_jobs1 sh -c "${FONDA} --batch --jobs 1 ${BATCH} 2>/dev/null"
+check batch_jobs4 sh -c "${FONDA} --batch --jobs 4 ${BATCH} 2>/dev/null"
+check batch_summary sh -c "${FONDA} --batch --jobs 4 ${BATCH} 2>&1 >/dev/null; echo exit \$?"
+check batch_stdin sh -c "printf 'fixtures/relocatable.o\nfixtures/symbols.prg\n' | ${FONDA} --batch --format tsv - 2>/dev/null"
+check batch_outdir sh -c "mkdir ${out}/outdir; ${FONDA} --batch --outdir ${out}/outdir --format json ${BATCH} 2>/dev/null;
+	echo exit \$?;
+	cd ${out}/outdir && for f in *; do echo \"== \$f\"; cat \$f; done"
+check batch_bad_jobs sh -c "for jobs in 0 1025 4x abc; do ${FONDA} --batch --jobs \$jobs ${BATCH} > ${out}/jobs.txt 2>&1;
+	echo exit \$?; head -1 ${out}/jobs.txt; done"
+
+# The original sample files
+check cpptest_dump ${FONDA} cpptest.elf
+check test_fonda_dump ${FONDA} test_fonda
+
+rm -rf ${out}
+if [ ${failed} = 1 ]; then
+	exit 1
+fi
+echo "All tests passed"